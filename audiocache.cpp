@@ -0,0 +1,214 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QtCore/QDebug>
+
+#include <algorithm>
+
+#include "audiocache.h"
+
+static const QString LockFileName = "lock";
+// holds the time an entry has last been used, like FrameCache's
+static const QString UsedSuffix = ".used";
+// entries used more recently than this are never evicted, because
+// another instance may still be muxing them
+static const qint64 MinEvictionAge = 10 * 60 * 1000;
+
+static QAtomicInt stagingCount;
+
+
+struct AudioCacheEntry {
+    QString path;
+    qint64 size;
+    qint64 lastUsed;
+    bool operator<(const AudioCacheEntry &other) const { return lastUsed < other.lastUsed; }
+};
+
+
+class AudioCachePrivate {
+public:
+    AudioCachePrivate(void)
+        : maxSize(AudioCache::DefaultMaxSize)
+    { /* ... */ }
+    QString directory;
+    qint64 maxSize;
+
+    static QString suffix(const QString &format)
+    {
+        // AAC goes into an MP4 container, MP3 is stored as is
+        return format == "aac" ? "m4a" : format;
+    }
+    QString entryPath(const QString &key, const QString &format) const
+    {
+        return directory + "/" + key + "." + suffix(format);
+    }
+    // several exporters may encode the same music at the same time
+    QString stagingPath(const QString &key, const QString &format) const
+    {
+        return directory + "/" + key + QString(".part-%1-%2.")
+                .arg(QCoreApplication::applicationPid())
+                .arg(stagingCount.fetchAndAddRelaxed(1)) + suffix(format);
+    }
+    void touch(const QString &path) const;
+    void evictLocked(void);
+};
+
+
+void AudioCachePrivate::touch(const QString &path) const
+{
+    QFile used(path + UsedSuffix);
+    if (used.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        used.write(QByteArray::number(QDateTime::currentMSecsSinceEpoch()));
+}
+
+
+void AudioCachePrivate::evictLocked(void)
+{
+    QList<AudioCacheEntry> entries;
+    qint64 totalSize = 0;
+    foreach (QFileInfo file, QDir(directory).entryInfoList(QDir::Files)) {
+        const QString &name = file.fileName();
+        if (name == LockFileName || name.contains(".part-") || name.endsWith(UsedSuffix))
+            continue;
+        AudioCacheEntry entry;
+        entry.path = file.absoluteFilePath();
+        entry.size = file.size();
+        // entries without a stamp count as used when they were written
+        QFile used(entry.path + UsedSuffix);
+        entry.lastUsed = used.open(QIODevice::ReadOnly)
+                ? used.readAll().toLongLong()
+                : file.lastModified().toMSecsSinceEpoch();
+        totalSize += entry.size;
+        entries.append(entry);
+    }
+    std::sort(entries.begin(), entries.end());
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    foreach (AudioCacheEntry entry, entries) {
+        if (totalSize <= maxSize || now - entry.lastUsed < MinEvictionAge)
+            break;
+        if (QFile::remove(entry.path)) {
+            QFile::remove(entry.path + UsedSuffix);
+            totalSize -= entry.size;
+        }
+    }
+}
+
+
+AudioCache::AudioCache(void)
+    : d_ptr(new AudioCachePrivate)
+{
+    // ...
+}
+
+
+AudioCache::~AudioCache()
+{
+    // ...
+}
+
+
+void AudioCache::setDirectory(const QString &directory)
+{
+    d_ptr->directory = directory;
+    QDir().mkpath(directory);
+}
+
+
+QString AudioCache::directory(void) const
+{
+    return d_ptr->directory;
+}
+
+
+void AudioCache::setMaxSize(qint64 bytes)
+{
+    d_ptr->maxSize = bytes;
+}
+
+
+qint64 AudioCache::maxSize(void) const
+{
+    return d_ptr->maxSize;
+}
+
+
+bool AudioCache::isEnabled(void) const
+{
+    return d_ptr->maxSize > 0 && !d_ptr->directory.isEmpty();
+}
+
+
+QString AudioCache::key(const QString &audioFile, const QString &format, int bitrate)
+{
+    QFile file(audioFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return QString();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (!hash.addData(&file))
+        return QString();
+    return QString("%1-%2-%3").arg(QString::fromLatin1(hash.result().toHex())).arg(format).arg(bitrate);
+}
+
+
+QString AudioCache::lookup(const QString &key, const QString &format) const
+{
+    Q_D(const AudioCache);
+    if (!isEnabled() || key.isEmpty())
+        return QString();
+    const QString &path = d->entryPath(key, format);
+    // A hit counts as a use, so that the entry is evicted last and not
+    // while it's being muxed. The lock keeps eviction from removing it
+    // before it has been touched.
+    QLockFile lock(d->directory + "/" + LockFileName);
+    if (!lock.lock() || QFileInfo(path).size() == 0)
+        return QString();
+    d->touch(path);
+    return path;
+}
+
+
+QString AudioCache::begin(const QString &key, const QString &format)
+{
+    Q_D(AudioCache);
+    if (!isEnabled() || key.isEmpty())
+        return QString();
+    const QString &path = d->stagingPath(key, format);
+    QFile::remove(path);
+    return path;
+}
+
+
+QString AudioCache::commit(const QString &key, const QString &format, const QString &staging)
+{
+    Q_D(AudioCache);
+    const QString &path = d->entryPath(key, format);
+    QLockFile lock(d->directory + "/" + LockFileName);
+    if (!lock.lock() || QFileInfo(staging).size() == 0) {
+        QFile::remove(staging);
+        return QString();
+    }
+    // another instance may have cached the same music in the meantime
+    if (QFileInfo(path).exists())
+        QFile::remove(staging);
+    else if (!QFile::rename(staging, path)) {
+        QFile::remove(staging);
+        return QString();
+    }
+    d->touch(path);
+    d->evictLocked();
+    return path;
+}
+
+
+void AudioCache::abort(const QString &staging)
+{
+    QFile::remove(staging);
+}
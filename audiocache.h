@@ -0,0 +1,49 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __AUDIOCACHE_H_
+#define __AUDIOCACHE_H_
+
+#include <QString>
+#include <QScopedPointer>
+
+class AudioCachePrivate;
+
+// Persistent cache of encoded audio streams, keyed by a hash of the
+// music's contents, the format and the bitrate, so that the music has
+// to be encoded only once however often it gets exported. Entries are
+// written to a staging file and renamed into place once complete. When
+// the cache grows beyond its maximum size, the oldest entries are
+// evicted.
+class AudioCache
+{
+public:
+    AudioCache(void);
+    ~AudioCache();
+
+    static const qint64 DefaultMaxSize = 256 * 1024 * 1024;
+
+    void setDirectory(const QString &directory);
+    QString directory(void) const;
+    void setMaxSize(qint64 bytes);
+    qint64 maxSize(void) const;
+    bool isEnabled(void) const;
+
+    // format is "mp3" or "aac", bitrate in kbit/s
+    static QString key(const QString &audioFile, const QString &format, int bitrate);
+    // returns the file of a complete entry and marks it as recently
+    // used, or returns an empty string
+    QString lookup(const QString &key, const QString &format) const;
+    // returns a new file to encode an entry into
+    QString begin(const QString &key, const QString &format);
+    // makes a staged entry available and returns its file
+    QString commit(const QString &key, const QString &format, const QString &staging);
+    void abort(const QString &staging);
+
+private:
+    QScopedPointer<AudioCachePrivate> d_ptr;
+    Q_DECLARE_PRIVATE(AudioCache)
+    Q_DISABLE_COPY(AudioCache)
+};
+
+#endif // __AUDIOCACHE_H_
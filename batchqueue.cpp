@@ -0,0 +1,429 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <QTextStream>
+#include <QThread>
+#include <QtCore/QDebug>
+
+#include "batchqueue.h"
+#include "renderjob.h"
+
+static const QString StateFileSuffix = ".state";
+static const QString DoneTag = "done";
+static const int ManifestFields = 6;
+
+
+struct BatchJob {
+    BatchJob(void)
+        : line(0)
+        , bpm(0)
+        , frameOffset(0)
+        , preset(-1)
+        , done(false)
+    { /* ... */ }
+    int line;
+    QString gifFile;
+    QString audioFile;
+    QString outputFile;
+    // 0 means the tempo is estimated from the music
+    qreal bpm;
+    int frameOffset;
+    // -1 for the default preset
+    int preset;
+    bool done;
+};
+
+
+// identifies a job in the state file by all of its fields, so that a
+// job whose line has been changed since is rendered again
+static QString jobHash(const BatchJob &job)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << job.gifFile << job.audioFile << job.bpm << job.frameOffset << job.preset << job.outputFile;
+    return QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex());
+}
+
+
+class BatchQueuePrivate {
+public:
+    BatchQueuePrivate(void)
+        : maxFps(0)
+        , encoder(nullptr)
+        , audioEncoder(nullptr)
+        , maxEncoders(qMax(1, QThread::idealThreadCount() / 2))
+        , nextJob(0)
+        , preparing(0)
+        , encoding(0)
+        , done(0)
+        , doneBefore(0)
+        , failed(0)
+        , running(false)
+    { /* ... */ }
+    QList<BatchJob> jobs;
+    QString stateFile;
+    QString errorString;
+    ExportOptions defaults;
+    int maxFps;
+    QString cacheDirectory;
+    EncoderBackend *encoder;
+    EncoderBackend *audioEncoder;
+    int maxEncoders;
+    // the job with this index is the next to be prepared
+    int nextJob;
+    QHash<RenderJob*, int> activeJobs;
+    // jobs ready for encoding in the order they have been prepared
+    QList<RenderJob*> preparedJobs;
+    int preparing;
+    int encoding;
+    int done;
+    int doneBefore;
+    int failed;
+    bool running;
+    QElapsedTimer clock;
+};
+
+
+BatchQueue::BatchQueue(QObject *parent)
+    : QObject(parent)
+    , d_ptr(new BatchQueuePrivate)
+{
+    // ...
+}
+
+
+BatchQueue::~BatchQueue()
+{
+    cancel();
+}
+
+
+bool BatchQueue::load(const QString &manifestFile)
+{
+    Q_D(BatchQueue);
+    QFile manifest(manifestFile);
+    if (!manifest.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        d->errorString = tr("Cannot open %1: %2").arg(manifestFile).arg(manifest.errorString());
+        return false;
+    }
+    const QDir &baseDir = QFileInfo(manifestFile).absoluteDir();
+    const QStringList presets = QStringList() << "ultrafast" << "veryfast" << "balanced" << "hq";
+    QSet<QString> outputFiles;
+    d->jobs.clear();
+    QTextStream in(&manifest);
+    int line = 0;
+    while (!in.atEnd()) {
+        const QString &text = in.readLine().trimmed();
+        ++line;
+        if (text.isEmpty() || text.startsWith('#'))
+            continue;
+        QStringList fields = text.split(';');
+        if (fields.count() != ManifestFields) {
+            d->errorString = tr("%1:%2: expected %3 fields separated by \";\".").arg(manifestFile).arg(line).arg(ManifestFields);
+            return false;
+        }
+        for (int i = 0; i < fields.count(); ++i)
+            fields[i] = fields.at(i).trimmed();
+        BatchJob job;
+        job.line = line;
+        job.gifFile = baseDir.absoluteFilePath(fields.at(0));
+        job.audioFile = baseDir.absoluteFilePath(fields.at(1));
+        job.outputFile = QDir::cleanPath(baseDir.absoluteFilePath(fields.at(5)));
+        bool ok = true;
+        if (!fields.at(2).isEmpty() && fields.at(2) != "auto")
+            job.bpm = fields.at(2).toDouble(&ok);
+        if (!ok || job.bpm < 0) {
+            d->errorString = tr("%1:%2: invalid tempo: %3").arg(manifestFile).arg(line).arg(fields.at(2));
+            return false;
+        }
+        if (!fields.at(3).isEmpty())
+            job.frameOffset = fields.at(3).toInt(&ok);
+        if (!ok || job.frameOffset < 0) {
+            d->errorString = tr("%1:%2: invalid frame offset: %3").arg(manifestFile).arg(line).arg(fields.at(3));
+            return false;
+        }
+        if (!fields.at(4).isEmpty()) {
+            job.preset = presets.indexOf(fields.at(4).toLower());
+            if (job.preset < 0) {
+                d->errorString = tr("%1:%2: unknown preset: %3").arg(manifestFile).arg(line).arg(fields.at(4));
+                return false;
+            }
+        }
+        if (fields.at(0).isEmpty() || fields.at(1).isEmpty() || fields.at(5).isEmpty()) {
+            d->errorString = tr("%1:%2: gif, audio and output are required.").arg(manifestFile).arg(line);
+            return false;
+        }
+        // jobs writing the same file would overwrite each other
+        if (outputFiles.contains(job.outputFile)) {
+            d->errorString = tr("%1:%2: %3 is written by an earlier job already.").arg(manifestFile).arg(line).arg(job.outputFile);
+            return false;
+        }
+        outputFiles.insert(job.outputFile);
+        d->jobs.append(job);
+    }
+    // jobs finished in an earlier run are skipped, unless they have
+    // been changed or their video has gone missing since
+    d->stateFile = manifestFile + StateFileSuffix;
+    QSet<QString> doneHashes;
+    QFile state(d->stateFile);
+    if (state.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream stateIn(&state);
+        while (!stateIn.atEnd()) {
+            // tag, hash of the job, output file
+            const QStringList &entry = stateIn.readLine().split('\t');
+            if (entry.count() == 3 && entry.at(0) == DoneTag)
+                doneHashes.insert(entry.at(1));
+        }
+    }
+    d->done = 0;
+    for (int i = 0; i < d->jobs.count(); ++i) {
+        BatchJob &job = d->jobs[i];
+        job.done = doneHashes.contains(jobHash(job)) && QFileInfo(job.outputFile).exists();
+        if (job.done)
+            ++d->done;
+    }
+    d->doneBefore = d->done;
+    return true;
+}
+
+
+QString BatchQueue::errorString(void) const
+{
+    return d_ptr->errorString;
+}
+
+
+void BatchQueue::setDefaults(const ExportOptions &options, int maxFps)
+{
+    Q_D(BatchQueue);
+    d->defaults = options;
+    d->maxFps = maxFps;
+}
+
+
+void BatchQueue::setCacheDirectory(const QString &directory)
+{
+    d_ptr->cacheDirectory = directory;
+}
+
+
+void BatchQueue::setEncoder(EncoderBackend *encoder)
+{
+    d_ptr->encoder = encoder;
+}
+
+
+void BatchQueue::setAudioEncoder(EncoderBackend *encoder)
+{
+    d_ptr->audioEncoder = encoder;
+}
+
+
+void BatchQueue::setMaxEncoders(int count)
+{
+    d_ptr->maxEncoders = qMax(1, count);
+}
+
+
+int BatchQueue::maxEncoders(void) const
+{
+    return d_ptr->maxEncoders;
+}
+
+
+int BatchQueue::jobCount(void) const
+{
+    return d_ptr->jobs.count();
+}
+
+
+int BatchQueue::doneCount(void) const
+{
+    return d_ptr->done;
+}
+
+
+int BatchQueue::failedCount(void) const
+{
+    return d_ptr->failed;
+}
+
+
+qreal BatchQueue::jobsPerHour(void) const
+{
+    Q_D(const BatchQueue);
+    const int finished = d->done - d->doneBefore + d->failed;
+    if (!d->clock.isValid() || finished == 0)
+        return 0;
+    return 3600e3 * finished / qMax<qint64>(1, d->clock.elapsed());
+}
+
+
+void BatchQueue::start(void)
+{
+    Q_D(BatchQueue);
+    d->nextJob = 0;
+    d->failed = 0;
+    d->running = true;
+    d->clock.start();
+    schedule();
+}
+
+
+void BatchQueue::cancel(void)
+{
+    Q_D(BatchQueue);
+    d->running = false;
+    d->preparedJobs.clear();
+    foreach (RenderJob *job, d->activeJobs.keys()) {
+        job->cancel();
+        job->deleteLater();
+    }
+    d->activeJobs.clear();
+    d->preparing = 0;
+    d->encoding = 0;
+}
+
+
+void BatchQueue::schedule(void)
+{
+    Q_D(BatchQueue);
+    if (!d->running)
+        return;
+    while (d->encoding < d->maxEncoders && !d->preparedJobs.isEmpty()) {
+        ++d->encoding;
+        RenderJob *job = d->preparedJobs.takeFirst();
+        emit message(tr("[%1/%2] Encoding %3 ...").arg(d->activeJobs.value(job) + 1).arg(d->jobs.count()).arg(job->options().outputFile));
+        job->encode();
+    }
+    // The next jobs are decoded and analyzed while the encoders are
+    // busy, but no further ahead than there are encoders to keep the
+    // memory for the frames bounded.
+    while (d->preparing + d->preparedJobs.count() < d->maxEncoders && d->nextJob < d->jobs.count()) {
+        const int index = d->nextJob++;
+        if (!d->jobs.at(index).done)
+            startJob(index);
+    }
+    if (d->activeJobs.isEmpty() && d->nextJob >= d->jobs.count()) {
+        d->running = false;
+        emit finished(d->failed == 0);
+    }
+}
+
+
+void BatchQueue::startJob(int index)
+{
+    Q_D(BatchQueue);
+    const BatchJob &batchJob = d->jobs.at(index);
+    ExportOptions options = d->defaults;
+    options.audioFile = batchJob.audioFile;
+    options.outputFile = batchJob.outputFile;
+    options.frameOffset = batchJob.frameOffset;
+    if (batchJob.preset >= 0)
+        options.preset = EncoderBackend::Preset(batchJob.preset);
+    // The encoders run side by side and share the cores, a single
+    // process per job is enough to keep them busy.
+    options.segmentedExport = false;
+    if (options.threads == 0)
+        options.threads = qMax(1, QThread::idealThreadCount() / d->maxEncoders);
+    RenderJob *job = new RenderJob(this);
+    job->setGifFile(batchJob.gifFile);
+    job->setBpm(batchJob.bpm);
+    job->setMaxFps(d->maxFps);
+    job->setCacheDirectory(d->cacheDirectory);
+    job->setOptions(options);
+    job->setEncoder(d->encoder);
+    job->setAudioEncoder(d->audioEncoder);
+    QObject::connect(job, SIGNAL(message(QString)), SLOT(jobMessage(QString)));
+    QObject::connect(job, SIGNAL(prepared()), SLOT(jobPrepared()));
+    QObject::connect(job, SIGNAL(finished(bool)), SLOT(jobFinished(bool)));
+    d->activeJobs.insert(job, index);
+    ++d->preparing;
+    job->prepare();
+}
+
+
+void BatchQueue::jobMessage(const QString &text)
+{
+    Q_D(BatchQueue);
+    RenderJob *job = qobject_cast<RenderJob*>(sender());
+    if (job == nullptr || !d->activeJobs.contains(job))
+        return;
+    emit message(QString("[%1/%2] %3").arg(d->activeJobs.value(job) + 1).arg(d->jobs.count()).arg(text));
+}
+
+
+void BatchQueue::jobPrepared(void)
+{
+    Q_D(BatchQueue);
+    RenderJob *job = qobject_cast<RenderJob*>(sender());
+    if (job == nullptr || !d->activeJobs.contains(job))
+        return;
+    const BatchJob &batchJob = d->jobs.at(d->activeJobs.value(job));
+    if (batchJob.bpm <= 0)
+        jobMessage(tr("Estimated tempo: %1 bpm").arg(job->bpm(), 0, 'f', 2));
+    --d->preparing;
+    d->preparedJobs.append(job);
+    // encode() may fail right away, so it isn't called from here
+    QMetaObject::invokeMethod(this, "schedule", Qt::QueuedConnection);
+}
+
+
+void BatchQueue::jobFinished(bool ok)
+{
+    Q_D(BatchQueue);
+    RenderJob *job = qobject_cast<RenderJob*>(sender());
+    if (job == nullptr || !d->activeJobs.contains(job))
+        return;
+    const int index = d->activeJobs.take(job);
+    if (job->isPrepared())
+        --d->encoding;
+    else
+        --d->preparing;
+    job->deleteLater();
+    const QString &prefix = QString("[%1/%2] ").arg(index + 1).arg(d->jobs.count());
+    if (ok) {
+        markDone(index);
+        emit message(prefix + tr("Written video to \"%1\".").arg(d->jobs.at(index).outputFile));
+    }
+    else {
+        ++d->failed;
+        emit message(prefix + tr("Line %1 failed: %2").arg(d->jobs.at(index).line).arg(job->errorString()));
+    }
+    const int remaining = d->jobs.count() - d->done - d->failed;
+    const qreal rate = jobsPerHour();
+    if (rate > 0) {
+        const int minutesLeft = qRound(60 * remaining / rate);
+        emit message(tr("%1 of %2 jobs done, %3 failed, %4 jobs/hour, about %5:%6 h left")
+                     .arg(d->done).arg(d->jobs.count()).arg(d->failed)
+                     .arg(rate, 0, 'f', 1)
+                     .arg(minutesLeft / 60).arg(minutesLeft % 60, 2, 10, QChar('0')));
+    }
+    QMetaObject::invokeMethod(this, "schedule", Qt::QueuedConnection);
+}
+
+
+void BatchQueue::markDone(int index)
+{
+    Q_D(BatchQueue);
+    BatchJob &job = d->jobs[index];
+    job.done = true;
+    ++d->done;
+    // appended and closed right away, so it survives a crash
+    QFile state(d->stateFile);
+    if (state.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        QTextStream out(&state);
+        out << DoneTag << "\t" << jobHash(job) << "\t" << job.outputFile << "\n";
+    }
+    else {
+        qWarning() << "BatchQueue: cannot write" << d->stateFile;
+    }
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __BATCHQUEUE_H_
+#define __BATCHQUEUE_H_
+
+#include <QObject>
+#include <QString>
+#include <QScopedPointer>
+
+#include "videoexporter.h"
+
+class BatchQueuePrivate;
+class EncoderBackend;
+
+
+// Renders the jobs listed in a manifest file, one per line:
+//
+//   gif; audio; bpm; offset; preset; output
+//
+// bpm may be "auto" or empty to estimate the tempo, offset and preset
+// may be empty for the defaults. Relative paths are resolved against
+// the manifest's directory, lines starting with # are ignored.
+// Several jobs are decoded and analyzed at the same time, while the
+// number of concurrent encoders is limited. Every finished job is
+// appended to a state file next to the manifest, with a hash of its
+// fields, so that a queue which has been interrupted resumes with the
+// jobs not yet done, and jobs changed since are rendered again.
+class BatchQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BatchQueue(QObject *parent = nullptr);
+    ~BatchQueue();
+
+    bool load(const QString &manifestFile);
+    QString errorString(void) const;
+    // options of all jobs; input and output files, tempo, offset and
+    // preset are taken from the manifest
+    void setDefaults(const ExportOptions &options, int maxFps);
+    // directory of the caches shared by the jobs, none if empty
+    void setCacheDirectory(const QString &directory);
+    // must have been probed before start() is called
+    void setEncoder(EncoderBackend *encoder);
+    void setAudioEncoder(EncoderBackend *encoder);
+    void setMaxEncoders(int count);
+    int maxEncoders(void) const;
+    int jobCount(void) const;
+    // jobs done, including those of an earlier run
+    int doneCount(void) const;
+    int failedCount(void) const;
+    qreal jobsPerHour(void) const;
+
+public slots:
+    void start(void);
+    void cancel(void);
+
+signals:
+    void message(const QString&);
+    void finished(bool ok);
+
+private slots:
+    void schedule(void);
+    void jobMessage(const QString&);
+    void jobPrepared(void);
+    void jobFinished(bool ok);
+
+private: // methods
+    void startJob(int index);
+    void markDone(int index);
+
+private:
+    QScopedPointer<BatchQueuePrivate> d_ptr;
+    Q_DECLARE_PRIVATE(BatchQueue)
+    Q_DISABLE_COPY(BatchQueue)
+};
+
+#endif // __BATCHQUEUE_H_
@@ -0,0 +1,86 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __BOUNDEDQUEUE_H_
+#define __BOUNDEDQUEUE_H_
+
+#include <QQueue>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+
+// Thread-safe FIFO of limited capacity. Producers block while the
+// queue is full, consumers block while it is empty. After close()
+// push() fails and pop() drains the remaining items before failing.
+template <typename T>
+class BoundedQueue {
+public:
+    BoundedQueue(int capacity)
+        : mCapacity(capacity)
+        , mClosed(false)
+    { /* ... */ }
+
+    bool push(const T &item)
+    {
+        QMutexLocker locker(&mMutex);
+        while (mQueue.size() >= mCapacity && !mClosed)
+            mNotFull.wait(&mMutex);
+        if (mClosed)
+            return false;
+        mQueue.enqueue(item);
+        mNotEmpty.wakeOne();
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        QMutexLocker locker(&mMutex);
+        while (mQueue.isEmpty() && !mClosed)
+            mNotEmpty.wait(&mMutex);
+        if (mQueue.isEmpty())
+            return false;
+        item = mQueue.dequeue();
+        mNotFull.wakeOne();
+        return true;
+    }
+
+    void close(void)
+    {
+        QMutexLocker locker(&mMutex);
+        mClosed = true;
+        mNotEmpty.wakeAll();
+        mNotFull.wakeAll();
+    }
+
+    void clear(void)
+    {
+        QMutexLocker locker(&mMutex);
+        mQueue.clear();
+        mNotFull.wakeAll();
+    }
+
+    void reset(void)
+    {
+        QMutexLocker locker(&mMutex);
+        mQueue.clear();
+        mClosed = false;
+    }
+
+    int size(void) const
+    {
+        QMutexLocker locker(&mMutex);
+        return mQueue.size();
+    }
+
+    int capacity(void) const { return mCapacity; }
+
+private:
+    int mCapacity;
+    bool mClosed;
+    QQueue<T> mQueue;
+    mutable QMutex mMutex;
+    QWaitCondition mNotFull;
+    QWaitCondition mNotEmpty;
+};
+
+#endif // __BOUNDEDQUEUE_H_
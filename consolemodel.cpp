@@ -0,0 +1,129 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QVector>
+#include <QtCore/QDebug>
+
+#include "consolemodel.h"
+
+
+class ConsoleModelPrivate {
+public:
+    ConsoleModelPrivate(void)
+        : head(0)
+        , count(0)
+    {
+        lines.resize(ConsoleModel::DefaultCapacity);
+    }
+    QVector<QString> lines;
+    // slot of the oldest line
+    int head;
+    int count;
+
+    int slot(int row) const
+    {
+        return (head + row) % lines.size();
+    }
+};
+
+
+ConsoleModel::ConsoleModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , d_ptr(new ConsoleModelPrivate)
+{
+    // ...
+}
+
+
+ConsoleModel::~ConsoleModel()
+{
+    // ...
+}
+
+
+void ConsoleModel::setCapacity(int lines)
+{
+    Q_D(ConsoleModel);
+    beginResetModel();
+    d->lines = QVector<QString>(qMax(1, lines));
+    d->head = 0;
+    d->count = 0;
+    endResetModel();
+}
+
+
+int ConsoleModel::capacity(void) const
+{
+    return d_ptr->lines.size();
+}
+
+
+void ConsoleModel::appendLines(const QStringList &lines)
+{
+    Q_D(ConsoleModel);
+    if (lines.isEmpty())
+        return;
+    // of more lines than fit only the last ones are kept
+    const int n = qMin(lines.count(), d->lines.size());
+    const int overflow = d->count + n - d->lines.size();
+    if (overflow > 0) {
+        beginRemoveRows(QModelIndex(), 0, overflow - 1);
+        for (int row = 0; row < overflow; ++row)
+            d->lines[d->slot(row)].clear();
+        d->head = d->slot(overflow);
+        d->count -= overflow;
+        endRemoveRows();
+    }
+    beginInsertRows(QModelIndex(), d->count, d->count + n - 1);
+    for (int i = lines.count() - n; i < lines.count(); ++i)
+        d->lines[d->slot(d->count++)] = lines.at(i);
+    endInsertRows();
+}
+
+
+void ConsoleModel::replaceLastLine(const QString &line)
+{
+    Q_D(ConsoleModel);
+    if (d->count == 0) {
+        appendLines(QStringList(line));
+        return;
+    }
+    d->lines[d->slot(d->count - 1)] = line;
+    const QModelIndex &last = index(d->count - 1);
+    emit dataChanged(last, last);
+}
+
+
+void ConsoleModel::clear(void)
+{
+    Q_D(ConsoleModel);
+    beginResetModel();
+    for (int row = 0; row < d->count; ++row)
+        d->lines[d->slot(row)].clear();
+    d->head = 0;
+    d->count = 0;
+    endResetModel();
+}
+
+
+QString ConsoleModel::line(int row) const
+{
+    Q_D(const ConsoleModel);
+    if (row < 0 || row >= d->count)
+        return QString();
+    return d->lines.at(d->slot(row));
+}
+
+
+int ConsoleModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : d_ptr->count;
+}
+
+
+QVariant ConsoleModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || role != Qt::DisplayRole)
+        return QVariant();
+    return line(index.row());
+}
@@ -0,0 +1,41 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __CONSOLEMODEL_H_
+#define __CONSOLEMODEL_H_
+
+#include <QAbstractListModel>
+#include <QStringList>
+#include <QScopedPointer>
+
+class ConsoleModelPrivate;
+
+// Holds the last lines written to the console in a ring buffer of
+// fixed capacity, so the memory stays the same however long an
+// encoder keeps talking. When lines are appended to a full buffer,
+// the oldest ones are dropped.
+class ConsoleModel : public QAbstractListModel
+{
+public:
+    explicit ConsoleModel(QObject *parent = nullptr);
+    ~ConsoleModel();
+
+    static const int DefaultCapacity = 5000;
+
+    void setCapacity(int lines);
+    int capacity(void) const;
+    void appendLines(const QStringList &lines);
+    void replaceLastLine(const QString &line);
+    void clear(void);
+    QString line(int row) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+private:
+    QScopedPointer<ConsoleModelPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(ConsoleModel)
+    Q_DISABLE_COPY(ConsoleModel)
+};
+
+#endif // __CONSOLEMODEL_H_
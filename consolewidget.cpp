@@ -1,17 +1,72 @@
 // Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
 // All rights reserved.
 
+#include <QAction>
+#include <QApplication>
+#include <QClipboard>
+#include <QScrollBar>
+#include <QTimer>
 #include <QtCore/QDebug>
+#include <algorithm>
 #include "consolewidget.h"
+#include "consolemodel.h"
 #include "ui_consolewidget.h"
 #include "main.h"
 
+static const int FlushInterval = 100;
+
+
+class ConsoleWidgetPrivate {
+public:
+    ConsoleWidgetPrivate(void)
+        : replaceLastLine(false)
+        , overwrite(false)
+    { /* ... */ }
+    ConsoleModel model;
+    QTimer flushTimer;
+    // lines not yet handed to the model
+    QStringList pending;
+    // the first pending line replaces the model's last one
+    bool replaceLastLine;
+    // the last line ended in a carriage return
+    bool overwrite;
+
+    void addLine(const QString &line, bool replace)
+    {
+        if (!replace)
+            pending.append(line);
+        else if (!pending.isEmpty())
+            pending.last() = line;
+        else {
+            pending.append(line);
+            replaceLastLine = true;
+        }
+        // lines that wouldn't fit into the model anyway are dropped
+        if (pending.count() > model.capacity()) {
+            pending.erase(pending.begin(), pending.begin() + pending.count() - model.capacity());
+            replaceLastLine = false;
+        }
+    }
+};
+
+
 ConsoleWidget::ConsoleWidget(QWidget *parent)
     : QWidget(parent)
     , ui(new Ui::ConsoleWidget)
+    , d_ptr(new ConsoleWidgetPrivate)
 {
+    Q_D(ConsoleWidget);
     ui->setupUi(this);
     setWindowTitle(QString("%1 - Console").arg(AppName));
+    ui->consoleListView->setModel(&d->model);
+    d->flushTimer.setSingleShot(true);
+    d->flushTimer.setInterval(FlushInterval);
+    QObject::connect(&d->flushTimer, SIGNAL(timeout()), SLOT(flush()));
+    QAction *copyAction = new QAction(this);
+    copyAction->setShortcut(QKeySequence::Copy);
+    copyAction->setShortcutContext(Qt::WidgetShortcut);
+    ui->consoleListView->addAction(copyAction);
+    QObject::connect(copyAction, SIGNAL(triggered()), SLOT(copy()));
 }
 
 
@@ -30,17 +85,76 @@ void ConsoleWidget::closeEvent(QCloseEvent *e)
 
 void ConsoleWidget::clear(void)
 {
-    ui->consoleTextEdit->clear();
+    Q_D(ConsoleWidget);
+    d->flushTimer.stop();
+    d->pending.clear();
+    d->replaceLastLine = false;
+    d->overwrite = false;
+    d->model.clear();
 }
 
 
 void ConsoleWidget::out(const QString &msg)
 {
-    ui->consoleTextEdit->append(msg.trimmed());
+    Q_D(ConsoleWidget);
+    if (msg.isEmpty())
+        return;
+    const QStringList &lines = msg.split('\n');
+    for (int i = 0; i < lines.count(); ++i) {
+        const QString &line = lines.at(i);
+        if (i == lines.count() - 1 && line.isEmpty() && i > 0) {
+            // the message ended with a newline
+            d->overwrite = false;
+            break;
+        }
+        // of the text overwritten by carriage returns the last is shown
+        const QStringList &pieces = line.split('\r');
+        QString text;
+        for (int j = pieces.count() - 1; j >= 0 && text.isEmpty(); --j)
+            text = pieces.at(j);
+        d->addLine(text, i == 0 && d->overwrite);
+        d->overwrite = pieces.count() > 1 && pieces.last().isEmpty();
+    }
+    if (!d->flushTimer.isActive())
+        d->flushTimer.start();
 }
 
 
 void ConsoleWidget::err(const QString &msg)
 {
-    ui->consoleTextEdit->append(msg.trimmed());
+    out(msg);
+}
+
+
+void ConsoleWidget::flush(void)
+{
+    Q_D(ConsoleWidget);
+    if (d->pending.isEmpty())
+        return;
+    QScrollBar *scrollBar = ui->consoleListView->verticalScrollBar();
+    const bool atEnd = scrollBar->value() == scrollBar->maximum();
+    if (d->replaceLastLine)
+        d->model.replaceLastLine(d->pending.takeFirst());
+    d->model.appendLines(d->pending);
+    d->pending.clear();
+    d->replaceLastLine = false;
+    // follow the output unless the user has scrolled up
+    if (atEnd)
+        ui->consoleListView->scrollToBottom();
+}
+
+
+void ConsoleWidget::copy(void)
+{
+    Q_D(ConsoleWidget);
+    QList<int> rows;
+    foreach (QModelIndex index, ui->consoleListView->selectionModel()->selectedRows())
+        rows.append(index.row());
+    // the lines are selected in the order they have been clicked
+    std::sort(rows.begin(), rows.end());
+    QStringList lines;
+    foreach (int row, rows)
+        lines.append(d->model.line(row));
+    if (!lines.isEmpty())
+        QApplication::clipboard()->setText(lines.join('\n'));
 }
@@ -6,11 +6,18 @@
 
 #include <QWidget>
 #include <QCloseEvent>
+#include <QScopedPointer>
 
 namespace Ui {
 class ConsoleWidget;
 }
 
+class ConsoleWidgetPrivate;
+
+// Shows the output of the encoders. Incoming text is collected and
+// handed to the view at most every 100 ms. A line ending in a carriage
+// return is overwritten by the next one, like in a terminal. Only the
+// last ConsoleModel::DefaultCapacity lines are kept.
 class ConsoleWidget : public QWidget
 {
     Q_OBJECT
@@ -30,8 +37,16 @@ public slots:
     void out(const QString&);
     void err(const QString&);
 
+private slots:
+    void flush(void);
+    void copy(void);
+
 private:
     Ui::ConsoleWidget *ui;
+
+    QScopedPointer<ConsoleWidgetPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(ConsoleWidget)
+    Q_DISABLE_COPY(ConsoleWidget)
 };
 
 #endif // __CONSOLEWIDGET_H_
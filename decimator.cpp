@@ -0,0 +1,257 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QVector>
+#include <QtCore/qmath.h>
+#include <QtCore/QDebug>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DECIMATOR_USE_SSE
+#include <emmintrin.h>
+#endif
+
+#include "decimator.h"
+
+
+class DecimatorPrivate {
+public:
+    DecimatorPrivate(void)
+        : inputRate(0)
+        , outputRate(Decimator::DefaultOutputRate)
+        , channels(0)
+        , L(1)
+        , M(1)
+        , pos(0)
+        , phase(0)
+    { /* ... */ }
+    int inputRate;
+    int outputRate;
+    int channels;
+    // upsampling factor
+    int L;
+    // downsampling factor
+    int M;
+    // L phases with TapsPerPhase coefficients each, stored in reverse
+    // order so that they can be multiplied element by element with
+    // the history buffer
+    QVector<float> coeffs;
+    // mono input samples not yet consumed, preceded by TapsPerPhase-1
+    // samples of history
+    QVector<float> history;
+    int pos;
+    int phase;
+};
+
+
+static int gcd(int a, int b)
+{
+    while (b != 0) {
+        const int tmp = b;
+        b = a % b;
+        a = tmp;
+    }
+    return a;
+}
+
+
+// zeroth order modified Bessel function of the first kind, needed for the Kaiser window
+static qreal besselI0(qreal x)
+{
+    qreal sum = 1;
+    qreal term = 1;
+    const qreal halfX = 0.5 * x;
+    for (int k = 1; k < 32; ++k) {
+        term *= halfX / k;
+        sum += term * term;
+    }
+    return sum;
+}
+
+
+static inline float dotProduct(const float *a, const float *b, int n)
+{
+#ifdef DECIMATOR_USE_SSE
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    float partial[4];
+    _mm_storeu_ps(partial, acc0);
+    float sum = partial[0] + partial[1] + partial[2] + partial[3];
+    for (; i < n; ++i)
+        sum += a[i] * b[i];
+    return sum;
+#else
+    float sum = 0;
+    for (int i = 0; i < n; ++i)
+        sum += a[i] * b[i];
+    return sum;
+#endif
+}
+
+
+Decimator::Decimator(void)
+    : d_ptr(new DecimatorPrivate)
+{
+    // ...
+}
+
+
+Decimator::~Decimator()
+{
+    // ...
+}
+
+
+void Decimator::setFormat(int inputRate, int channels, int outputRate)
+{
+    Q_D(Decimator);
+    if (inputRate == d->inputRate && channels == d->channels && outputRate == d->outputRate)
+        return;
+    d->inputRate = inputRate;
+    d->channels = channels;
+    d->outputRate = outputRate;
+    if (!isValid())
+        return;
+    const int div = gcd(inputRate, outputRate);
+    d->L = outputRate / div;
+    d->M = inputRate / div;
+    designFilter();
+    reset();
+}
+
+
+bool Decimator::isValid(void) const
+{
+    return d_ptr->inputRate > 0 && d_ptr->outputRate > 0 && d_ptr->channels > 0;
+}
+
+
+int Decimator::inputRate(void) const
+{
+    return d_ptr->inputRate;
+}
+
+
+int Decimator::outputRate(void) const
+{
+    return d_ptr->outputRate;
+}
+
+
+int Decimator::channelCount(void) const
+{
+    return d_ptr->channels;
+}
+
+
+void Decimator::reset(void)
+{
+    Q_D(Decimator);
+    d->history.fill(0, TapsPerPhase - 1);
+    d->pos = TapsPerPhase - 1;
+    d->phase = 0;
+}
+
+
+void Decimator::designFilter(void)
+{
+    Q_D(Decimator);
+    // windowed sinc low-pass at the upsampled rate L * inputRate,
+    // cutting off a little below the lower of the two Nyquist frequencies
+    static const qreal Beta = 7.0;
+    static const qreal Rolloff = 0.9;
+    const int N = d->L * TapsPerPhase;
+    const qreal fc = Rolloff * 0.5 / qMax(d->L, d->M);
+    const qreal center = 0.5 * (N - 1);
+    const qreal i0Beta = besselI0(Beta);
+    QVector<qreal> h(N);
+    qreal sum = 0;
+    for (int n = 0; n < N; ++n) {
+        const qreal x = n - center;
+        const qreal sinc = qFuzzyIsNull(x) ? 2 * fc : qSin(2 * M_PI * fc * x) / (M_PI * x);
+        const qreal r = 2 * x / (N - 1);
+        const qreal window = besselI0(Beta * qSqrt(qMax(qreal(0), 1 - r * r))) / i0Beta;
+        h[n] = sinc * window;
+        sum += h[n];
+    }
+    // the zero-stuffed input carries only 1/L of the energy, so
+    // every phase has to have a DC gain of 1, i.e. the prototype L
+    const qreal gain = d->L / sum;
+    d->coeffs.resize(N);
+    for (int p = 0; p < d->L; ++p) {
+        float *phaseCoeffs = d->coeffs.data() + p * TapsPerPhase;
+        for (int k = 0; k < TapsPerPhase; ++k)
+            phaseCoeffs[TapsPerPhase - 1 - k] = float(gain * h[p + k * d->L]);
+    }
+}
+
+
+void Decimator::process(const SampleBufferType *in, int frameCount, SampleBuffer &out)
+{
+    Q_D(Decimator);
+    if (!isValid() || frameCount <= 0)
+        return;
+    const int offset = d->history.size();
+    d->history.resize(offset + frameCount);
+    float *dst = d->history.data() + offset;
+    const float scale = 1.f / d->channels;
+    if (d->channels == 1) {
+        for (int i = 0; i < frameCount; ++i)
+            dst[i] = in[i];
+    }
+    else {
+        for (int i = 0; i < frameCount; ++i) {
+            int sum = 0;
+            for (int c = 0; c < d->channels; ++c)
+                sum += *in++;
+            dst[i] = scale * sum;
+        }
+    }
+    filter(out);
+}
+
+
+void Decimator::flush(SampleBuffer &out)
+{
+    Q_D(Decimator);
+    if (!isValid())
+        return;
+    // push the samples still sitting in the filter's delay line out
+    d->history.resize(d->history.size() + TapsPerPhase / 2);
+    filter(out);
+    reset();
+}
+
+
+void Decimator::filter(SampleBuffer &out)
+{
+    Q_D(Decimator);
+    const int available = d->history.size();
+    if (d->L == d->M) {
+        for (int i = d->pos; i < available; ++i)
+            out.append(SampleBufferType(qBound(-32768, qRound(d->history[i]), 32767)));
+        d->pos = available;
+    }
+    else {
+        const float *x = d->history.constData();
+        const float *coeffs = d->coeffs.constData();
+        while (d->pos < available) {
+            const float y = dotProduct(coeffs + d->phase * TapsPerPhase, x + d->pos - (TapsPerPhase - 1), TapsPerPhase);
+            out.append(SampleBufferType(qBound(-32768, qRound(y), 32767)));
+            d->phase += d->M;
+            d->pos += d->phase / d->L;
+            d->phase %= d->L;
+        }
+    }
+    // keep only the samples still needed for the next output
+    const int consumed = qMin(d->pos, available) - (TapsPerPhase - 1);
+    if (consumed > 0) {
+        d->history.remove(0, consumed);
+        d->pos -= consumed;
+    }
+}
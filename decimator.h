@@ -0,0 +1,45 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __DECIMATOR_H_
+#define __DECIMATOR_H_
+
+#include <QScopedPointer>
+#include "types.h"
+
+class DecimatorPrivate;
+
+// Streaming polyphase low-pass resampler. Converts interleaved
+// 16 bit PCM of any channel count into mono at a (usually much
+// lower) analysis sample rate. The conversion ratio is reduced to
+// L/M, and each output sample is computed as the dot product of
+// one of L filter phases with the most recent input samples.
+class Decimator
+{
+public:
+    Decimator(void);
+    ~Decimator();
+
+    static const int DefaultOutputRate = 11025;
+    static const int TapsPerPhase = 32;
+
+    void setFormat(int inputRate, int channels, int outputRate = DefaultOutputRate);
+    bool isValid(void) const;
+    int inputRate(void) const;
+    int outputRate(void) const;
+    int channelCount(void) const;
+    void reset(void);
+    void process(const SampleBufferType *in, int frameCount, SampleBuffer &out);
+    void flush(SampleBuffer &out);
+
+private: // methods
+    void designFilter(void);
+    void filter(SampleBuffer &out);
+
+private:
+    QScopedPointer<DecimatorPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(Decimator)
+    Q_DISABLE_COPY(Decimator)
+};
+
+#endif // __DECIMATOR_H_
@@ -0,0 +1,172 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QProcess>
+#include <QtCore/QDebug>
+
+#include "encoderbackend.h"
+
+static const int ProbeTimeout = 10 * 1000;
+
+
+QString EncoderCommand::toString(void) const
+{
+    QStringList words;
+    words.append(QString("\"%1\"").arg(program));
+    foreach (QString argument, arguments)
+        words.append(argument.contains(' ') || argument.isEmpty()
+                     ? QString("\"%1\"").arg(argument)
+                     : argument);
+    return words.join(' ');
+}
+
+
+class EncoderBackendPrivate {
+public:
+    EncoderBackendPrivate(void)
+        : probed(false)
+        , available(false)
+        , threads(false)
+    { /* ... */ }
+    QMutex mutex;
+    QString executable;
+    // the executable the capabilities below belong to
+    QString probedExecutable;
+    bool probed;
+    bool available;
+    QStringList encoders;
+    bool threads;
+};
+
+
+EncoderBackend::EncoderBackend(void)
+    : d_ptr(new EncoderBackendPrivate)
+{
+    // ...
+}
+
+
+EncoderBackend::~EncoderBackend()
+{
+    // ...
+}
+
+
+void EncoderBackend::setExecutable(const QString &executable)
+{
+    QMutexLocker locker(&d_ptr->mutex);
+    d_ptr->executable = executable;
+}
+
+
+QString EncoderBackend::executable(void) const
+{
+    QMutexLocker locker(&d_ptr->mutex);
+    return d_ptr->executable;
+}
+
+
+bool EncoderBackend::probe(void)
+{
+    Q_D(EncoderBackend);
+    QMutexLocker locker(&d->mutex);
+    if (d->probed && d->probedExecutable == d->executable)
+        return d->available;
+    QStringList encoders;
+    bool threads = false;
+    const QString executable = d->executable;
+    locker.unlock();
+    const bool available = probeExecutable(&encoders, &threads);
+    locker.relock();
+    d->probedExecutable = executable;
+    d->probed = true;
+    d->available = available;
+    d->encoders = encoders;
+    d->threads = threads;
+    return available;
+}
+
+
+bool EncoderBackend::isProbed(void) const
+{
+    QMutexLocker locker(&d_ptr->mutex);
+    return d_ptr->probed && d_ptr->probedExecutable == d_ptr->executable;
+}
+
+
+bool EncoderBackend::isAvailable(void) const
+{
+    QMutexLocker locker(&d_ptr->mutex);
+    return d_ptr->available;
+}
+
+
+bool EncoderBackend::hasEncoder(const QString &codec) const
+{
+    QMutexLocker locker(&d_ptr->mutex);
+    return d_ptr->encoders.contains(codec);
+}
+
+
+bool EncoderBackend::supportsThreads(void) const
+{
+    QMutexLocker locker(&d_ptr->mutex);
+    return d_ptr->threads;
+}
+
+
+QByteArray EncoderBackend::run(const QStringList &arguments) const
+{
+    QProcess process;
+    process.setProcessChannelMode(QProcess::MergedChannels);
+    process.start(executable(), arguments);
+    if (!process.waitForStarted(ProbeTimeout))
+        return QByteArray();
+    process.closeWriteChannel();
+    if (!process.waitForFinished(ProbeTimeout)) {
+        process.kill();
+        process.waitForFinished();
+    }
+    return process.readAll();
+}
+
+
+QString EncoderOutputReader::read(const QByteArray &output, bool *progressed)
+{
+    if (progressed != nullptr)
+        *progressed = false;
+    mBuffer.append(output);
+    QString text;
+    int begin = 0;
+    for (int i = 0; i < mBuffer.size(); ++i) {
+        const char c = mBuffer.at(i);
+        if (c != '\n' && c != '\r')
+            continue;
+        const QString &line = QString::fromLocal8Bit(mBuffer.constData() + begin, i - begin);
+        begin = i + 1;
+        const EncoderBackend::LineType type = mEncoder != nullptr
+                ? mEncoder->parseLine(line, &mPending)
+                : EncoderBackend::OutputLine;
+        if (type == EncoderBackend::ProgressEndLine) {
+            mProgress = mPending;
+            mHasProgress = true;
+            if (progressed != nullptr)
+                *progressed = true;
+        }
+        else if (type == EncoderBackend::OutputLine && !line.isEmpty()) {
+            text += line + "\n";
+        }
+    }
+    mBuffer.remove(0, begin);
+    return text;
+}
+
+
+QString EncoderOutputReader::flush(void)
+{
+    const QString &line = QString::fromLocal8Bit(mBuffer);
+    mBuffer.clear();
+    return line;
+}
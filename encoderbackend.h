@@ -0,0 +1,201 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __ENCODERBACKEND_H_
+#define __ENCODERBACKEND_H_
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QSize>
+#include <QScopedPointer>
+
+class EncoderBackendPrivate;
+struct EncoderParams;
+
+
+// A program to run together with its arguments.
+struct EncoderCommand {
+    EncoderCommand(void) { /* ... */ }
+    EncoderCommand(const QString &program, const QStringList &arguments)
+        : program(program)
+        , arguments(arguments)
+    { /* ... */ }
+    QString program;
+    QStringList arguments;
+    // for display only, the arguments are never parsed back
+    QString toString(void) const;
+};
+
+
+// A progress report of an encoder process.
+struct EncoderProgress {
+    EncoderProgress(void)
+        : frames(0)
+        , time(0)
+        , fps(0)
+        , bitrate(0)
+    { /* ... */ }
+    // frames written so far
+    int frames;
+    // seconds of video written so far, 0 if unknown
+    qreal time;
+    // frames encoded per second
+    qreal fps;
+    // bitrate of the video written so far in kbit/s, 0 if unknown
+    qreal bitrate;
+    // Frames of the schedule written so far. The encoder may write
+    // fewer frames if it drops repeated ones, so go by the time.
+    int scheduledFrames(qreal fps) const
+    {
+        return time > 0 ? qRound(time * fps) : frames;
+    }
+};
+
+
+// Turns the parameters of an encoding job into the arguments of an
+// external encoder. The executable is probed once for the codecs it
+// has been built with, so that the best available codec can be picked
+// without the user having to know. probe() may run in another thread.
+class EncoderBackend
+{
+public:
+    virtual ~EncoderBackend();
+
+    enum Preset {
+        Ultrafast,
+        Veryfast,
+        Balanced,
+        HighQuality
+    };
+
+    // H.264 needs an encoder built with x264, MPEG-4 is the fallback
+    enum Codec {
+        H264,
+        Mpeg4
+    };
+
+    virtual QString name(void) const = 0;
+    void setExecutable(const QString &executable);
+    QString executable(void) const;
+
+    // runs the executable unless it has already been probed
+    bool probe(void);
+    // whether the probe of the current executable has finished
+    bool isProbed(void) const;
+    bool isAvailable(void) const;
+    bool hasEncoder(const QString &codec) const;
+    bool supportsThreads(void) const;
+
+    // Contents of the file naming the frame images in display order. A
+    // file named several times in a row is the same frame repeated.
+    virtual QByteArray frameList(const QStringList &frameFiles, qreal fps) const = 0;
+    virtual EncoderCommand encodeCommand(const EncoderParams &params) const = 0;
+    // Joins the video streams of the input files without re-encoding
+    // and muxes the audio. The list file may be written to name the
+    // inputs to the encoder.
+    virtual EncoderCommand concatCommand(const QStringList &inputFiles, const QString &listFile, const EncoderParams &params) const = 0;
+    // "mp3" or "aac" if the audio gets encoded for the output file,
+    // empty if it is copied as is
+    virtual QString audioFormat(const EncoderParams &params) const = 0;
+    // Encodes the audio file only, in the given format. The command's
+    // program is empty if the encoder can't do that.
+    virtual EncoderCommand audioCommand(const EncoderParams &params, const QString &format) const = 0;
+
+    enum LineType {
+        OutputLine,
+        // part of a progress report
+        ProgressLine,
+        // completes a progress report
+        ProgressEndLine
+    };
+    // fills in the progress from a line the encoder has written
+    virtual LineType parseLine(const QString &line, EncoderProgress *progress) const = 0;
+
+protected:
+    EncoderBackend(void);
+    // fills in the encoders the executable knows and whether it can
+    // encode with several threads, returns false if it did not run
+    virtual bool probeExecutable(QStringList *encoders, bool *threads) const = 0;
+    QByteArray run(const QStringList &arguments) const;
+
+private:
+    QScopedPointer<EncoderBackendPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(EncoderBackend)
+    Q_DISABLE_COPY(EncoderBackend)
+};
+
+
+// Splits the output of an encoder into lines, which may end in \r
+// while the encoder keeps overwriting its status line, and picks out
+// the progress reports.
+class EncoderOutputReader {
+public:
+    explicit EncoderOutputReader(const EncoderBackend *encoder = nullptr)
+        : mEncoder(encoder)
+        , mHasProgress(false)
+    { /* ... */ }
+    // Returns the complete lines of the output read so far which aren't
+    // part of progress reports. progressed is set if at least one
+    // report has been completed.
+    QString read(const QByteArray &output, bool *progressed = nullptr);
+    // returns what is left of the last line
+    QString flush(void);
+    bool hasProgress(void) const { return mHasProgress; }
+    // the last complete report
+    const EncoderProgress &progress(void) const { return mProgress; }
+
+private:
+    const EncoderBackend *mEncoder;
+    QByteArray mBuffer;
+    // the report being read
+    EncoderProgress mPending;
+    EncoderProgress mProgress;
+    bool mHasProgress;
+};
+
+
+struct EncoderParams {
+    EncoderParams(void)
+        : fps(25)
+        , frames(0)
+        , threads(1)
+        , preset(EncoderBackend::Balanced)
+        , codec(EncoderBackend::H264)
+        , dropDuplicates(false)
+        , audioEncoded(false)
+        , audioBitrate(128)
+        , subtitleDelay(0)
+    { /* ... */ }
+    // file written from EncoderBackend::frameList(), if empty the
+    // frames are read from standard input as YUV4MPEG2
+    QString frameListFile;
+    QSize size;
+    qreal fps;
+    // number of frames to write, 0 for all; frame lists give it so
+    // that every chunk and segment lasts exactly as scheduled
+    int frames;
+    int threads;
+    EncoderBackend::Preset preset;
+    EncoderBackend::Codec codec;
+    // Frames read from standard input carry no duration, so repeated
+    // ones can only be dropped at the cost of cutting the last one
+    // short. Only set this if the video isn't joined with others.
+    bool dropDuplicates;
+    // no audio if empty
+    QString audioFile;
+    // the audio file has been encoded for the output already and is
+    // muxed without re-encoding
+    bool audioEncoded;
+    int audioBitrate;
+    // no subtitles if empty
+    QString subtitleFile;
+    QString subtitleFont;
+    // seconds to shift the subtitles by
+    qreal subtitleDelay;
+    // passed to the encoder in front of the output file
+    QStringList extraOptions;
+    QString outputFile;
+};
+
+#endif // __ENCODERBACKEND_H_
@@ -0,0 +1,255 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QFile>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QtCore/QDebug>
+
+#include "ffmpegbackend.h"
+
+// x264 presets and constant rate factors per quality preset
+static const char *X264Presets[] = { "ultrafast", "veryfast", "medium", "veryslow" };
+static const int X264Crf[] = { 23, 21, 19, 15 };
+// quantizers of the native MPEG-4 encoder per quality preset
+static const int Mpeg4Quantizers[] = { 5, 4, 3, 2 };
+// progress is reported as key=value lines on standard output instead
+// of the status line on standard error
+static const QStringList ProgressArguments = QStringList() << "-nostats" << "-progress" << "pipe:1";
+
+
+// a line of the concat demuxer's script, see
+// https://ffmpeg.org/ffmpeg-formats.html#concat
+static QByteArray concatFileLine(const QString &fileName)
+{
+    return "file '" + QString(fileName).replace("'", "'\\''").toUtf8() + "'\n";
+}
+
+
+// escapes a value for a filter option and then for the filtergraph,
+// see https://ffmpeg.org/ffmpeg-filters.html#Notes-on-filtergraph-escaping
+static QString escapeFilterValue(const QString &value)
+{
+    QString escaped;
+    foreach (QChar c, value) {
+        if (c == '\\' || c == '\'' || c == ':')
+            escaped += '\\';
+        escaped += c;
+    }
+    QString graphEscaped;
+    foreach (QChar c, escaped) {
+        if (c == '\\' || c == '\'' || c == '[' || c == ']' || c == ',' || c == ';')
+            graphEscaped += '\\';
+        graphEscaped += c;
+    }
+    return graphEscaped;
+}
+
+
+FfmpegBackend::FfmpegBackend(void)
+{
+    // ...
+}
+
+
+QString FfmpegBackend::name(void) const
+{
+    return "ffmpeg";
+}
+
+
+bool FfmpegBackend::probeExecutable(QStringList *encoders, bool *threads) const
+{
+    // encoders are listed like " V....D libx264    libx264 H.264 ..."
+    static const QRegExp encoderLine("^\\s*[VAS][\\.A-Z]{5}\\s+(\\S+)\\s");
+    const QByteArray &output = run(QStringList() << "-hide_banner" << "-encoders");
+    if (!output.contains("Encoders:"))
+        return false;
+    foreach (QString line, QString::fromLocal8Bit(output).split('\n')) {
+        QRegExp re(encoderLine);
+        if (re.indexIn(line) == 0)
+            encoders->append(re.cap(1));
+    }
+    const QByteArray &version = run(QStringList() << "-version");
+    *threads = !version.contains("--disable-pthreads") || version.contains("--enable-w32threads");
+    return true;
+}
+
+
+QByteArray FfmpegBackend::frameList(const QStringList &frameFiles, qreal fps) const
+{
+    // A repeated frame is listed once for as long as it is held, so it
+    // only gets encoded once, see encodeCommand(). The last frame is
+    // listed on its own so that the video doesn't end before it does.
+    QByteArray list = "ffconcat version 1.0\n";
+    const int nFiles = frameFiles.size();
+    int i = 0;
+    while (i < nFiles) {
+        int repeats = 1;
+        while (i + repeats < nFiles - 1 && frameFiles.at(i + repeats) == frameFiles.at(i))
+            ++repeats;
+        list.append(concatFileLine(frameFiles.at(i)))
+                .append("duration " + QByteArray::number(repeats / fps, 'f', 6) + "\n");
+        i += repeats;
+    }
+    // the duration of the last entry only counts if it is followed by another
+    if (!frameFiles.isEmpty())
+        list.append(concatFileLine(frameFiles.last()));
+    return list;
+}
+
+
+QStringList FfmpegBackend::audioArguments(const EncoderParams &params) const
+{
+    QStringList args;
+    if (params.audioFile.isEmpty()) {
+        args << "-an";
+        return args;
+    }
+    args << "-map" << "0:v:0" << "-map" << "1:a:0";
+    if (params.audioEncoded)
+        args << "-c:a" << "copy";
+    else
+        args << "-c:a" << (audioFormat(params) == "mp3" ? "libmp3lame" : "aac")
+             << "-b:a" << QString("%1k").arg(params.audioBitrate);
+    return args;
+}
+
+
+QString FfmpegBackend::audioFormat(const EncoderParams &params) const
+{
+    if (params.audioEncoded)
+        return QString();
+    const bool avi = QFileInfo(params.outputFile).suffix().toLower() == "avi";
+    return (avi || !hasEncoder("aac")) && hasEncoder("libmp3lame") ? "mp3" : "aac";
+}
+
+
+EncoderCommand FfmpegBackend::audioCommand(const EncoderParams &params, const QString &format) const
+{
+    const QString &codec = format == "mp3" ? "libmp3lame" : "aac";
+    if (!hasEncoder(codec))
+        return EncoderCommand();
+    QStringList args;
+    args << "-y" << "-hide_banner" << ProgressArguments
+         << "-i" << params.audioFile
+         << "-map" << "0:a:0" << "-map_metadata" << "-1"
+         << "-c:a" << codec << "-b:a" << QString("%1k").arg(params.audioBitrate);
+    // a bare stream, without tags that might confuse MEncoder
+    if (format == "mp3")
+        args << "-write_xing" << "0" << "-id3v2_version" << "0";
+    args << params.outputFile;
+    return EncoderCommand(executable(), args);
+}
+
+
+EncoderCommand FfmpegBackend::encodeCommand(const EncoderParams &params) const
+{
+    QStringList args;
+    args << "-y" << "-hide_banner" << ProgressArguments;
+    if (params.frameListFile.isEmpty())
+        args << "-f" << "yuv4mpegpipe" << "-i" << "-";
+    else
+        args << "-f" << "concat" << "-safe" << "0" << "-i" << params.frameListFile;
+    if (!params.audioFile.isEmpty())
+        args << "-i" << params.audioFile;
+    QStringList filters;
+    if (!params.subtitleFile.isEmpty()) {
+        // every frame must be there to show the subtitles in time
+        if (!params.frameListFile.isEmpty())
+            filters << QString("fps=%1").arg(params.fps);
+        QString filter = QString("subtitles=filename=%1").arg(escapeFilterValue(params.subtitleFile));
+        if (!params.subtitleFont.isEmpty()) {
+            // libass looks up the font by its name in the given directory
+            const QFileInfo font(params.subtitleFont);
+            filter += QString(":fontsdir=%1:force_style=%2")
+                    .arg(escapeFilterValue(font.absolutePath()))
+                    .arg(escapeFilterValue(QString("FontName=%1,FontSize=36").arg(font.completeBaseName())));
+        }
+        // the subtitles filter goes by the timestamps of the frames
+        if (params.subtitleDelay != 0)
+            filter = QString("setpts=PTS+(%1)/TB,%2,setpts=PTS-(%1)/TB")
+                    .arg(-params.subtitleDelay)
+                    .arg(filter);
+        filters << filter;
+    }
+    // drops frames that are exactly the same as their predecessor
+    if (params.frameListFile.isEmpty() && params.dropDuplicates)
+        filters << "mpdecimate=hi=0:lo=0:frac=0";
+    if (!filters.isEmpty())
+        args << "-vf" << filters.join(",");
+    if (params.codec == H264 && hasEncoder("libx264")) {
+        args << "-c:v" << "libx264"
+             << "-preset" << X264Presets[params.preset]
+             << "-crf" << QString::number(X264Crf[params.preset]);
+        if (params.preset == HighQuality)
+            args << "-tune" << "film";
+    }
+    else {
+        args << "-c:v" << "mpeg4" << "-q:v" << QString::number(Mpeg4Quantizers[params.preset]);
+        if (params.preset == HighQuality)
+            args << "-mbd" << "rd" << "-trellis" << "2";
+    }
+    args << "-pix_fmt" << "yuv420p"
+         << "-r" << QString::number(params.fps);
+    // a held frame stays in the video as one frame with a long
+    // duration instead of being repeated at the frame rate
+    if (!params.frameListFile.isEmpty() || params.dropDuplicates)
+        args << "-vsync" << "vfr";
+    args << "-threads" << QString::number(supportsThreads() ? params.threads : 1);
+    // A frame list ends in an entry without a duration, which becomes
+    // one more frame, and held frames are written once, so a list is
+    // cut by its scheduled duration rather than a number of frames.
+    if (params.frames > 0 && !params.frameListFile.isEmpty())
+        args << "-t" << QString::number(params.frames / params.fps, 'f', 6);
+    else if (params.frames > 0)
+        args << "-frames:v" << QString::number(params.frames);
+    args << audioArguments(params) << params.extraOptions << params.outputFile;
+    return EncoderCommand(executable(), args);
+}
+
+
+EncoderCommand FfmpegBackend::concatCommand(const QStringList &inputFiles, const QString &listFile, const EncoderParams &params) const
+{
+    QByteArray list = "ffconcat version 1.0\n";
+    foreach (QString inputFile, inputFiles)
+        list.append(concatFileLine(inputFile));
+    QFile file(listFile);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        file.write(list);
+    QStringList args;
+    args << "-y" << "-hide_banner" << ProgressArguments
+         << "-f" << "concat" << "-safe" << "0" << "-i" << listFile;
+    if (!params.audioFile.isEmpty())
+        args << "-i" << params.audioFile;
+    args << "-c:v" << "copy";
+    // the inputs hold fewer frames than they show if frames are repeated
+    if (params.frames > 0)
+        args << "-t" << QString::number(params.frames / params.fps, 'f', 6);
+    // the extra options are meant for the encoding pass
+    args << audioArguments(params) << params.outputFile;
+    return EncoderCommand(executable(), args);
+}
+
+
+EncoderBackend::LineType FfmpegBackend::parseLine(const QString &line, EncoderProgress *progress) const
+{
+    // a report is a block of lines like "frame=100", "fps=48.3" or
+    // "bitrate=1843.2kbits/s", the last one is "progress=continue|end"
+    QRegExp re("([a-z0-9_]+)=\\s*(\\S*)");
+    if (!re.exactMatch(line))
+        return OutputLine;
+    const QString &key = re.cap(1);
+    const QString &value = re.cap(2);
+    if (key == "frame")
+        progress->frames = value.toInt();
+    else if (key == "out_time_us" || key == "out_time_ms") // both in microseconds
+        progress->time = qMax(0.0, value.toDouble() / 1e6);
+    else if (key == "fps")
+        progress->fps = value.toDouble();
+    else if (key == "bitrate")
+        progress->bitrate = QString(value).remove("kbits/s").toDouble();
+    else if (key == "progress")
+        return ProgressEndLine;
+    return ProgressLine;
+}
@@ -0,0 +1,32 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __FFMPEGBACKEND_H_
+#define __FFMPEGBACKEND_H_
+
+#include "encoderbackend.h"
+
+// Drives ffmpeg. H.264 is encoded with libx264 if ffmpeg has been
+// built with it, MPEG-4 with the native encoder otherwise. Frame
+// lists and segments are read through the concat demuxer.
+class FfmpegBackend : public EncoderBackend
+{
+public:
+    FfmpegBackend(void);
+
+    QString name(void) const;
+    QByteArray frameList(const QStringList &frameFiles, qreal fps) const;
+    EncoderCommand encodeCommand(const EncoderParams &params) const;
+    EncoderCommand concatCommand(const QStringList &inputFiles, const QString &listFile, const EncoderParams &params) const;
+    QString audioFormat(const EncoderParams &params) const;
+    EncoderCommand audioCommand(const EncoderParams &params, const QString &format) const;
+    LineType parseLine(const QString &line, EncoderProgress *progress) const;
+
+protected:
+    bool probeExecutable(QStringList *encoders, bool *threads) const;
+
+private: // methods
+    QStringList audioArguments(const EncoderParams &params) const;
+};
+
+#endif // __FFMPEGBACKEND_H_
@@ -0,0 +1,455 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QObject>
+#include <QtCore/QDebug>
+#include <string.h>
+
+#include "flacdecoder.h"
+
+
+static inline int countLeadingZeros(quint64 x)
+{
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while ((x & (Q_UINT64_C(1) << 63)) == 0) {
+        x <<= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+
+// MSB first bit reader with a 64 bit cache. Bits beyond the
+// cached ones are always zero, reads past the end yield zeros.
+class FlacBitReader
+{
+public:
+    FlacBitReader(const uchar *data, qint64 size)
+        : mData(data)
+        , mSize(size)
+        , mPos(0)
+        , mCache(0)
+        , mBits(0)
+    { /* ... */ }
+
+    inline quint32 read(int n)
+    {
+        if (n == 0)
+            return 0;
+        if (mBits < n)
+            refill();
+        const quint32 v = quint32(mCache >> (64 - n));
+        mCache <<= n;
+        mBits -= n;
+        return v;
+    }
+
+    inline qint32 readSigned(int n)
+    {
+        if (n == 0)
+            return 0;
+        return qint32(read(n) << (32 - n)) >> (32 - n);
+    }
+
+    inline quint32 readUnary(void)
+    {
+        quint32 n = 0;
+        for (;;) {
+            if (mBits == 0) {
+                refill();
+                if (overrun())
+                    return n;
+            }
+            if (mCache == 0) {
+                n += mBits;
+                mBits = 0;
+                continue;
+            }
+            const int zeros = countLeadingZeros(mCache);
+            n += zeros;
+            mCache = (zeros < 63) ? (mCache << (zeros + 1)) : 0;
+            mBits -= zeros + 1;
+            return n;
+        }
+    }
+
+    inline qint32 readRice(int param)
+    {
+        const quint32 u = (readUnary() << param) | read(param);
+        return qint32(u >> 1) ^ -qint32(u & 1);
+    }
+
+    void alignToByte(void)
+    {
+        const int n = mBits % 8;
+        mCache <<= n;
+        mBits -= n;
+    }
+
+    qint64 bytePos(void) const
+    {
+        return mPos - mBits / 8;
+    }
+
+    void seek(qint64 bytePos)
+    {
+        mPos = bytePos;
+        mCache = 0;
+        mBits = 0;
+    }
+
+    bool overrun(void) const
+    {
+        return bytePos() > mSize;
+    }
+
+    qint64 bytesLeft(void) const
+    {
+        return mSize - bytePos();
+    }
+
+private:
+    inline void refill(void)
+    {
+        while (mBits <= 56) {
+            const quint64 byte = (mPos < mSize) ? mData[mPos] : 0;
+            ++mPos;
+            mCache |= byte << (56 - mBits);
+            mBits += 8;
+        }
+    }
+
+    const uchar *mData;
+    qint64 mSize;
+    qint64 mPos;
+    quint64 mCache;
+    int mBits;
+};
+
+
+FlacDecoder::FlacDecoder(void)
+    : mMap(nullptr)
+    , mSize(0)
+    , mFirstFrame(0)
+    , mBitsPerSample(0)
+    , mMaxBlockSize(0)
+{
+    // ...
+}
+
+
+FlacDecoder::~FlacDecoder()
+{
+    if (mMap != nullptr)
+        mFile.unmap(const_cast<uchar*>(mMap));
+}
+
+
+bool FlacDecoder::open(const QString &fileName)
+{
+    mFile.setFileName(fileName);
+    if (!mFile.open(QIODevice::ReadOnly)) {
+        mErrorString = mFile.errorString();
+        return false;
+    }
+    mSize = mFile.size();
+    mMap = mFile.map(0, mSize);
+    if (mMap == nullptr) {
+        mErrorString = mFile.errorString();
+        return false;
+    }
+    qint64 pos = 0;
+    // skip ID3v2 tag some taggers prepend
+    if (mSize > 10 && memcmp(mMap, "ID3", 3) == 0) {
+        const qint64 tagSize = (mMap[6] << 21) | (mMap[7] << 14) | (mMap[8] << 7) | mMap[9];
+        pos = 10 + tagSize + ((mMap[5] & 0x10) ? 10 : 0);
+    }
+    if (pos + 4 > mSize || memcmp(mMap + pos, "fLaC", 4) != 0) {
+        mErrorString = QObject::tr("Not a FLAC file");
+        return false;
+    }
+    pos += 4;
+    bool haveStreamInfo = false;
+    bool last = false;
+    while (!last && pos + 4 <= mSize) {
+        last = (mMap[pos] & 0x80) != 0;
+        const int type = mMap[pos] & 0x7f;
+        const qint64 length = (mMap[pos + 1] << 16) | (mMap[pos + 2] << 8) | mMap[pos + 3];
+        pos += 4;
+        if (type == 0 && length >= 34 && pos + 34 <= mSize) {
+            FlacBitReader br(mMap + pos, length);
+            br.read(16); // minimum block size
+            mMaxBlockSize = br.read(16);
+            br.read(24); // minimum frame size
+            br.read(24); // maximum frame size
+            mSampleRate = br.read(20);
+            mChannels = br.read(3) + 1;
+            mBitsPerSample = br.read(5) + 1;
+            mFrameCount = (qint64(br.read(4)) << 32) | br.read(32);
+            haveStreamInfo = true;
+        }
+        pos += length;
+    }
+    if (!haveStreamInfo || mSampleRate == 0) {
+        mErrorString = QObject::tr("FLAC file lacks stream info");
+        return false;
+    }
+    mFirstFrame = pos;
+    if (mMaxBlockSize <= 0)
+        mMaxBlockSize = 65535;
+    for (int c = 0; c < mChannels; ++c)
+        mChannelData[c].resize(mMaxBlockSize);
+    return true;
+}
+
+
+bool FlacDecoder::decode(SampleBuffer &samples)
+{
+    samples.clear();
+    if (mFrameCount > 0)
+        samples.reserve(int(mFrameCount * mChannels));
+    FlacBitReader br(mMap + mFirstFrame, mSize - mFirstFrame);
+    const uchar *frames = mMap + mFirstFrame;
+    while (!mCanceled && br.bytesLeft() > 2) {
+        const qint64 frameStart = br.bytePos();
+        if (decodeFrame(br, samples))
+            continue;
+        // skip to the next frame sync code
+        qint64 p = frameStart + 1;
+        const qint64 n = mSize - mFirstFrame - 1;
+        while (p < n && !(frames[p] == 0xff && (frames[p + 1] & 0xfe) == 0xf8))
+            ++p;
+        if (p >= n)
+            break;
+        br.seek(p);
+    }
+    if (samples.isEmpty()) {
+        mErrorString = QObject::tr("No decodable FLAC frames found");
+        return false;
+    }
+    if (mFrameCount == 0 || samples.size() < mFrameCount * mChannels)
+        mFrameCount = samples.size() / mChannels;
+    else
+        samples.resize(int(mFrameCount * mChannels));
+    return !mCanceled;
+}
+
+
+bool FlacDecoder::decodeFrame(FlacBitReader &br, SampleBuffer &samples)
+{
+    if (br.read(14) != 0x3ffe)
+        return false;
+    br.read(1); // reserved
+    br.read(1); // blocking strategy
+    const int blockSizeCode = br.read(4);
+    const int sampleRateCode = br.read(4);
+    const int channelAssignment = br.read(4);
+    const int sampleSizeCode = br.read(3);
+    br.read(1); // reserved
+    // frame or sample number, coded like UTF-8
+    const quint32 lead = br.read(8);
+    int ones = 0;
+    while (ones < 8 && (lead & (0x80 >> ones)))
+        ++ones;
+    for (int i = 1; i < ones; ++i)
+        br.read(8);
+    int blockSize;
+    if (blockSizeCode == 1)
+        blockSize = 192;
+    else if (blockSizeCode >= 2 && blockSizeCode <= 5)
+        blockSize = 576 << (blockSizeCode - 2);
+    else if (blockSizeCode == 6)
+        blockSize = br.read(8) + 1;
+    else if (blockSizeCode == 7)
+        blockSize = br.read(16) + 1;
+    else if (blockSizeCode >= 8)
+        blockSize = 256 << (blockSizeCode - 8);
+    else
+        return false;
+    if (sampleRateCode == 12)
+        br.read(8);
+    else if (sampleRateCode == 13 || sampleRateCode == 14)
+        br.read(16);
+    else if (sampleRateCode == 15)
+        return false;
+    br.read(8); // CRC-8
+    static const int SampleSizes[8] = { 0, 8, 12, 0, 16, 20, 24, 32 };
+    const int bps = (sampleSizeCode == 0) ? mBitsPerSample : SampleSizes[sampleSizeCode];
+    const int channels = (channelAssignment < 8) ? channelAssignment + 1 : 2;
+    if (bps == 0 || channels != mChannels || channelAssignment > 10)
+        return false;
+    if (blockSize > mChannelData[0].size()) {
+        for (int c = 0; c < mChannels; ++c)
+            mChannelData[c].resize(blockSize);
+    }
+    for (int c = 0; c < channels; ++c) {
+        // the side channel needs one extra bit
+        int subframeBps = bps;
+        if ((channelAssignment == 8 && c == 1) || (channelAssignment == 9 && c == 0) || (channelAssignment == 10 && c == 1))
+            ++subframeBps;
+        if (!decodeSubframe(br, blockSize, subframeBps, mChannelData[c].data()))
+            return false;
+    }
+    br.alignToByte();
+    br.read(16); // CRC-16
+    if (br.overrun())
+        return false;
+
+    qint32 *ch0 = mChannelData[0].data();
+    qint32 *ch1 = (channels > 1) ? mChannelData[1].data() : nullptr;
+    switch (channelAssignment) {
+    case 8: // left/side
+        for (int i = 0; i < blockSize; ++i)
+            ch1[i] = ch0[i] - ch1[i];
+        break;
+    case 9: // side/right
+        for (int i = 0; i < blockSize; ++i)
+            ch0[i] += ch1[i];
+        break;
+    case 10: // mid/side
+        for (int i = 0; i < blockSize; ++i) {
+            const qint32 side = ch1[i];
+            const qint32 mid = (ch0[i] << 1) | (side & 1);
+            ch0[i] = (mid + side) >> 1;
+            ch1[i] = (mid - side) >> 1;
+        }
+        break;
+    default:
+        break;
+    }
+
+    const int offset = samples.size();
+    samples.resize(offset + blockSize * channels);
+    SampleBufferType *dst = samples.data() + offset;
+    const int shift = bps - 16;
+    for (int i = 0; i < blockSize; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            const qint32 s = mChannelData[c][i];
+            *dst++ = SampleBufferType(shift >= 0 ? (s >> shift) : (s << -shift));
+        }
+    }
+    return true;
+}
+
+
+bool FlacDecoder::decodeSubframe(FlacBitReader &br, int blockSize, int bps, qint32 *out)
+{
+    if (br.read(1) != 0)
+        return false;
+    const int type = br.read(6);
+    int wasted = 0;
+    if (br.read(1))
+        wasted = br.readUnary() + 1;
+    bps -= wasted;
+    if (bps <= 0)
+        return false;
+
+    if (type == 0) { // constant
+        const qint32 v = br.readSigned(bps);
+        for (int i = 0; i < blockSize; ++i)
+            out[i] = v;
+    }
+    else if (type == 1) { // verbatim
+        for (int i = 0; i < blockSize; ++i)
+            out[i] = br.readSigned(bps);
+    }
+    else if (type >= 8 && type <= 12) { // fixed predictor
+        const int order = type - 8;
+        if (order > blockSize)
+            return false;
+        for (int i = 0; i < order; ++i)
+            out[i] = br.readSigned(bps);
+        if (!decodeResidual(br, blockSize, order, out))
+            return false;
+        switch (order) {
+        case 1:
+            for (int i = 1; i < blockSize; ++i)
+                out[i] += out[i - 1];
+            break;
+        case 2:
+            for (int i = 2; i < blockSize; ++i)
+                out[i] += 2 * out[i - 1] - out[i - 2];
+            break;
+        case 3:
+            for (int i = 3; i < blockSize; ++i)
+                out[i] += 3 * out[i - 1] - 3 * out[i - 2] + out[i - 3];
+            break;
+        case 4:
+            for (int i = 4; i < blockSize; ++i)
+                out[i] += 4 * out[i - 1] - 6 * out[i - 2] + 4 * out[i - 3] - out[i - 4];
+            break;
+        default:
+            break;
+        }
+    }
+    else if (type >= 32) { // LPC
+        const int order = type - 31;
+        if (order > blockSize)
+            return false;
+        for (int i = 0; i < order; ++i)
+            out[i] = br.readSigned(bps);
+        const int precision = br.read(4) + 1;
+        if (precision == 16)
+            return false;
+        const int shift = br.readSigned(5);
+        if (shift < 0)
+            return false;
+        qint32 coeffs[32];
+        for (int i = 0; i < order; ++i)
+            coeffs[i] = br.readSigned(precision);
+        if (!decodeResidual(br, blockSize, order, out))
+            return false;
+        for (int i = order; i < blockSize; ++i) {
+            qint64 sum = 0;
+            const qint32 *history = out + i - 1;
+            for (int j = 0; j < order; ++j)
+                sum += qint64(coeffs[j]) * history[-j];
+            out[i] += qint32(sum >> shift);
+        }
+    }
+    else {
+        return false;
+    }
+
+    if (wasted > 0) {
+        for (int i = 0; i < blockSize; ++i)
+            out[i] <<= wasted;
+    }
+    return true;
+}
+
+
+bool FlacDecoder::decodeResidual(FlacBitReader &br, int blockSize, int order, qint32 *out)
+{
+    const int method = br.read(2);
+    if (method > 1)
+        return false;
+    const int paramBits = (method == 0) ? 4 : 5;
+    const int escapeCode = (method == 0) ? 15 : 31;
+    const int partitionOrder = br.read(4);
+    const int partitions = 1 << partitionOrder;
+    const int partitionSize = blockSize >> partitionOrder;
+    if (partitionSize < order || (partitionSize << partitionOrder) != blockSize)
+        return false;
+    int i = order;
+    for (int p = 0; p < partitions; ++p) {
+        const int count = (p == 0) ? partitionSize - order : partitionSize;
+        const int param = br.read(paramBits);
+        if (param == escapeCode) {
+            const int bits = br.read(5);
+            for (int k = 0; k < count; ++k)
+                out[i++] = br.readSigned(bits);
+        }
+        else {
+            for (int k = 0; k < count; ++k)
+                out[i++] = br.readRice(param);
+        }
+        if (br.overrun())
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __FLACDECODER_H_
+#define __FLACDECODER_H_
+
+#include <QFile>
+#include <QVector>
+#include "pcmdecoder.h"
+
+class FlacBitReader;
+
+// Small FLAC decoder working on a memory mapping of the file.
+// Supports all subframe types, stereo decorrelation modes and
+// sample sizes up to 32 bits; samples are scaled to 16 bits.
+class FlacDecoder : public PcmDecoder
+{
+public:
+    FlacDecoder(void);
+    ~FlacDecoder();
+
+    bool open(const QString &fileName);
+    bool decode(SampleBuffer &samples);
+
+private: // methods
+    bool decodeFrame(FlacBitReader &br, SampleBuffer &samples);
+    bool decodeSubframe(FlacBitReader &br, int blockSize, int bps, qint32 *out);
+    bool decodeResidual(FlacBitReader &br, int blockSize, int order, qint32 *out);
+
+private:
+    QFile mFile;
+    const uchar *mMap;
+    qint64 mSize;
+    qint64 mFirstFrame;
+    int mBitsPerSample;
+    int mMaxBlockSize;
+    QVector<qint32> mChannelData[8];
+};
+
+#endif // __FLACDECODER_H_
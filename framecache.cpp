@@ -0,0 +1,310 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QLockFile>
+#include <QTextStream>
+#include <QVector>
+#include <QtConcurrent>
+#include <QtCore/QDebug>
+#include <algorithm>
+
+#include "framecache.h"
+#include "framestore.h"
+
+static const char IndexMagic[] = "lolqt-frames 1";
+static const QString IndexFileName = "index";
+static const QString UsedFileName = "used";
+static const QString LockFileName = "lock";
+// entries used more recently than this are never evicted, because
+// another instance may still be reading their files
+static const qint64 MinEvictionAge = 10 * 60 * 1000;
+
+static QAtomicInt instanceCount;
+
+
+struct CacheEntry {
+    QString path;
+    qint64 size;
+    qint64 lastUsed;
+    bool operator<(const CacheEntry &other) const { return lastUsed < other.lastUsed; }
+};
+
+
+static QImage loadImage(const QString &fileName)
+{
+    return QImage(fileName);
+}
+
+
+class FrameCachePrivate {
+public:
+    FrameCachePrivate(void)
+        : maxSize(FrameCache::DefaultMaxSize)
+        , instance(instanceCount.fetchAndAddRelaxed(1))
+    { /* ... */ }
+    QString directory;
+    qint64 maxSize;
+    // tells apart the staging directories of the caches in a process
+    const int instance;
+
+    QString entryPath(const QString &key) const
+    {
+        return directory + "/" + key;
+    }
+    QString stagingPath(const QString &key) const
+    {
+        return directory + "/" + key + QString(".part-%1-%2").arg(QCoreApplication::applicationPid()).arg(instance);
+    }
+    void touch(const QString &path);
+    bool readIndex(const QString &path, QStringList *uniqueFileNames, QVector<int> *uniqueIndexes, QVector<int> *delays) const;
+    void evictLocked(void);
+};
+
+
+void FrameCachePrivate::touch(const QString &path)
+{
+    QFile used(path + "/" + UsedFileName);
+    if (used.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        used.write(QByteArray::number(QDateTime::currentMSecsSinceEpoch()));
+}
+
+
+// reads the index of a complete entry with the lock held, the file
+// names are made absolute
+bool FrameCachePrivate::readIndex(const QString &path, QStringList *uniqueFileNames, QVector<int> *uniqueIndexes, QVector<int> *delays) const
+{
+    QFile indexFile(path + "/" + IndexFileName);
+    if (!indexFile.open(QIODevice::ReadOnly))
+        return false;
+    QTextStream in(&indexFile);
+    if (in.readLine() != IndexMagic)
+        return false;
+    int nFiles = 0;
+    in >> nFiles;
+    in.readLine();
+    for (int i = 0; i < nFiles; ++i)
+        uniqueFileNames->append(path + "/" + in.readLine());
+    int nFrames = 0;
+    in >> nFrames;
+    for (int i = 0; i < nFrames && in.status() == QTextStream::Ok; ++i) {
+        int unique = 0, delay = 0;
+        in >> unique >> delay;
+        if (unique < 0 || unique >= nFiles)
+            return false;
+        uniqueIndexes->append(unique);
+        delays->append(delay);
+    }
+    return nFrames > 0 && uniqueIndexes->count() == nFrames;
+}
+
+
+void FrameCachePrivate::evictLocked(void)
+{
+    QList<CacheEntry> entries;
+    qint64 totalSize = 0;
+    const QFileInfoList &dirs = QDir(directory).entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot);
+    foreach (QFileInfo dir, dirs) {
+        if (dir.fileName().contains(".part-"))
+            continue;
+        CacheEntry entry;
+        entry.path = dir.absoluteFilePath();
+        entry.size = 0;
+        foreach (QFileInfo file, QDir(entry.path).entryInfoList(QDir::Files))
+            entry.size += file.size();
+        QFile used(entry.path + "/" + UsedFileName);
+        entry.lastUsed = used.open(QIODevice::ReadOnly) ? used.readAll().toLongLong() : 0;
+        totalSize += entry.size;
+        entries.append(entry);
+    }
+    std::sort(entries.begin(), entries.end());
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    foreach (CacheEntry entry, entries) {
+        if (totalSize <= maxSize || now - entry.lastUsed < MinEvictionAge)
+            break;
+        if (QDir(entry.path).removeRecursively())
+            totalSize -= entry.size;
+    }
+}
+
+
+FrameCache::FrameCache(void)
+    : d_ptr(new FrameCachePrivate)
+{
+    // ...
+}
+
+
+FrameCache::~FrameCache()
+{
+    // ...
+}
+
+
+void FrameCache::setDirectory(const QString &directory)
+{
+    d_ptr->directory = directory;
+    QDir().mkpath(directory);
+}
+
+
+QString FrameCache::directory(void) const
+{
+    return d_ptr->directory;
+}
+
+
+void FrameCache::setMaxSize(qint64 bytes)
+{
+    d_ptr->maxSize = bytes;
+}
+
+
+qint64 FrameCache::maxSize(void) const
+{
+    return d_ptr->maxSize;
+}
+
+
+bool FrameCache::isEnabled(void) const
+{
+    return d_ptr->maxSize > 0 && !d_ptr->directory.isEmpty();
+}
+
+
+QString FrameCache::key(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QString();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (!hash.addData(&file))
+        return QString();
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+
+bool FrameCache::load(const QString &key, FrameStore *store, QStringList *fileNames)
+{
+    Q_D(FrameCache);
+    if (!isEnabled() || key.isEmpty())
+        return false;
+    const QString &path = d->entryPath(key);
+    QStringList uniqueFileNames;
+    QVector<int> uniqueIndexes;
+    QVector<int> delays;
+    {
+        QLockFile lock(d->directory + "/" + LockFileName);
+        if (!lock.lock() || !d->readIndex(path, &uniqueFileNames, &uniqueIndexes, &delays))
+            return false;
+        d->touch(path);
+    }
+    // recently used entries are not evicted, so the files stay put
+    const QList<QImage> &images = QtConcurrent::blockingMapped<QList<QImage> >(uniqueFileNames, loadImage);
+    foreach (QImage image, images)
+        if (image.isNull())
+            return false;
+    for (int i = 0; i < uniqueIndexes.count(); ++i) {
+        store->append(images.at(uniqueIndexes.at(i)), delays.at(i));
+        fileNames->append(uniqueFileNames.at(uniqueIndexes.at(i)));
+    }
+    return true;
+}
+
+
+QString FrameCache::begin(const QString &key)
+{
+    Q_D(FrameCache);
+    if (!isEnabled() || key.isEmpty())
+        return QString();
+    const QString &path = d->stagingPath(key);
+    QDir(path).removeRecursively();
+    if (!QDir().mkpath(path))
+        return QString();
+    return path;
+}
+
+
+bool FrameCache::commit(const QString &key, const FrameStore &store, QStringList *fileNames)
+{
+    Q_D(FrameCache);
+    const QString &staging = d->stagingPath(key);
+    const QString &path = d->entryPath(key);
+    QStringList uniqueFileNames;
+    for (int i = 0; i < store.frameCount(); ++i) {
+        const int unique = store.uniqueIndexes().at(i);
+        if (unique == uniqueFileNames.count())
+            uniqueFileNames.append(QFileInfo(fileNames->at(i)).fileName());
+    }
+    QFile indexFile(staging + "/" + IndexFileName);
+    if (!indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        abort(key);
+        return false;
+    }
+    QTextStream out(&indexFile);
+    out << IndexMagic << "\n" << uniqueFileNames.count() << "\n";
+    foreach (QString fileName, uniqueFileNames)
+        out << fileName << "\n";
+    out << store.frameCount() << "\n";
+    for (int i = 0; i < store.frameCount(); ++i)
+        out << store.uniqueIndexes().at(i) << " " << store.delay(i) << "\n";
+    out.flush();
+    indexFile.close();
+    d->touch(staging);
+    QLockFile lock(d->directory + "/" + LockFileName);
+    if (!lock.lock()) {
+        abort(key);
+        return false;
+    }
+    // Another instance may have cached the same GIF in the meantime,
+    // maybe under another name. Its files are named after that GIF, so
+    // they are looked up in its index.
+    QStringList existingFileNames;
+    QVector<int> existingIndexes;
+    QVector<int> existingDelays;
+    if (QFileInfo(path).exists()
+            && d->readIndex(path, &existingFileNames, &existingIndexes, &existingDelays)
+            && existingIndexes == store.uniqueIndexes()) {
+        QDir(staging).removeRecursively();
+        d->touch(path);
+        for (int i = 0; i < fileNames->count(); ++i)
+            (*fileNames)[i] = existingFileNames.at(existingIndexes.at(i));
+    }
+    else {
+        // an incomplete or unreadable entry is replaced
+        if (QFileInfo(path).exists())
+            QDir(path).removeRecursively();
+        if (!QDir().rename(staging, path)) {
+            QDir(staging).removeRecursively();
+            return false;
+        }
+        for (int i = 0; i < fileNames->count(); ++i)
+            (*fileNames)[i] = path + "/" + QFileInfo(fileNames->at(i)).fileName();
+    }
+    d->evictLocked();
+    return true;
+}
+
+
+void FrameCache::abort(const QString &key)
+{
+    QDir(d_ptr->stagingPath(key)).removeRecursively();
+}
+
+
+void FrameCache::evict(void)
+{
+    Q_D(FrameCache);
+    if (!isEnabled())
+        return;
+    QLockFile lock(d->directory + "/" + LockFileName);
+    if (lock.lock())
+        d->evictLocked();
+}
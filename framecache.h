@@ -0,0 +1,53 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __FRAMECACHE_H_
+#define __FRAMECACHE_H_
+
+#include <QString>
+#include <QStringList>
+#include <QScopedPointer>
+
+class FrameCachePrivate;
+class FrameStore;
+
+// Persistent cache of extracted frames, keyed by a hash of the GIF's
+// contents. Every entry is a directory holding the distinct frames as
+// PNG files plus an index with the frame order and delays. Entries are
+// written to a staging directory and renamed into place once complete,
+// and the cache as a whole is guarded by a lock file, so several
+// instances of the program, or several caches within one, can share
+// it. When the cache grows beyond its maximum size, the least recently
+// used entries are evicted.
+class FrameCache
+{
+public:
+    FrameCache(void);
+    ~FrameCache();
+
+    static const qint64 DefaultMaxSize = 512 * 1024 * 1024;
+
+    void setDirectory(const QString &directory);
+    QString directory(void) const;
+    void setMaxSize(qint64 bytes);
+    qint64 maxSize(void) const;
+    bool isEnabled(void) const;
+
+    static QString key(const QString &fileName);
+    // fills the store and the per frame file names from a complete entry
+    bool load(const QString &key, FrameStore *store, QStringList *fileNames);
+    // returns the directory to write the frames of a new entry into
+    QString begin(const QString &key);
+    // makes a staged entry available; the file names are adjusted to
+    // its final location
+    bool commit(const QString &key, const FrameStore &store, QStringList *fileNames);
+    void abort(const QString &key);
+    void evict(void);
+
+private:
+    QScopedPointer<FrameCachePrivate> d_ptr;
+    Q_DECLARE_PRIVATE(FrameCache)
+    Q_DISABLE_COPY(FrameCache)
+};
+
+#endif // __FRAMECACHE_H_
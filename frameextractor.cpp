@@ -0,0 +1,323 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QImage>
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QtConcurrent>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QtCore/QDebug>
+
+#include "frameextractor.h"
+#include "boundedqueue.h"
+#include "gifdecoder.h"
+#include "framestore.h"
+#include "framecache.h"
+
+
+struct EncodeJob {
+    QImage image;
+    QString fileName;
+};
+
+
+static void saveFrame(EncodeJob &job)
+{
+    if (!job.image.save(job.fileName))
+        job.fileName.clear();
+}
+
+
+// writes the images on all cores, returns the number of failed writes
+static int saveJobs(QVector<EncodeJob> &jobs)
+{
+    QtConcurrent::blockingMap(jobs, saveFrame);
+    int errors = 0;
+    foreach (const EncodeJob &job, jobs)
+        if (job.fileName.isEmpty())
+            ++errors;
+    return errors;
+}
+
+
+class FrameExtractorPrivate {
+public:
+    FrameExtractorPrivate(void)
+        : encoderCount(qMax(1, QThread::idealThreadCount()))
+        , queue(2 * encoderCount)
+        , writeFiles(true)
+        , cache(nullptr)
+        , cached(false)
+        , expectedFrames(0)
+        , doCancel(false)
+    {
+        // one thread for decoding plus the encoders
+        pool.setMaxThreadCount(encoderCount + 1);
+    }
+    const int encoderCount;
+    QThreadPool pool;
+    BoundedQueue<EncodeJob> queue;
+    QFuture<bool> decodeFuture;
+    // reports the end of the decoding once the future has finished, so
+    // that isRunning() is false when finished() is emitted
+    QFutureWatcher<bool> decodeWatcher;
+    QString fileName;
+    QString outputDirectory;
+    QString fileNamePattern;
+    QStringList fileNames;
+    // files the distinct frames are written to
+    QStringList frameFileNames;
+    QSharedPointer<FrameStore> store;
+    bool writeFiles;
+    FrameCache *cache;
+    // frame files belong to the cache
+    bool cached;
+    int expectedFrames;
+    QAtomicInt framesWritten;
+    QAtomicInt writeErrors;
+    volatile bool doCancel;
+    QString errorString;
+};
+
+
+FrameExtractor::FrameExtractor(QObject *parent)
+    : QObject(parent)
+    , d_ptr(new FrameExtractorPrivate)
+{
+    QObject::connect(&d_ptr->decodeWatcher, SIGNAL(finished()), SLOT(decodingFinished()));
+}
+
+
+FrameExtractor::~FrameExtractor()
+{
+    cancel();
+}
+
+
+void FrameExtractor::start(const QString &fileName, const QString &outputDirectory, const QString &fileNamePattern)
+{
+    Q_D(FrameExtractor);
+    cancel();
+    d->queue.reset();
+    d->doCancel = false;
+    d->fileName = fileName;
+    d->outputDirectory = outputDirectory;
+    d->fileNamePattern = fileNamePattern;
+    d->fileNames.clear();
+    d->frameFileNames.clear();
+    // a new store, the old one may still be in use by a reader
+    d->store = QSharedPointer<FrameStore>(new FrameStore);
+    d->cached = false;
+    d->expectedFrames = 0;
+    d->framesWritten.store(0);
+    d->writeErrors.store(0);
+    d->errorString.clear();
+    d->decodeFuture = QtConcurrent::run(&d->pool, this, &FrameExtractor::decodeFrames);
+    d->decodeWatcher.setFuture(d->decodeFuture);
+}
+
+
+void FrameExtractor::setWriteFiles(bool enabled)
+{
+    d_ptr->writeFiles = enabled;
+}
+
+
+bool FrameExtractor::writeFiles(void) const
+{
+    return d_ptr->writeFiles;
+}
+
+
+void FrameExtractor::setCache(FrameCache *cache)
+{
+    d_ptr->cache = cache;
+}
+
+
+bool FrameExtractor::isCached(void) const
+{
+    return d_ptr->cached;
+}
+
+
+int FrameExtractor::writeFrames(const FrameStore &store, const QStringList &fileNames)
+{
+    QVector<EncodeJob> jobs;
+    for (int i = 0; i < store.uniqueFrameCount() && i < fileNames.size(); ++i) {
+        if (fileNames.at(i).isEmpty())
+            continue;
+        EncodeJob job;
+        job.image = store.uniqueFrame(i);
+        job.fileName = fileNames.at(i);
+        jobs.append(job);
+    }
+    return saveJobs(jobs);
+}
+
+
+void FrameExtractor::cancel(void)
+{
+    Q_D(FrameExtractor);
+    d->doCancel = true;
+    d->queue.close();
+    d->decodeFuture.waitForFinished();
+}
+
+
+bool FrameExtractor::isRunning(void) const
+{
+    return d_ptr->decodeFuture.isRunning();
+}
+
+
+bool FrameExtractor::isCanceled(void) const
+{
+    return d_ptr->doCancel;
+}
+
+
+QString FrameExtractor::errorString(void) const
+{
+    return d_ptr->errorString;
+}
+
+
+int FrameExtractor::frameCount(void) const
+{
+    return d_ptr->fileNames.count();
+}
+
+
+const QStringList &FrameExtractor::fileNames(void) const
+{
+    return d_ptr->fileNames;
+}
+
+
+QSharedPointer<const FrameStore> FrameExtractor::frameStore(void) const
+{
+    return d_ptr->store;
+}
+
+
+void FrameExtractor::decodingFinished(void)
+{
+    Q_D(FrameExtractor);
+    if (d->doCancel)
+        return;
+    emit finished(d->decodeWatcher.result());
+}
+
+
+bool FrameExtractor::decodeFrames(void)
+{
+    Q_D(FrameExtractor);
+    QString cacheKey;
+    QString outputDirectory = d->outputDirectory;
+    if (d->cache != nullptr && d->cache->isEnabled()) {
+        cacheKey = FrameCache::key(d->fileName);
+        if (d->cache->load(cacheKey, d->store.data(), &d->fileNames)) {
+            updateFrameFileNames();
+            d->cached = true;
+            emit progress(d->fileNames.count(), d->fileNames.count());
+            return true;
+        }
+        // frames of GIFs not yet cached are written to the cache
+        const QString &stagingDirectory = d->cache->begin(cacheKey);
+        if (stagingDirectory.isEmpty())
+            cacheKey.clear();
+        else
+            outputDirectory = stagingDirectory;
+    }
+    const bool writeFiles = d->writeFiles || !cacheKey.isEmpty();
+    QList<QFuture<void> > encoders;
+    for (int i = 0; writeFiles && i < d->encoderCount; ++i)
+        encoders.append(QtConcurrent::run(&d->pool, this, &FrameExtractor::encodeFrames));
+    GifDecoder decoder;
+    if (decoder.open(d->fileName))
+        d->expectedFrames = decoder.frameCount();
+    const QString &baseName = QFileInfo(d->fileName).baseName();
+    int i = 0;
+    while (!d->doCancel) {
+        // shares the snapshot the decoder keeps anyway
+        if (decoder.currentFrameNumber() % decoder.checkpointInterval() == 0)
+            emit checkpoint(d->fileName, decoder.currentFrameNumber(), decoder.canvas());
+        const QImage &image = decoder.read();
+        if (image.isNull())
+            break;
+        // GIFs hold an image by repeating it, so many frames are duplicates
+        const int knownFrames = d->store->uniqueFrameCount();
+        const int index = d->store->append(image, decoder.delay(i));
+        ++i;
+        if (index < knownFrames) {
+            d->fileNames.append(d->frameFileNames.at(index));
+            const int done = d->framesWritten.fetchAndAddOrdered(1) + 1;
+            emit progress(done, qMax(done, d->expectedFrames));
+            continue;
+        }
+        EncodeJob job;
+        job.image = d->store->uniqueFrame(index);
+        job.fileName = outputDirectory + "/" + d->fileNamePattern.arg(baseName).arg(index, 4, 10, QChar('0'));
+        d->frameFileNames.append(job.fileName);
+        d->fileNames.append(job.fileName);
+        if (!writeFiles) {
+            const int done = d->framesWritten.fetchAndAddOrdered(1) + 1;
+            emit progress(done, qMax(done, d->expectedFrames));
+            continue;
+        }
+        if (!d->queue.push(job))
+            break;
+    }
+    if (i == 0)
+        d->errorString = decoder.errorString();
+    if (d->expectedFrames < i)
+        d->expectedFrames = i;
+    d->queue.close();
+    foreach (QFuture<void> encoder, encoders)
+        encoder.waitForFinished();
+    const bool ok = i > 0 && d->writeErrors.load() == 0;
+    if (!cacheKey.isEmpty()) {
+        if (ok && !d->doCancel && d->cache->commit(cacheKey, *d->store, &d->fileNames)) {
+            updateFrameFileNames();
+            d->cached = true;
+        }
+        else {
+            d->cache->abort(cacheKey);
+        }
+    }
+    if (d->doCancel)
+        return false;
+    if (d->writeErrors.load() > 0)
+        d->errorString = tr("%1 frames could not be written to %2").arg(d->writeErrors.load()).arg(outputDirectory);
+    return ok;
+}
+
+
+void FrameExtractor::updateFrameFileNames(void)
+{
+    Q_D(FrameExtractor);
+    d->frameFileNames.clear();
+    const QVector<int> &uniqueIndexes = d->store->uniqueIndexes();
+    for (int i = 0; i < uniqueIndexes.count(); ++i)
+        if (uniqueIndexes.at(i) == d->frameFileNames.count())
+            d->frameFileNames.append(d->fileNames.at(i));
+}
+
+
+void FrameExtractor::encodeFrames(void)
+{
+    Q_D(FrameExtractor);
+    EncodeJob job;
+    while (d->queue.pop(job)) {
+        if (d->doCancel)
+            continue;
+        if (!job.image.save(job.fileName))
+            d->writeErrors.ref();
+        const int done = d->framesWritten.fetchAndAddOrdered(1) + 1;
+        emit progress(done, qMax(done, d->expectedFrames));
+    }
+}
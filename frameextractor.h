@@ -0,0 +1,82 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __FRAMEEXTRACTOR_H_
+#define __FRAMEEXTRACTOR_H_
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QImage>
+#include <QScopedPointer>
+#include <QSharedPointer>
+
+class FrameExtractorPrivate;
+class FrameStore;
+class FrameCache;
+
+// Writes the frames of an animated GIF to image files. A single
+// worker decodes the composited frames with GifDecoder in order and
+// hands them over a bounded queue to a pool of workers which encode
+// and write them.
+// The decoded frames are kept in a FrameStore, which holds identical
+// frames only once; each distinct frame is written to one file. With
+// writing disabled the frames can be streamed to the encoder without
+// touching the disk.
+class FrameExtractor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FrameExtractor(QObject *parent = nullptr);
+    ~FrameExtractor();
+
+    // %1 base name of the GIF, %2 four digit frame number
+    void start(const QString &fileName, const QString &outputDirectory, const QString &fileNamePattern);
+    void setWriteFiles(bool enabled);
+    bool writeFiles(void) const;
+    // Frames of GIFs extracted before are loaded from the cache, those
+    // of new ones are written to it, regardless of setWriteFiles().
+    void setCache(FrameCache *cache);
+    // true if the frame files belong to the cache and must be kept
+    bool isCached(void) const;
+    // writes the distinct frames of a store to the given files on all
+    // cores, skipping empty names, returns the number of files that
+    // could not be written
+    static int writeFrames(const FrameStore &store, const QStringList &fileNames);
+    void cancel(void);
+    bool isRunning(void) const;
+    bool isCanceled(void) const;
+    QString errorString(void) const;
+
+    int frameCount(void) const;
+    // one file name per frame, identical frames share a file
+    const QStringList &fileNames(void) const;
+    // the decoded frames; complete once finished() has been emitted
+    QSharedPointer<const FrameStore> frameStore(void) const;
+
+signals:
+    void progress(int done, int total);
+    // the canvas before every GifDecoder::checkpointInterval() frames,
+    // for a decoder of the same file to seek with
+    void checkpoint(const QString &fileName, int frameNumber, const QImage &canvas);
+    // emitted once the extraction is over, not after cancel()
+    void finished(bool ok);
+
+private slots:
+    void decodingFinished(void);
+
+private: // methods
+    // returns the result for finished()
+    bool decodeFrames(void);
+    void encodeFrames(void);
+    void updateFrameFileNames(void);
+
+private:
+    QScopedPointer<FrameExtractorPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(FrameExtractor)
+    Q_DISABLE_COPY(FrameExtractor)
+};
+
+#endif // __FRAMEEXTRACTOR_H_
@@ -0,0 +1,114 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <qmath.h>
+
+#include "framescheduler.h"
+
+
+class FrameSchedulerPrivate {
+public:
+    FrameSchedulerPrivate(void)
+        : frameCount(0)
+        , bpm(0)
+        , maxFps(FrameScheduler::DefaultMaxFps)
+    { /* ... */ }
+    int frameCount;
+    qreal bpm;
+    qreal maxFps;
+};
+
+
+FrameScheduler::FrameScheduler(void)
+    : d_ptr(new FrameSchedulerPrivate)
+{
+    // ...
+}
+
+
+FrameScheduler::~FrameScheduler()
+{
+    // ...
+}
+
+
+void FrameScheduler::setFrameCount(int frameCount)
+{
+    d_ptr->frameCount = frameCount;
+}
+
+
+int FrameScheduler::frameCount(void) const
+{
+    return d_ptr->frameCount;
+}
+
+
+void FrameScheduler::setBpm(qreal bpm)
+{
+    d_ptr->bpm = bpm;
+}
+
+
+qreal FrameScheduler::bpm(void) const
+{
+    return d_ptr->bpm;
+}
+
+
+void FrameScheduler::setMaxFps(qreal fps)
+{
+    d_ptr->maxFps = fps;
+}
+
+
+qreal FrameScheduler::maxFps(void) const
+{
+    return d_ptr->maxFps;
+}
+
+
+qreal FrameScheduler::sourceFps(void) const
+{
+    return d_ptr->bpm / 60.0 * d_ptr->frameCount;
+}
+
+
+qreal FrameScheduler::fps(void) const
+{
+    return d_ptr->bpm / 60.0 * framesPerBeat();
+}
+
+
+int FrameScheduler::framesPerBeat(void) const
+{
+    Q_D(const FrameScheduler);
+    if (d->frameCount <= 0 || d->bpm <= 0)
+        return 0;
+    if (d->maxFps <= 0)
+        return d->frameCount;
+    // a tiny tolerance so that e.g. 120 bpm at 30 fps yields 15 and not 14
+    const int slots = qFloor(d->maxFps * 60.0 / d->bpm + 1e-9);
+    return qBound(1, slots, d->frameCount);
+}
+
+
+int FrameScheduler::frameAt(int outputFrame, int offset) const
+{
+    Q_D(const FrameScheduler);
+    const int slots = framesPerBeat();
+    if (slots == 0)
+        return 0;
+    // integer arithmetic keeps the phase exact
+    const int phase = int(qint64(outputFrame % slots) * d->frameCount / slots);
+    return ((phase + offset) % d->frameCount + d->frameCount) % d->frameCount;
+}
+
+
+QVector<int> FrameScheduler::schedule(int outputFrames, int offset) const
+{
+    QVector<int> result(qMax(0, outputFrames));
+    for (int i = 0; i < result.size(); ++i)
+        result[i] = frameAt(i, offset);
+    return result;
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __FRAMESCHEDULER_H_
+#define __FRAMESCHEDULER_H_
+
+#include <QVector>
+#include <QScopedPointer>
+
+class FrameSchedulerPrivate;
+
+// Decides which GIF frame to show at each frame of the video. The
+// animation runs through all of its frames once per beat. Showing
+// every frame would take bpm/60 * frameCount frames per second, which
+// quickly exceeds what any player displays. So each beat is divided
+// into a whole number of video frames not exceeding the maximum frame
+// rate, and every video frame shows the GIF frame belonging to its
+// phase within the beat. Frames get dropped when the GIF has more
+// frames than there are slots per beat and held when it has fewer.
+// Because the number of video frames per beat is an integer, the
+// schedule repeats exactly with every beat and never drifts.
+class FrameScheduler
+{
+public:
+    FrameScheduler(void);
+    ~FrameScheduler();
+
+    static const int DefaultMaxFps = 60;
+
+    void setFrameCount(int frameCount);
+    int frameCount(void) const;
+    void setBpm(qreal bpm);
+    qreal bpm(void) const;
+    // 0 means no limit
+    void setMaxFps(qreal fps);
+    qreal maxFps(void) const;
+
+    // rate at which every GIF frame is shown exactly once per beat
+    qreal sourceFps(void) const;
+    // rate of the video, at most maxFps() unless a beat is too
+    // long to fit a single frame
+    qreal fps(void) const;
+    // video frames per beat, the period of the schedule
+    int framesPerBeat(void) const;
+    // GIF frame for a video frame, shifted by offset GIF frames
+    int frameAt(int outputFrame, int offset = 0) const;
+    QVector<int> schedule(int outputFrames, int offset = 0) const;
+
+private:
+    QScopedPointer<FrameSchedulerPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(FrameScheduler)
+    Q_DISABLE_COPY(FrameScheduler)
+};
+
+#endif // __FRAMESCHEDULER_H_
@@ -0,0 +1,215 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QMultiHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QtConcurrent>
+#include <string.h>
+
+#include "framestore.h"
+#include "yuvconverter.h"
+
+static const int ColorSlots = 1024;
+
+
+// 64 bit multiply-xorshift hash over the visible pixel data
+static quint64 frameHash(const QImage &image)
+{
+    static const quint64 K = Q_UINT64_C(0x9e3779b97f4a7c15);
+    quint64 h = quint64(image.width()) * K ^ quint64(image.height()) ^ quint64(image.format());
+    const int lineBytes = (image.width() * image.depth() + 7) / 8;
+    for (int y = 0; y < image.height(); ++y) {
+        const uchar *line = image.constScanLine(y);
+        int x = 0;
+        for (; x + 8 <= lineBytes; x += 8) {
+            quint64 v;
+            memcpy(&v, line + x, sizeof(v));
+            h = (h ^ v) * K;
+            h ^= h >> 29;
+        }
+        for (; x < lineBytes; ++x)
+            h = (h ^ line[x]) * K;
+    }
+    foreach (QRgb rgb, image.colorTable())
+        h = (h ^ rgb) * K;
+    return h ^ (h >> 32);
+}
+
+
+// Converts an ARGB32 image to Indexed8 without loss, with the colors
+// in order of first appearance. Returns the image unchanged if it has
+// more than 256 colors.
+static QImage toIndexed8(const QImage &image)
+{
+    if (image.format() != QImage::Format_ARGB32 && image.format() != QImage::Format_RGB32)
+        return image;
+    QImage result(image.size(), QImage::Format_Indexed8);
+    QVector<QRgb> colors;
+    colors.reserve(256);
+    // open addressing table from color to palette index
+    QRgb slotColor[ColorSlots];
+    int slotIndex[ColorSlots];
+    for (int i = 0; i < ColorSlots; ++i)
+        slotIndex[i] = -1;
+    for (int y = 0; y < image.height(); ++y) {
+        const QRgb *src = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        uchar *dst = result.scanLine(y);
+        QRgb lastColor = 0;
+        int lastIndex = -1;
+        for (int x = 0; x < image.width(); ++x) {
+            const QRgb c = src[x];
+            if (c != lastColor || lastIndex < 0) {
+                int slot = int((c * 2654435761u) >> 22) & (ColorSlots - 1);
+                while (slotIndex[slot] >= 0 && slotColor[slot] != c)
+                    slot = (slot + 1) & (ColorSlots - 1);
+                if (slotIndex[slot] < 0) {
+                    if (colors.size() == 256)
+                        return image;
+                    slotColor[slot] = c;
+                    slotIndex[slot] = colors.size();
+                    colors.append(c);
+                }
+                lastColor = c;
+                lastIndex = slotIndex[slot];
+            }
+            dst[x] = uchar(lastIndex);
+        }
+    }
+    result.setColorTable(colors);
+    return result;
+}
+
+
+class FrameStorePrivate {
+public:
+    FrameStorePrivate(void)
+        : memoryUsage(0)
+    { /* ... */ }
+    QSize size;
+    QVector<QImage> uniqueFrames;
+    QVector<int> uniqueIndexes;
+    QVector<int> delays;
+    QMultiHash<quint64, int> hashes;
+    qint64 memoryUsage;
+    // guards i420, which is filled on demand by readers
+    QMutex i420Mutex;
+    QVector<QByteArray> i420;
+};
+
+
+FrameStore::FrameStore(void)
+    : d_ptr(new FrameStorePrivate)
+{
+    // ...
+}
+
+
+FrameStore::~FrameStore()
+{
+    // ...
+}
+
+
+int FrameStore::append(const QImage &image, int delay)
+{
+    Q_D(FrameStore);
+    {
+        QMutexLocker locker(&d->i420Mutex);
+        d->i420.clear();
+    }
+    if (d->size.isEmpty())
+        d->size = image.size();
+    const QImage &compact = toIndexed8(image);
+    const quint64 hash = frameHash(compact);
+    int index = -1;
+    QMultiHash<quint64, int>::const_iterator it = d->hashes.constFind(hash);
+    for (; it != d->hashes.constEnd() && it.key() == hash; ++it) {
+        if (d->uniqueFrames.at(it.value()) == compact) {
+            index = it.value();
+            break;
+        }
+    }
+    if (index < 0) {
+        index = d->uniqueFrames.count();
+        d->hashes.insert(hash, index);
+        d->uniqueFrames.append(compact);
+        d->memoryUsage += compact.byteCount() + compact.colorCount() * sizeof(QRgb);
+    }
+    d->uniqueIndexes.append(index);
+    d->delays.append(delay);
+    return index;
+}
+
+
+QSize FrameStore::size(void) const
+{
+    return d_ptr->size;
+}
+
+
+int FrameStore::frameCount(void) const
+{
+    return d_ptr->uniqueIndexes.count();
+}
+
+
+QImage FrameStore::frame(int index) const
+{
+    return d_ptr->uniqueFrames.at(d_ptr->uniqueIndexes.at(index));
+}
+
+
+int FrameStore::delay(int index) const
+{
+    return d_ptr->delays.at(index);
+}
+
+
+const QVector<int> &FrameStore::delays(void) const
+{
+    return d_ptr->delays;
+}
+
+
+int FrameStore::totalDuration(void) const
+{
+    int duration = 0;
+    foreach (int delay, d_ptr->delays)
+        duration += delay;
+    return duration;
+}
+
+
+int FrameStore::uniqueFrameCount(void) const
+{
+    return d_ptr->uniqueFrames.count();
+}
+
+
+QImage FrameStore::uniqueFrame(int unique) const
+{
+    return d_ptr->uniqueFrames.at(unique);
+}
+
+
+const QVector<int> &FrameStore::uniqueIndexes(void) const
+{
+    return d_ptr->uniqueIndexes;
+}
+
+
+qint64 FrameStore::memoryUsage(void) const
+{
+    return d_ptr->memoryUsage;
+}
+
+
+QVector<QByteArray> FrameStore::i420Frames(void) const
+{
+    FrameStorePrivate *d = d_ptr.data();
+    QMutexLocker locker(&d->i420Mutex);
+    if (d->i420.count() != d->uniqueFrames.count())
+        d->i420 = QtConcurrent::blockingMapped<QVector<QByteArray> >(d->uniqueFrames, toI420);
+    return d->i420;
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __FRAMESTORE_H_
+#define __FRAMESTORE_H_
+
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+#include <QVector>
+#include <QScopedPointer>
+
+class FrameStorePrivate;
+
+// Holds the decoded frames of an animation in memory. Identical frames
+// are stored once, and frames with no more than 256 colors are kept as
+// Indexed8 images with a color table, a quarter of the size of ARGB32.
+// The store is filled by a single writer; once complete it may be
+// read from any number of threads. The YUV 4:2:0 data the encoders
+// are fed with is converted on first use and shared by all of them.
+class FrameStore
+{
+public:
+    FrameStore(void);
+    ~FrameStore();
+
+    // returns the index of the distinct frame the image is stored as
+    int append(const QImage &image, int delay);
+
+    QSize size(void) const;
+    int frameCount(void) const;
+    // Indexed8 or ARGB32 image of a frame
+    QImage frame(int index) const;
+    // display time of a frame in milliseconds
+    int delay(int index) const;
+    const QVector<int> &delays(void) const;
+    int totalDuration(void) const;
+
+    int uniqueFrameCount(void) const;
+    QImage uniqueFrame(int unique) const;
+    // index into the distinct frames for each frame
+    const QVector<int> &uniqueIndexes(void) const;
+    qint64 memoryUsage(void) const;
+    // the distinct frames as planar YUV 4:2:0, converted on all cores
+    // by the first caller; blocks while another thread converts them
+    QVector<QByteArray> i420Frames(void) const;
+
+private:
+    QScopedPointer<FrameStorePrivate> d_ptr;
+    Q_DECLARE_PRIVATE(FrameStore)
+    Q_DISABLE_COPY(FrameStore)
+};
+
+#endif // __FRAMESTORE_H_
@@ -0,0 +1,112 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QByteArray>
+#include <QtCore/QDebug>
+
+#include "framestreamer.h"
+#include "yuvconverter.h"
+#include "framestore.h"
+
+
+class FrameStreamerPrivate {
+public:
+    FrameStreamerPrivate(QProcess *process)
+        : process(process)
+        , fps(25)
+        , headerWritten(false)
+        , next(0)
+        , frameBytes(0)
+    { /* ... */ }
+    QProcess *process;
+    QSharedPointer<const FrameStore> frames;
+    // YUV data of the distinct frames, shared with the other streamers
+    QVector<QByteArray> converted;
+    QVector<int> sequence;
+    qreal fps;
+    bool headerWritten;
+    int next;
+    qint64 frameBytes;
+};
+
+
+FrameStreamer::FrameStreamer(QProcess *process, QObject *parent)
+    : QObject(parent)
+    , d_ptr(new FrameStreamerPrivate(process))
+{
+    QObject::connect(process, SIGNAL(started()), SLOT(writeMore()));
+    QObject::connect(process, SIGNAL(bytesWritten(qint64)), SLOT(writeMore()));
+}
+
+
+FrameStreamer::~FrameStreamer()
+{
+    // ...
+}
+
+
+void FrameStreamer::setFrames(QSharedPointer<const FrameStore> frames)
+{
+    Q_D(FrameStreamer);
+    d->frames = frames;
+    d->converted = frames->i420Frames();
+    d->frameBytes = i420Size(frames->size().width(), frames->size().height());
+}
+
+
+void FrameStreamer::setSequence(const QVector<int> &sequence)
+{
+    Q_D(FrameStreamer);
+    d->sequence = sequence;
+    d->next = 0;
+}
+
+
+void FrameStreamer::setFrameRate(qreal fps)
+{
+    d_ptr->fps = fps;
+}
+
+
+int FrameStreamer::framesWritten(void) const
+{
+    return d_ptr->next;
+}
+
+
+int FrameStreamer::frameCount(void) const
+{
+    return d_ptr->sequence.size();
+}
+
+
+void FrameStreamer::writeMore(void)
+{
+    Q_D(FrameStreamer);
+    if (d->process->state() != QProcess::Running || d->frames.isNull() || d->frames->frameCount() == 0)
+        return;
+    if (!d->headerWritten) {
+        d->process->write(QString("YUV4MPEG2 W%1 H%2 F%3:1000 Ip A1:1 C420jpeg\n")
+                          .arg(d->frames->size().width())
+                          .arg(d->frames->size().height())
+                          .arg(qRound(1000 * d->fps))
+                          .toLatin1());
+        d->headerWritten = true;
+    }
+    static const QByteArray FrameHeader("FRAME\n");
+    const qint64 maxPending = MaxPendingFrames * (d->frameBytes + FrameHeader.size());
+    const int nFrames = d->sequence.size();
+    while (d->next < nFrames && d->process->bytesToWrite() < maxPending) {
+        const int idx = d->frames->uniqueIndexes().at(d->sequence.at(d->next));
+        d->process->write(FrameHeader);
+        d->process->write(d->converted.at(idx));
+        ++d->next;
+    }
+    if (nFrames > 0)
+        emit progress(d->next, nFrames);
+    if (d->next == nFrames && d->headerWritten) {
+        d->headerWritten = false;
+        d->process->closeWriteChannel();
+        emit finished();
+    }
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __FRAMESTREAMER_H_
+#define __FRAMESTREAMER_H_
+
+#include <QObject>
+#include <QProcess>
+#include <QVector>
+#include <QScopedPointer>
+#include <QSharedPointer>
+
+class FrameStreamerPrivate;
+class FrameStore;
+
+// Feeds a sequence of frames as an uncompressed YUV4MPEG2 stream into
+// the standard input of an encoder process. The frames are taken in
+// YUV 4:2:0 from the store, which converts each distinct frame once for
+// all streamers; converting them before setFrames() keeps the work off
+// the calling thread. Frames are written only as long
+// as the process has consumed all but a few of the previous ones.
+class FrameStreamer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FrameStreamer(QProcess *process, QObject *parent = nullptr);
+    ~FrameStreamer();
+
+    static const int MaxPendingFrames = 4;
+
+    void setFrames(QSharedPointer<const FrameStore> frames);
+    // frame numbers, one per output frame
+    void setSequence(const QVector<int> &sequence);
+    void setFrameRate(qreal fps);
+    int framesWritten(void) const;
+    int frameCount(void) const;
+
+signals:
+    void progress(int done, int total);
+    void finished(void);
+
+public slots:
+    void writeMore(void);
+
+private:
+    QScopedPointer<FrameStreamerPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(FrameStreamer)
+    Q_DISABLE_COPY(FrameStreamer)
+};
+
+#endif // __FRAMESTREAMER_H_
@@ -0,0 +1,574 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QObject>
+#include <QFile>
+#include <QRect>
+#include <QtEndian>
+#include <QtCore/QDebug>
+#include <string.h>
+
+#include "gifdecoder.h"
+
+static const int MaxLzwCodes = 4096;
+
+enum Disposal {
+    DisposalNone = 0,
+    DisposalKeep = 1,
+    DisposalBackground = 2,
+    DisposalPrevious = 3
+};
+
+
+struct GifFrame {
+    QRect rect;
+    // offset of the local color table in the file, -1 if none
+    qint64 paletteOffset;
+    int paletteSize;
+    int transparent;
+    int disposal;
+    int delay;
+    bool interlaced;
+    int minCodeSize;
+    // offset of the first data sub-block
+    qint64 dataOffset;
+};
+
+
+class GifDecoderPrivate {
+public:
+    GifDecoderPrivate(void)
+        : map(nullptr)
+        , fileSize(0)
+        , loopCount(-1)
+        , current(0)
+        , checkpointBudget(GifDecoder::DefaultCheckpointBudget)
+        , checkpointInterval(1)
+    { /* ... */ }
+    QFile file;
+    const uchar *map;
+    qint64 fileSize;
+    QString errorString;
+    QSize size;
+    QVector<QRgb> globalPalette;
+    QVector<GifFrame> frames;
+    QVector<int> delays;
+    int loopCount;
+    int current;
+    QImage canvas;
+    qint64 checkpointBudget;
+    int checkpointInterval;
+    // canvas before frame i * checkpointInterval, null if not seen yet
+    QVector<QImage> checkpoints;
+    // scratch buffers reused for every frame
+    QVector<uchar> lzwData;
+    QVector<uchar> indexes;
+    quint16 prefix[MaxLzwCodes];
+    uchar suffix[MaxLzwCodes];
+    uchar first[MaxLzwCodes];
+    quint16 length[MaxLzwCodes];
+
+    void initCheckpoints(void);
+    QVector<QRgb> palette(qint64 offset, int count) const;
+    bool skipSubBlocks(qint64 &pos) const;
+    void gatherSubBlocks(qint64 pos);
+    bool decompress(int minCodeSize, int pixelCount);
+};
+
+
+// chooses the interval so that all checkpoints fit into the budget
+void GifDecoderPrivate::initCheckpoints(void)
+{
+    const qint64 frameBytes = 4 * qint64(size.width()) * qint64(size.height());
+    const qint64 maxCheckpoints = qMax<qint64>(1, checkpointBudget / qMax<qint64>(1, frameBytes));
+    checkpointInterval = int(qMax<qint64>(1, (frames.count() + maxCheckpoints - 1) / maxCheckpoints));
+    checkpoints = QVector<QImage>((frames.count() + checkpointInterval - 1) / checkpointInterval);
+}
+
+
+QVector<QRgb> GifDecoderPrivate::palette(qint64 offset, int count) const
+{
+    QVector<QRgb> result(256, qRgb(0, 0, 0));
+    const uchar *p = map + offset;
+    for (int i = 0; i < count; ++i, p += 3)
+        result[i] = qRgb(p[0], p[1], p[2]);
+    return result;
+}
+
+
+bool GifDecoderPrivate::skipSubBlocks(qint64 &pos) const
+{
+    while (pos < fileSize) {
+        const int blockSize = map[pos++];
+        if (blockSize == 0)
+            return true;
+        pos += blockSize;
+    }
+    return false;
+}
+
+
+// copies the data sub-blocks into one contiguous buffer
+void GifDecoderPrivate::gatherSubBlocks(qint64 pos)
+{
+    lzwData.resize(0);
+    while (pos < fileSize) {
+        const int declaredSize = map[pos];
+        ++pos;
+        // the last block of a truncated file is cut short
+        const int blockSize = int(qMin<qint64>(declaredSize, fileSize - pos));
+        if (blockSize == 0)
+            break;
+        const int oldSize = lzwData.size();
+        lzwData.resize(oldSize + blockSize);
+        memcpy(lzwData.data() + oldSize, map + pos, blockSize);
+        pos += blockSize;
+    }
+}
+
+
+// Table driven LZW decompression into `indexes`. Every table entry
+// knows its length and first byte, so strings are written back to
+// front in one pass without a stack. Returns false on corrupt data;
+// pixels not covered by the data keep their previous value.
+bool GifDecoderPrivate::decompress(int minCodeSize, int pixelCount)
+{
+    if (minCodeSize < 1 || minCodeSize > 11)
+        return false;
+    const int clearCode = 1 << minCodeSize;
+    const int endCode = clearCode + 1;
+    for (int i = 0; i < clearCode; ++i) {
+        prefix[i] = 0;
+        suffix[i] = uchar(i);
+        first[i] = uchar(i);
+        length[i] = 1;
+    }
+    int codeSize = minCodeSize + 1;
+    int codeMask = (1 << codeSize) - 1;
+    int next = clearCode + 2;
+    int prev = -1;
+    quint32 bitBuffer = 0;
+    int bitCount = 0;
+    const uchar *src = lzwData.constData();
+    const uchar *const srcEnd = src + lzwData.size();
+    uchar *out = indexes.data();
+    int pos = 0;
+    while (pos < pixelCount) {
+        while (bitCount < codeSize) {
+            if (src == srcEnd)
+                return false;
+            bitBuffer |= quint32(*src++) << bitCount;
+            bitCount += 8;
+        }
+        const int code = int(bitBuffer & codeMask);
+        bitBuffer >>= codeSize;
+        bitCount -= codeSize;
+        if (code == clearCode) {
+            codeSize = minCodeSize + 1;
+            codeMask = (1 << codeSize) - 1;
+            next = clearCode + 2;
+            prev = -1;
+            continue;
+        }
+        if (code == endCode)
+            break;
+        if (prev < 0) {
+            if (code >= clearCode)
+                return false;
+            out[pos++] = uchar(code);
+            prev = code;
+            continue;
+        }
+        if (code > next || (code == next && next >= MaxLzwCodes))
+            return false;
+        // the new entry is the previous string plus the first byte of
+        // the current one; for a code not yet in the table (KwKwK)
+        // that's the first byte of the previous string
+        if (next < MaxLzwCodes) {
+            prefix[next] = quint16(prev);
+            suffix[next] = (code == next) ? first[prev] : first[code];
+            first[next] = first[prev];
+            length[next] = length[prev] + 1;
+            ++next;
+            if (next > codeMask && codeSize < 12) {
+                ++codeSize;
+                codeMask = (1 << codeSize) - 1;
+            }
+        }
+        int c = code;
+        const int len = length[c];
+        for (int i = len - 1; i >= 0; --i) {
+            if (pos + i < pixelCount)
+                out[pos + i] = suffix[c];
+            c = prefix[c];
+        }
+        pos += len;
+        prev = code;
+    }
+    return true;
+}
+
+
+GifDecoder::GifDecoder(void)
+    : d_ptr(new GifDecoderPrivate)
+{
+    // ...
+}
+
+
+GifDecoder::~GifDecoder()
+{
+    close();
+}
+
+
+void GifDecoder::close(void)
+{
+    Q_D(GifDecoder);
+    if (d->map != nullptr)
+        d->file.unmap(const_cast<uchar*>(d->map));
+    d->map = nullptr;
+    d->file.close();
+    d->frames.clear();
+    d->delays.clear();
+    d->globalPalette.clear();
+    d->checkpoints.clear();
+    d->canvas = QImage();
+    d->current = 0;
+    d->loopCount = -1;
+}
+
+
+bool GifDecoder::open(const QString &fileName)
+{
+    Q_D(GifDecoder);
+    close();
+    d->errorString.clear();
+    d->file.setFileName(fileName);
+    if (!d->file.open(QIODevice::ReadOnly)) {
+        d->errorString = d->file.errorString();
+        return false;
+    }
+    d->fileSize = d->file.size();
+    d->map = d->file.map(0, d->fileSize);
+    if (d->map == nullptr) {
+        d->errorString = d->file.errorString();
+        return false;
+    }
+    const uchar *map = d->map;
+    if (d->fileSize < 13 || (memcmp(map, "GIF87a", 6) != 0 && memcmp(map, "GIF89a", 6) != 0)) {
+        d->errorString = QObject::tr("Not a GIF file");
+        return false;
+    }
+    d->size = QSize(qFromLittleEndian<quint16>(map + 6), qFromLittleEndian<quint16>(map + 8));
+    const int screenFlags = map[10];
+    qint64 pos = 13;
+    if (screenFlags & 0x80) {
+        const int count = 2 << (screenFlags & 7);
+        if (pos + 3 * count > d->fileSize) {
+            d->errorString = QObject::tr("GIF file truncated");
+            return false;
+        }
+        d->globalPalette = d->palette(pos, count);
+        pos += 3 * count;
+    }
+    // graphic control extension values apply to the next image only
+    int disposal = DisposalNone;
+    int transparent = -1;
+    int delay = 0;
+    bool done = false;
+    while (!done && pos < d->fileSize) {
+        switch (map[pos++]) {
+        case 0x21: // extension
+        {
+            if (pos >= d->fileSize)
+                break;
+            const int label = map[pos++];
+            if (label == 0xf9 && pos + 5 <= d->fileSize && map[pos] >= 4) {
+                const int flags = map[pos + 1];
+                disposal = (flags >> 2) & 7;
+                delay = 10 * qFromLittleEndian<quint16>(map + pos + 2);
+                transparent = (flags & 1) ? map[pos + 4] : -1;
+            }
+            else if (label == 0xff && pos + 12 <= d->fileSize && map[pos] == 11 && memcmp(map + pos + 1, "NETSCAPE2.0", 11) == 0) {
+                const qint64 sub = pos + 12;
+                if (sub + 4 <= d->fileSize && map[sub] >= 3 && map[sub + 1] == 1)
+                    d->loopCount = qFromLittleEndian<quint16>(map + sub + 2);
+            }
+            if (!d->skipSubBlocks(pos))
+                done = true;
+            break;
+        }
+        case 0x2c: // image descriptor
+        {
+            if (pos + 10 > d->fileSize) {
+                done = true;
+                break;
+            }
+            GifFrame frame;
+            frame.rect = QRect(qFromLittleEndian<quint16>(map + pos),
+                               qFromLittleEndian<quint16>(map + pos + 2),
+                               qFromLittleEndian<quint16>(map + pos + 4),
+                               qFromLittleEndian<quint16>(map + pos + 6));
+            const int flags = map[pos + 8];
+            pos += 9;
+            frame.interlaced = (flags & 0x40) != 0;
+            frame.paletteOffset = -1;
+            frame.paletteSize = 0;
+            if (flags & 0x80) {
+                frame.paletteOffset = pos;
+                frame.paletteSize = 2 << (flags & 7);
+                pos += 3 * frame.paletteSize;
+            }
+            if (pos >= d->fileSize) {
+                done = true;
+                break;
+            }
+            frame.minCodeSize = map[pos++];
+            frame.dataOffset = pos;
+            frame.disposal = disposal;
+            frame.transparent = transparent;
+            frame.delay = (delay <= 10) ? 100 : delay;
+            if (!d->skipSubBlocks(pos))
+                done = true;
+            d->frames.append(frame);
+            d->delays.append(frame.delay);
+            disposal = DisposalNone;
+            transparent = -1;
+            delay = 0;
+            break;
+        }
+        case 0x3b: // trailer
+            // fall through
+        default:
+            done = true;
+            break;
+        }
+    }
+    if (d->frames.isEmpty()) {
+        d->errorString = QObject::tr("GIF file contains no images");
+        return false;
+    }
+    if (d->size.isEmpty())
+        d->size = d->frames.first().rect.size();
+    d->initCheckpoints();
+    rewind();
+    return true;
+}
+
+
+bool GifDecoder::isValid(void) const
+{
+    return !d_ptr->frames.isEmpty();
+}
+
+
+QString GifDecoder::errorString(void) const
+{
+    return d_ptr->errorString;
+}
+
+
+QSize GifDecoder::size(void) const
+{
+    return d_ptr->size;
+}
+
+
+int GifDecoder::frameCount(void) const
+{
+    return d_ptr->frames.count();
+}
+
+
+int GifDecoder::delay(int frame) const
+{
+    return d_ptr->delays.at(frame);
+}
+
+
+const QVector<int> &GifDecoder::delays(void) const
+{
+    return d_ptr->delays;
+}
+
+
+int GifDecoder::totalDuration(void) const
+{
+    int duration = 0;
+    foreach (int delay, d_ptr->delays)
+        duration += delay;
+    return duration;
+}
+
+
+int GifDecoder::loopCount(void) const
+{
+    return d_ptr->loopCount;
+}
+
+
+int GifDecoder::currentFrameNumber(void) const
+{
+    return d_ptr->current;
+}
+
+
+void GifDecoder::rewind(void)
+{
+    Q_D(GifDecoder);
+    d->current = 0;
+    d->canvas = QImage(d->size, QImage::Format_ARGB32);
+    d->canvas.fill(0);
+}
+
+
+QImage GifDecoder::canvas(void) const
+{
+    return d_ptr->canvas;
+}
+
+
+void GifDecoder::restore(int frameNumber, const QImage &canvas)
+{
+    Q_D(GifDecoder);
+    d->current = frameNumber;
+    d->canvas = canvas;
+}
+
+
+void GifDecoder::setCheckpointBudget(qint64 bytes)
+{
+    Q_D(GifDecoder);
+    d->checkpointBudget = bytes;
+    d->initCheckpoints();
+}
+
+
+int GifDecoder::checkpointInterval(void) const
+{
+    return d_ptr->checkpointInterval;
+}
+
+
+void GifDecoder::addCheckpoint(int frameNumber, const QImage &canvas)
+{
+    Q_D(GifDecoder);
+    if (frameNumber < 0 || frameNumber >= d->frames.count() || frameNumber % d->checkpointInterval != 0 || canvas.size() != d->size)
+        return;
+    QImage &checkpoint = d->checkpoints[frameNumber / d->checkpointInterval];
+    if (checkpoint.isNull())
+        checkpoint = canvas;
+}
+
+
+bool GifDecoder::isSeekable(int index) const
+{
+    if (index < 0 || index >= d_ptr->frames.count())
+        return false;
+    if (index >= d_ptr->current && index - d_ptr->current < d_ptr->checkpointInterval)
+        return true;
+    return !d_ptr->checkpoints.at(index / d_ptr->checkpointInterval).isNull();
+}
+
+
+QImage GifDecoder::frame(int index)
+{
+    Q_D(GifDecoder);
+    if (index < 0 || index >= d->frames.count())
+        return QImage();
+    // continue from the current position unless a checkpoint is closer
+    int c = index / d->checkpointInterval;
+    while (c > 0 && d->checkpoints.at(c).isNull())
+        --c;
+    const int checkpointFrame = c * d->checkpointInterval;
+    if (index < d->current || checkpointFrame > d->current) {
+        if (d->checkpoints.at(c).isNull())
+            rewind();
+        else
+            restore(checkpointFrame, d->checkpoints.at(c));
+    }
+    QImage result;
+    while (d->current <= index)
+        result = read();
+    return result;
+}
+
+
+QImage GifDecoder::read(void)
+{
+    Q_D(GifDecoder);
+    if (d->current >= d->frames.count())
+        return QImage();
+    if (d->current % d->checkpointInterval == 0 && !d->checkpoints.isEmpty()) {
+        QImage &checkpoint = d->checkpoints[d->current / d->checkpointInterval];
+        if (checkpoint.isNull())
+            checkpoint = d->canvas;
+    }
+    const GifFrame &frame = d->frames.at(d->current++);
+    const int w = frame.rect.width();
+    const int h = frame.rect.height();
+    const int pixelCount = w * h;
+    d->indexes.resize(pixelCount);
+    // pixels missing from truncated data stay transparent
+    memset(d->indexes.data(), frame.transparent >= 0 ? frame.transparent : 0, pixelCount);
+    d->gatherSubBlocks(frame.dataOffset);
+    if (!d->decompress(frame.minCodeSize, pixelCount))
+        qWarning() << "GifDecoder: corrupt image data in frame" << (d->current - 1);
+    QVector<QRgb> palette = (frame.paletteOffset >= 0)
+            ? d->palette(frame.paletteOffset, frame.paletteSize)
+            : d->globalPalette;
+    if (palette.isEmpty())
+        palette = QVector<QRgb>(256, qRgb(0, 0, 0));
+    if (frame.transparent >= 0)
+        palette[frame.transparent] = 0;
+    const QRect &visible = frame.rect.intersected(QRect(QPoint(0, 0), d->size));
+    QImage previous;
+    if (frame.disposal == DisposalPrevious)
+        previous = d->canvas.copy(visible);
+    // interlaced images store rows 0, 8, 16 ..., then 4, 12 ..., then 2, 6 ..., then 1, 3 ...
+    static const int PassStart[4] = { 0, 4, 2, 1 };
+    static const int PassStep[4] = { 8, 8, 4, 2 };
+    int pass = 0;
+    int row = 0;
+    for (int i = 0; i < h; ++i) {
+        int y = i;
+        if (frame.interlaced) {
+            while (row >= h && pass < 3) {
+                ++pass;
+                row = PassStart[pass];
+            }
+            y = row;
+            row += PassStep[pass];
+        }
+        const int cy = frame.rect.top() + y;
+        if (cy < visible.top() || cy > visible.bottom())
+            continue;
+        const uchar *src = d->indexes.constData() + i * w + (visible.left() - frame.rect.left());
+        QRgb *dst = reinterpret_cast<QRgb*>(d->canvas.scanLine(cy)) + visible.left();
+        const int n = visible.width();
+        if (frame.transparent < 0) {
+            for (int x = 0; x < n; ++x)
+                dst[x] = palette.at(src[x]);
+        }
+        else {
+            for (int x = 0; x < n; ++x)
+                if (src[x] != frame.transparent)
+                    dst[x] = palette.at(src[x]);
+        }
+    }
+    const QImage result = d->canvas;
+    switch (frame.disposal) {
+    case DisposalBackground:
+        for (int y = visible.top(); y <= visible.bottom(); ++y)
+            memset(d->canvas.scanLine(y) + 4 * visible.left(), 0, 4 * visible.width());
+        break;
+    case DisposalPrevious:
+        for (int y = visible.top(); y <= visible.bottom(); ++y)
+            memcpy(d->canvas.scanLine(y) + 4 * visible.left(), previous.constScanLine(y - visible.top()), 4 * visible.width());
+        break;
+    default:
+        break;
+    }
+    return result;
+}
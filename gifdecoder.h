@@ -0,0 +1,78 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __GIFDECODER_H_
+#define __GIFDECODER_H_
+
+#include <QString>
+#include <QImage>
+#include <QSize>
+#include <QVector>
+#include <QScopedPointer>
+
+class GifDecoderPrivate;
+
+// Decodes animated GIFs. open() scans the file once and records
+// position, palette, disposal mode and delay of every frame. read()
+// then decompresses the frames in order and composites them onto a
+// canvas of the logical screen size.
+// Because of the disposal semantics frame N depends on all frames
+// before it. For random access the decoder keeps a snapshot of the
+// canvas every checkpointInterval() frames, so frame() has to decode
+// at most that many frames to reach any frame.
+class GifDecoder
+{
+public:
+    GifDecoder(void);
+    ~GifDecoder();
+
+    static const qint64 DefaultCheckpointBudget = 64 * 1024 * 1024;
+
+    bool open(const QString &fileName);
+    void close(void);
+    bool isValid(void) const;
+    QString errorString(void) const;
+
+    QSize size(void) const;
+    int frameCount(void) const;
+    // display time of a frame in milliseconds; like web browsers
+    // treat delays of 10 ms or less as 100 ms
+    int delay(int frame) const;
+    const QVector<int> &delays(void) const;
+    int totalDuration(void) const;
+    // number of repetitions from the NETSCAPE2.0 extension, 0 means
+    // forever, -1 if the file has no such extension
+    int loopCount(void) const;
+
+    // number of the frame the next call to read() returns
+    int currentFrameNumber(void) const;
+    // composited ARGB32 image of the next frame, null after the last
+    QImage read(void);
+    void rewind(void);
+
+    // The canvas the next frame gets drawn onto, i.e. the previous
+    // frame after its disposal. Together with currentFrameNumber() it
+    // is all that's needed to resume decoding from this point.
+    QImage canvas(void) const;
+    void restore(int frameNumber, const QImage &canvas);
+
+    // memory in bytes the checkpoints may take up
+    void setCheckpointBudget(qint64 bytes);
+    int checkpointInterval(void) const;
+    // Takes the canvas before a frame from another decoder of the same
+    // file, e.g. one decoding all frames in another thread. Ignored
+    // unless the frame is a multiple of checkpointInterval().
+    void addCheckpoint(int frameNumber, const QImage &canvas);
+    // true if frame() gets there without decoding more than
+    // checkpointInterval() frames
+    bool isSeekable(int index) const;
+    // composited image of any frame, null if out of range
+    QImage frame(int index);
+
+private:
+    QScopedPointer<GifDecoderPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(GifDecoder)
+    Q_DISABLE_COPY(GifDecoder)
+};
+
+#endif // __GIFDECODER_H_
@@ -0,0 +1,441 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QRegExp>
+#include <QStandardPaths>
+#include <QTextStream>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtCore/QDebug>
+#include <stdio.h>
+#include <string.h>
+
+#include "headlessrenderer.h"
+#include "framescheduler.h"
+#include "mencoderbackend.h"
+#include "ffmpegbackend.h"
+#include "renderjob.h"
+#include "batchqueue.h"
+#include "main.h"
+
+// options which make the program run without the GUI, the long ones
+// may be followed by "=value"
+static const char *HeadlessOptions[] = { "--gif", "--audio", "--out", "--batch", "--help", "--version", nullptr };
+static const char *HeadlessShortOptions[] = { "-h", "-v", nullptr };
+// progress is reported in steps of this many percent
+static const int ProgressStep = 5;
+
+
+static QTextStream &err(void)
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+
+class HeadlessRendererPrivate {
+public:
+    HeadlessRendererPrivate(void)
+        : bpm(0)
+        , maxFps(FrameScheduler::DefaultMaxFps)
+        , quiet(false)
+        , encoder(nullptr)
+        , audioEncoder(nullptr)
+        , maxEncoders(0)
+        , lastPercent(-1)
+        , exitCode(HeadlessRenderer::Success)
+    { /* ... */ }
+    QString gifFile;
+    // 0 means the tempo is estimated from the music
+    qreal bpm;
+    int maxFps;
+    bool quiet;
+    ExportOptions options;
+    QList<ExportVariant> variants;
+    QString cacheDirectory;
+    MEncoderBackend mencoder;
+    FfmpegBackend ffmpeg;
+    EncoderBackend *encoder;
+    // encodes the audio for the cache if the encoder can't do that
+    EncoderBackend *audioEncoder;
+    QFuture<bool> encoderProbe;
+    RenderJob job;
+    // manifest of the jobs to render, renders a single job if empty
+    QString batchFile;
+    // 0 for the queue's default
+    int maxEncoders;
+    BatchQueue batch;
+    int lastPercent;
+    int exitCode;
+
+    ~HeadlessRendererPrivate()
+    {
+        encoderProbe.waitForFinished();
+    }
+};
+
+
+HeadlessRenderer::HeadlessRenderer(QObject *parent)
+    : QObject(parent)
+    , d_ptr(new HeadlessRendererPrivate)
+{
+    Q_D(HeadlessRenderer);
+    QObject::connect(&d->job, SIGNAL(message(QString)), SLOT(message(QString)));
+    QObject::connect(&d->job, SIGNAL(output(QString)), SLOT(encoderOutput(QString)));
+    QObject::connect(&d->job, SIGNAL(progressReport(ExportProgress)), SLOT(encodingProgress(ExportProgress)));
+    QObject::connect(&d->job, SIGNAL(prepared()), SLOT(jobPrepared()));
+    QObject::connect(&d->job, SIGNAL(finished(bool)), SLOT(jobFinished(bool)));
+    QObject::connect(&d->batch, SIGNAL(message(QString)), SLOT(message(QString)));
+    QObject::connect(&d->batch, SIGNAL(finished(bool)), SLOT(batchFinished(bool)));
+}
+
+
+HeadlessRenderer::~HeadlessRenderer()
+{
+    // ...
+}
+
+
+bool HeadlessRenderer::isHeadless(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        for (int j = 0; HeadlessOptions[j] != nullptr; ++j)
+            if (strncmp(argv[i], HeadlessOptions[j], strlen(HeadlessOptions[j])) == 0)
+                return true;
+        for (int j = 0; HeadlessShortOptions[j] != nullptr; ++j)
+            if (strcmp(argv[i], HeadlessShortOptions[j]) == 0)
+                return true;
+    }
+    return false;
+}
+
+
+int HeadlessRenderer::exitCode(void) const
+{
+    return d_ptr->exitCode;
+}
+
+
+bool HeadlessRenderer::parseArguments(const QStringList &arguments)
+{
+    Q_D(HeadlessRenderer);
+    QCommandLineParser parser;
+    parser.setApplicationDescription(tr("Merges an animated GIF and music into a video without opening a window,\n"
+                                        "or renders all jobs listed in a manifest with --batch."));
+    const QCommandLineOption &helpOption = parser.addHelpOption();
+    const QCommandLineOption &versionOption = parser.addVersionOption();
+    QCommandLineOption gifOption("gif", tr("Animated GIF to repeat."), tr("file"));
+    QCommandLineOption audioOption("audio", tr("Music (MP3, M4A, WAV or FLAC)."), tr("file"));
+    QCommandLineOption outOption("out", tr("Video file to write."), tr("file"));
+    QCommandLineOption variantOption("variant", tr("Another video to write from the same frames at the same time, may be repeated.\n"
+                                                   "Empty fields are taken from the other options: file; WxH; preset; h264|mpeg4."), tr("spec"));
+    QCommandLineOption batchOption("batch", tr("Manifest with one job per line: gif; audio; bpm; offset; preset; output."), tr("file"));
+    QCommandLineOption jobsOption("jobs", tr("Maximum number of encoders running at the same time in batch mode."), tr("count"), QString::number(qMax(1, QThread::idealThreadCount() / 2)));
+    QCommandLineOption bpmOption("bpm", tr("Beats per minute, or \"auto\" to estimate them from the music."), tr("bpm"), "auto");
+    QCommandLineOption offsetOption("offset", tr("Frame to start with."), tr("frame"), "0");
+    QCommandLineOption maxFpsOption("max-fps", tr("Maximum frame rate of the video, 0 for no limit."), tr("fps"), QString::number(FrameScheduler::DefaultMaxFps));
+    QCommandLineOption sizeOption("size", tr("Size to scale the frames to, e.g. 1280x0; 0 keeps the aspect ratio."), tr("WxH"), "0x0");
+    QCommandLineOption filterOption("filter", tr("Scaling filter: lanczos3 or bilinear."), tr("filter"), "lanczos3");
+    QCommandLineOption encoderOption("encoder", tr("Encoder: mencoder or ffmpeg."), tr("name"), "ffmpeg");
+    QCommandLineOption encoderPathOption("encoder-path", tr("Path to the encoder's binary, searched in PATH by default."), tr("path"));
+    QCommandLineOption presetOption("preset", tr("Encoder preset: ultrafast, veryfast, balanced or hq."), tr("preset"), "balanced");
+    QCommandLineOption audioBitrateOption("audio-bitrate", tr("Audio bitrate."), tr("kbps"), "128");
+    QCommandLineOption tmpOption("tmp", tr("Directory for temporary files."), tr("directory"), QDir::tempPath());
+    QCommandLineOption noStreamOption("no-stream", tr("Let the encoder read the frames from image files."));
+    QCommandLineOption noLoopOption("no-loop", tr("Encode the whole video instead of copying one loop."));
+    QCommandLineOption noSegmentsOption("no-segments", tr("Encode with a single encoder process."));
+    QCommandLineOption noCacheOption("no-cache", tr("Don't keep the extracted frames and the encoded audio for later runs."));
+    QCommandLineOption progressLogOption("progress-log", tr("File to append the encoders' progress reports to."), tr("file"), VideoExporter::defaultProgressLogFile());
+    QCommandLineOption quietOption("quiet", tr("Print errors only."));
+    parser.addOption(gifOption);
+    parser.addOption(audioOption);
+    parser.addOption(outOption);
+    parser.addOption(variantOption);
+    parser.addOption(batchOption);
+    parser.addOption(jobsOption);
+    parser.addOption(bpmOption);
+    parser.addOption(offsetOption);
+    parser.addOption(maxFpsOption);
+    parser.addOption(sizeOption);
+    parser.addOption(filterOption);
+    parser.addOption(encoderOption);
+    parser.addOption(encoderPathOption);
+    parser.addOption(presetOption);
+    parser.addOption(audioBitrateOption);
+    parser.addOption(tmpOption);
+    parser.addOption(noStreamOption);
+    parser.addOption(noLoopOption);
+    parser.addOption(noSegmentsOption);
+    parser.addOption(noCacheOption);
+    parser.addOption(progressLogOption);
+    parser.addOption(quietOption);
+    d->exitCode = UsageError;
+    if (!parser.parse(arguments)) {
+        err() << parser.errorText() << endl;
+        return false;
+    }
+    if (parser.isSet(helpOption)) {
+        err() << parser.helpText() << flush;
+        d->exitCode = Success;
+        return false;
+    }
+    if (parser.isSet(versionOption)) {
+        err() << AppName << " " << AppVersion << endl;
+        d->exitCode = Success;
+        return false;
+    }
+    d->batchFile = parser.value(batchOption);
+    if (d->batchFile.isEmpty() && (!parser.isSet(gifOption) || !parser.isSet(audioOption) || !parser.isSet(outOption))) {
+        err() << tr("--gif, --audio and --out or --batch are required, see --help.") << endl;
+        return false;
+    }
+    d->gifFile = parser.value(gifOption);
+    d->options.audioFile = parser.value(audioOption);
+    d->options.outputFile = parser.value(outOption);
+    d->options.tempDirectory = parser.value(tmpOption);
+    d->options.streamFrames = !parser.isSet(noStreamOption);
+    d->options.loopExport = !parser.isSet(noLoopOption);
+    d->options.segmentedExport = !parser.isSet(noSegmentsOption);
+    d->options.progressLogFile = parser.value(progressLogOption);
+    d->quiet = parser.isSet(quietOption);
+    bool ok = true;
+    if (parser.value(bpmOption) != "auto") {
+        d->bpm = parser.value(bpmOption).toDouble(&ok);
+        if (!ok || d->bpm <= 0) {
+            err() << tr("Invalid tempo: %1").arg(parser.value(bpmOption)) << endl;
+            return false;
+        }
+    }
+    d->options.frameOffset = parser.value(offsetOption).toInt(&ok);
+    if (!ok || d->options.frameOffset < 0) {
+        err() << tr("Invalid frame offset: %1").arg(parser.value(offsetOption)) << endl;
+        return false;
+    }
+    d->maxEncoders = parser.value(jobsOption).toInt(&ok);
+    if (!ok || d->maxEncoders <= 0) {
+        err() << tr("Invalid number of jobs: %1").arg(parser.value(jobsOption)) << endl;
+        return false;
+    }
+    d->maxFps = parser.value(maxFpsOption).toInt(&ok);
+    if (!ok || d->maxFps < 0) {
+        err() << tr("Invalid frame rate: %1").arg(parser.value(maxFpsOption)) << endl;
+        return false;
+    }
+    d->options.audioBitrate = parser.value(audioBitrateOption).toInt(&ok);
+    if (!ok || d->options.audioBitrate <= 0) {
+        err() << tr("Invalid audio bitrate: %1").arg(parser.value(audioBitrateOption)) << endl;
+        return false;
+    }
+    QRegExp sizeRe("(\\d+)x(\\d+)");
+    if (!sizeRe.exactMatch(parser.value(sizeOption))) {
+        err() << tr("Invalid size: %1").arg(parser.value(sizeOption)) << endl;
+        return false;
+    }
+    d->options.outputSize = QSize(sizeRe.cap(1).toInt(), sizeRe.cap(2).toInt());
+    const QString &filter = parser.value(filterOption).toLower();
+    if (filter == "lanczos3")
+        d->options.resizeFilter = ImageResizer::Lanczos3;
+    else if (filter == "bilinear")
+        d->options.resizeFilter = ImageResizer::Bilinear;
+    else {
+        err() << tr("Unknown filter: %1").arg(filter) << endl;
+        return false;
+    }
+    const QStringList presets = QStringList() << "ultrafast" << "veryfast" << "balanced" << "hq";
+    const int preset = presets.indexOf(parser.value(presetOption).toLower());
+    if (preset < 0) {
+        err() << tr("Unknown preset: %1").arg(parser.value(presetOption)) << endl;
+        return false;
+    }
+    d->options.preset = EncoderBackend::Preset(preset);
+    if (!d->batchFile.isEmpty() && parser.isSet(variantOption)) {
+        err() << tr("--variant can't be combined with --batch.") << endl;
+        return false;
+    }
+    foreach (QString spec, parser.values(variantOption)) {
+        const QStringList &fields = spec.split(';');
+        ExportVariant variant;
+        variant.outputFile = fields.at(0).trimmed();
+        variant.outputSize = d->options.outputSize;
+        variant.preset = d->options.preset;
+        const QString &size = fields.value(1).trimmed();
+        const QString &variantPreset = fields.value(2).trimmed().toLower();
+        const QString &codec = fields.value(3).trimmed().toLower();
+        if (variant.outputFile.isEmpty() || fields.count() > 4) {
+            err() << tr("Invalid variant: %1").arg(spec) << endl;
+            return false;
+        }
+        if (!size.isEmpty()) {
+            if (!sizeRe.exactMatch(size)) {
+                err() << tr("Invalid size: %1").arg(size) << endl;
+                return false;
+            }
+            variant.outputSize = QSize(sizeRe.cap(1).toInt(), sizeRe.cap(2).toInt());
+        }
+        if (!variantPreset.isEmpty()) {
+            if (!presets.contains(variantPreset)) {
+                err() << tr("Unknown preset: %1").arg(variantPreset) << endl;
+                return false;
+            }
+            variant.preset = EncoderBackend::Preset(presets.indexOf(variantPreset));
+        }
+        if (codec == "mpeg4")
+            variant.codec = EncoderBackend::Mpeg4;
+        else if (!codec.isEmpty() && codec != "h264") {
+            err() << tr("Unknown codec: %1").arg(codec) << endl;
+            return false;
+        }
+        d->variants.append(variant);
+    }
+    const QString &encoder = parser.value(encoderOption).toLower();
+    if (encoder == "ffmpeg")
+        d->encoder = &d->ffmpeg;
+    else if (encoder == "mencoder")
+        d->encoder = &d->mencoder;
+    else {
+        err() << tr("Unknown encoder: %1").arg(encoder) << endl;
+        return false;
+    }
+    const QString &encoderPath = parser.isSet(encoderPathOption)
+            ? parser.value(encoderPathOption)
+            : QStandardPaths::findExecutable(encoder);
+    if (encoderPath.isEmpty()) {
+        err() << tr("%1 not found in PATH, use --encoder-path.").arg(d->encoder->name()) << endl;
+        return false;
+    }
+    d->encoder->setExecutable(encoderPath);
+    if (d->encoder == &d->mencoder) {
+        // MEncoder can't encode the audio alone
+        d->ffmpeg.setExecutable(QStandardPaths::findExecutable("ffmpeg"));
+        if (!d->ffmpeg.executable().isEmpty())
+            d->audioEncoder = &d->ffmpeg;
+    }
+    if (!parser.isSet(noCacheOption))
+        d->cacheDirectory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (!d->batchFile.isEmpty() && !d->batch.load(d->batchFile)) {
+        err() << d->batch.errorString() << endl;
+        return false;
+    }
+    d->exitCode = Success;
+    return true;
+}
+
+
+void HeadlessRenderer::start(void)
+{
+    Q_D(HeadlessRenderer);
+    if (d->audioEncoder != nullptr)
+        d->audioEncoder->probe();
+    if (!d->batchFile.isEmpty()) {
+        // a missing encoder is better noticed before hundreds of jobs
+        if (!d->encoder->probe()) {
+            fail(tr("%1 could not be run from \"%2\".").arg(d->encoder->name()).arg(d->encoder->executable()));
+            return;
+        }
+        d->batch.setDefaults(d->options, d->maxFps);
+        d->batch.setCacheDirectory(d->cacheDirectory);
+        d->batch.setEncoder(d->encoder);
+        d->batch.setAudioEncoder(d->audioEncoder);
+        d->batch.setMaxEncoders(d->maxEncoders);
+        message(tr("%1 jobs, %2 done already, up to %3 encoders at a time")
+                .arg(d->batch.jobCount()).arg(d->batch.doneCount()).arg(d->batch.maxEncoders()));
+        d->batch.start();
+        return;
+    }
+    // the encoder is probed while the inputs are being processed
+    d->encoderProbe = QtConcurrent::run(d->encoder, &EncoderBackend::probe);
+    d->job.setGifFile(d->gifFile);
+    d->job.setBpm(d->bpm);
+    d->job.setMaxFps(d->maxFps);
+    d->job.setCacheDirectory(d->cacheDirectory);
+    d->job.setOptions(d->options);
+    d->job.setVariants(d->variants);
+    d->job.setEncoder(d->encoder);
+    d->job.setAudioEncoder(d->audioEncoder);
+    d->job.prepare();
+}
+
+
+void HeadlessRenderer::jobPrepared(void)
+{
+    Q_D(HeadlessRenderer);
+    if (d->bpm <= 0)
+        message(tr("Estimated tempo: %1 bpm").arg(d->job.bpm(), 0, 'f', 2));
+    d->encoderProbe.waitForFinished();
+    d->job.encode();
+}
+
+
+void HeadlessRenderer::jobFinished(bool ok)
+{
+    Q_D(HeadlessRenderer);
+    if (!ok) {
+        fail(d->job.errorString());
+        return;
+    }
+    message(tr("Written video to \"%1\".").arg(d->options.outputFile));
+    foreach (ExportVariant variant, d->variants)
+        message(tr("Written video to \"%1\".").arg(variant.outputFile));
+    finish(Success);
+}
+
+
+void HeadlessRenderer::batchFinished(bool ok)
+{
+    Q_D(HeadlessRenderer);
+    message(tr("%1 of %2 jobs done, %3 failed.").arg(d->batch.doneCount()).arg(d->batch.jobCount()).arg(d->batch.failedCount()));
+    finish(ok ? Success : Failure);
+}
+
+
+void HeadlessRenderer::message(const QString &text)
+{
+    Q_D(HeadlessRenderer);
+    if (!d->quiet)
+        err() << text << endl;
+}
+
+
+void HeadlessRenderer::encoderOutput(const QString &out)
+{
+    Q_D(HeadlessRenderer);
+    if (!d->quiet)
+        err() << out << flush;
+}
+
+
+void HeadlessRenderer::encodingProgress(const ExportProgress &report)
+{
+    Q_D(HeadlessRenderer);
+    if (d->quiet || report.totalFrames <= 0)
+        return;
+    // percent of all passes, the later ones start at 100, 200 ...
+    const int percent = 100 * (report.pass - 1) + 100 * report.frames / report.totalFrames;
+    if (percent / ProgressStep == d->lastPercent / ProgressStep)
+        return;
+    d->lastPercent = percent;
+    err() << report.toString() << endl;
+}
+
+
+void HeadlessRenderer::fail(const QString &message)
+{
+    Q_D(HeadlessRenderer);
+    if (d->exitCode != Success)
+        return;
+    err() << message << endl;
+    d->job.cancel();
+    d->batch.cancel();
+    finish(Failure);
+}
+
+
+void HeadlessRenderer::finish(int exitCode)
+{
+    Q_D(HeadlessRenderer);
+    d->exitCode = exitCode;
+    QCoreApplication::exit(exitCode);
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __HEADLESSRENDERER_H_
+#define __HEADLESSRENDERER_H_
+
+#include <QObject>
+#include <QStringList>
+#include <QScopedPointer>
+
+#include "videoexporter.h"
+
+class HeadlessRendererPrivate;
+
+// Renders a video, or a batch of them, from the command line without
+// any widgets, so it runs on a QCoreApplication on machines without a
+// display. See RenderJob and BatchQueue for how. The application exits
+// with one of the exit codes below when done.
+class HeadlessRenderer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HeadlessRenderer(QObject *parent = nullptr);
+    ~HeadlessRenderer();
+
+    enum ExitCode {
+        Success = 0,
+        Failure = 1,
+        UsageError = 2
+    };
+
+    // true if the arguments ask for rendering without the GUI
+    static bool isHeadless(int argc, char *argv[]);
+    // returns false after printing a message if the application
+    // should exit with exitCode() right away
+    bool parseArguments(const QStringList &arguments);
+    int exitCode(void) const;
+
+public slots:
+    void start(void);
+
+private slots:
+    void jobPrepared(void);
+    void jobFinished(bool ok);
+    void batchFinished(bool ok);
+    void message(const QString&);
+    void encoderOutput(const QString&);
+    void encodingProgress(const ExportProgress&);
+
+private: // methods
+    void fail(const QString &message);
+    void finish(int exitCode);
+
+private:
+    QScopedPointer<HeadlessRendererPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(HeadlessRenderer)
+    Q_DISABLE_COPY(HeadlessRenderer)
+};
+
+#endif // __HEADLESSRENDERER_H_
@@ -0,0 +1,382 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QVector>
+#include <QtConcurrent>
+#include <qmath.h>
+
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#define RESIZER_USE_SSE
+#include <emmintrin.h>
+#endif
+
+#include "imageresizer.h"
+#include "framestore.h"
+
+static const int Precision = 14;
+static const int One = 1 << Precision;
+
+
+// weights of one dimension: output pixel i is the weighted sum of
+// count[i] input pixels beginning at start[i]
+struct Coefficients {
+    Coefficients(void)
+        : stride(0)
+    { /* ... */ }
+    QVector<int> start;
+    QVector<int> count;
+    QVector<qint16> weights;
+    int stride;
+};
+
+
+static double bilinear(double x)
+{
+    x = qAbs(x);
+    return (x < 1.0) ? 1.0 - x : 0.0;
+}
+
+
+static double sinc(double x)
+{
+    if (x == 0.0)
+        return 1.0;
+    x *= M_PI;
+    return qSin(x) / x;
+}
+
+
+static double lanczos3(double x)
+{
+    return (x > -3.0 && x < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+}
+
+
+static Coefficients computeCoefficients(int inSize, int outSize, ImageResizer::Filter filter)
+{
+    Coefficients c;
+    if (inSize <= 0 || outSize <= 0)
+        return c;
+    double (*kernel)(double) = (filter == ImageResizer::Lanczos3) ? lanczos3 : bilinear;
+    const double radius = (filter == ImageResizer::Lanczos3) ? 3.0 : 1.0;
+    const double scale = double(inSize) / outSize;
+    // when shrinking the kernel is stretched to cover all input pixels
+    const double filterScale = qMax(scale, 1.0);
+    const double support = radius * filterScale;
+    c.stride = 2 * qCeil(support) + 1;
+    c.start.resize(outSize);
+    c.count.resize(outSize);
+    c.weights.fill(0, outSize * c.stride);
+    QVector<double> w(c.stride);
+    for (int o = 0; o < outSize; ++o) {
+        const double center = (o + 0.5) * scale;
+        const int lo = qMax(int(center - support + 0.5), 0);
+        const int hi = qMin(int(center + support + 0.5), inSize);
+        const int n = qMin(hi - lo, c.stride);
+        double sum = 0.0;
+        for (int k = 0; k < n; ++k) {
+            w[k] = kernel((lo + k - center + 0.5) / filterScale);
+            sum += w[k];
+        }
+        if (sum == 0.0)
+            sum = 1.0;
+        // the rounding error goes to the largest weight so that all
+        // weights add up to exactly one
+        qint16 *dst = c.weights.data() + o * c.stride;
+        int total = 0;
+        int largest = 0;
+        for (int k = 0; k < n; ++k) {
+            dst[k] = qint16(qRound(w[k] / sum * One));
+            total += dst[k];
+            if (dst[k] > dst[largest])
+                largest = k;
+        }
+        dst[largest] = qint16(dst[largest] + One - total);
+        c.start[o] = lo;
+        c.count[o] = n;
+    }
+    return c;
+}
+
+
+static inline uchar clamp8(int v)
+{
+    return uchar(qBound(0, v, 255));
+}
+
+
+#ifdef RESIZER_USE_SSE
+// two weights in every 32 bit lane, as expected by _mm_madd_epi16
+static inline __m128i weightPair(qint16 w0, qint16 w1)
+{
+    return _mm_set1_epi32(int(quint32(quint16(w0)) | (quint32(quint16(w1)) << 16)));
+}
+
+
+// restores the premultiplied invariant that no color exceeds alpha,
+// which negative filter lobes may have broken
+static inline __m128i clampToAlpha(__m128i px)
+{
+    __m128i a = _mm_srli_epi32(px, 24);
+    a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+    a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+    return _mm_min_epu8(px, a);
+}
+#endif
+
+
+static void resizeRowHorizontally(const quint32 *src, quint32 *dst, const Coefficients &c)
+{
+    const int outSize = c.start.size();
+#ifdef RESIZER_USE_SSE
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi32(One / 2);
+    for (int o = 0; o < outSize; ++o) {
+        const quint32 *p = src + c.start.at(o);
+        const qint16 *w = c.weights.constData() + o * c.stride;
+        const int n = c.count.at(o);
+        __m128i sum = rounding;
+        int k = 0;
+        for (; k + 2 <= n; k += 2) {
+            // B0 B1 G0 G1 R0 R1 A0 A1 as 16 bit integers
+            const __m128i ab = _mm_unpacklo_epi8(_mm_unpacklo_epi8(_mm_cvtsi32_si128(int(p[k])), _mm_cvtsi32_si128(int(p[k + 1]))), zero);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(ab, weightPair(w[k], w[k + 1])));
+        }
+        if (k < n) {
+            const __m128i a = _mm_unpacklo_epi8(_mm_unpacklo_epi8(_mm_cvtsi32_si128(int(p[k])), zero), zero);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(a, weightPair(w[k], 0)));
+        }
+        sum = _mm_srai_epi32(sum, Precision);
+        sum = _mm_packs_epi32(sum, sum);
+        dst[o] = quint32(_mm_cvtsi128_si32(clampToAlpha(_mm_packus_epi16(sum, sum))));
+    }
+#else
+    for (int o = 0; o < outSize; ++o) {
+        const quint32 *p = src + c.start.at(o);
+        const qint16 *w = c.weights.constData() + o * c.stride;
+        const int n = c.count.at(o);
+        int b = One / 2, g = One / 2, r = One / 2, a = One / 2;
+        for (int k = 0; k < n; ++k) {
+            b += w[k] * int(p[k] & 0xff);
+            g += w[k] * int((p[k] >> 8) & 0xff);
+            r += w[k] * int((p[k] >> 16) & 0xff);
+            a += w[k] * int(p[k] >> 24);
+        }
+        const int alpha = clamp8(a >> Precision);
+        dst[o] = quint32(qMin(int(clamp8(b >> Precision)), alpha))
+                | (quint32(qMin(int(clamp8(g >> Precision)), alpha)) << 8)
+                | (quint32(qMin(int(clamp8(r >> Precision)), alpha)) << 16)
+                | (quint32(alpha) << 24);
+    }
+#endif
+}
+
+
+static void resizeRowVertically(const QImage &src, int o, uchar *dst, const Coefficients &c)
+{
+    const int start = c.start.at(o);
+    const int n = c.count.at(o);
+    const qint16 *w = c.weights.constData() + o * c.stride;
+    const int width = src.width();
+    int x = 0;
+#ifdef RESIZER_USE_SSE
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi32(One / 2);
+    for (; x + 4 <= width; x += 4) {
+        __m128i s0 = rounding, s1 = rounding, s2 = rounding, s3 = rounding;
+        int k = 0;
+        for (; k < n; k += 2) {
+            const __m128i ra = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src.constScanLine(start + k) + 4 * x));
+            const __m128i rb = (k + 1 < n)
+                    ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(src.constScanLine(start + k + 1) + 4 * x))
+                    : zero;
+            const __m128i wk = weightPair(w[k], (k + 1 < n) ? w[k + 1] : 0);
+            // bytes of the two rows interleaved, pixels 0 and 1 in lo, 2 and 3 in hi
+            const __m128i lo = _mm_unpacklo_epi8(ra, rb);
+            const __m128i hi = _mm_unpackhi_epi8(ra, rb);
+            s0 = _mm_add_epi32(s0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), wk));
+            s1 = _mm_add_epi32(s1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), wk));
+            s2 = _mm_add_epi32(s2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), wk));
+            s3 = _mm_add_epi32(s3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), wk));
+        }
+        const __m128i p01 = _mm_packs_epi32(_mm_srai_epi32(s0, Precision), _mm_srai_epi32(s1, Precision));
+        const __m128i p23 = _mm_packs_epi32(_mm_srai_epi32(s2, Precision), _mm_srai_epi32(s3, Precision));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * x), clampToAlpha(_mm_packus_epi16(p01, p23)));
+    }
+#endif
+    for (; x < width; ++x) {
+        int sum[4] = { One / 2, One / 2, One / 2, One / 2 };
+        for (int k = 0; k < n; ++k) {
+            const uchar *p = src.constScanLine(start + k) + 4 * x;
+            for (int ch = 0; ch < 4; ++ch)
+                sum[ch] += w[k] * int(p[ch]);
+        }
+        // channels in memory order; with ARGB32 on little endian
+        // machines alpha comes last
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        const int alpha = clamp8(sum[3] >> Precision);
+        for (int ch = 0; ch < 3; ++ch)
+            dst[4 * x + ch] = uchar(qMin(int(clamp8(sum[ch] >> Precision)), alpha));
+        dst[4 * x + 3] = uchar(alpha);
+#else
+        const int alpha = clamp8(sum[0] >> Precision);
+        dst[4 * x] = uchar(alpha);
+        for (int ch = 1; ch < 4; ++ch)
+            dst[4 * x + ch] = uchar(qMin(int(clamp8(sum[ch] >> Precision)), alpha));
+#endif
+    }
+}
+
+
+// A premultiplied pixel is the pixel composited onto black, which is
+// what the encoders make of transparency anyway. Marked opaque, the
+// frames can be stored with a palette if they have few enough colors.
+static QImage toOpaque(const QImage &image)
+{
+    QImage result(image.size(), QImage::Format_RGB32);
+    for (int y = 0; y < image.height(); ++y) {
+        const quint32 *src = reinterpret_cast<const quint32*>(image.constScanLine(y));
+        quint32 *dst = reinterpret_cast<quint32*>(result.scanLine(y));
+        for (int x = 0; x < image.width(); ++x)
+            dst[x] = src[x] | 0xff000000u;
+    }
+    return result;
+}
+
+
+struct ResizeFunctor {
+    typedef QImage result_type;
+    ResizeFunctor(const ImageResizer *resizer)
+        : resizer(resizer)
+    { /* ... */ }
+    QImage operator()(const QImage &image) const
+    {
+        return toOpaque(resizer->resize(image));
+    }
+    const ImageResizer *resizer;
+};
+
+
+class ImageResizerPrivate {
+public:
+    ImageResizerPrivate(void)
+        : filter(ImageResizer::Lanczos3)
+    { /* ... */ }
+    ImageResizer::Filter filter;
+    QSize sourceSize;
+    QSize targetSize;
+    Coefficients horizontal;
+    Coefficients vertical;
+
+    void updateCoefficients(void)
+    {
+        horizontal = computeCoefficients(sourceSize.width(), targetSize.width(), filter);
+        vertical = computeCoefficients(sourceSize.height(), targetSize.height(), filter);
+    }
+};
+
+
+ImageResizer::ImageResizer(void)
+    : d_ptr(new ImageResizerPrivate)
+{
+    // ...
+}
+
+
+ImageResizer::~ImageResizer()
+{
+    // ...
+}
+
+
+void ImageResizer::setFilter(Filter filter)
+{
+    Q_D(ImageResizer);
+    if (filter == d->filter)
+        return;
+    d->filter = filter;
+    d->updateCoefficients();
+}
+
+
+ImageResizer::Filter ImageResizer::filter(void) const
+{
+    return d_ptr->filter;
+}
+
+
+void ImageResizer::setSize(const QSize &sourceSize, const QSize &targetSize)
+{
+    Q_D(ImageResizer);
+    if (sourceSize == d->sourceSize && targetSize == d->targetSize)
+        return;
+    d->sourceSize = sourceSize;
+    d->targetSize = targetSize;
+    d->updateCoefficients();
+}
+
+
+QSize ImageResizer::sourceSize(void) const
+{
+    return d_ptr->sourceSize;
+}
+
+
+QSize ImageResizer::targetSize(void) const
+{
+    return d_ptr->targetSize;
+}
+
+
+QSize ImageResizer::fit(const QSize &sourceSize, const QSize &box)
+{
+    if (sourceSize.isEmpty())
+        return sourceSize;
+    // without a box odd dimensions are still scaled by a pixel
+    qreal scale = 1;
+    if (box.width() > 0 && box.height() > 0)
+        scale = qMin(qreal(box.width()) / sourceSize.width(), qreal(box.height()) / sourceSize.height());
+    else if (box.width() > 0)
+        scale = qreal(box.width()) / sourceSize.width();
+    else if (box.height() > 0)
+        scale = qreal(box.height()) / sourceSize.height();
+    const int width = qMax(2, 2 * qRound(scale * sourceSize.width() / 2));
+    const int height = qMax(2, 2 * qRound(scale * sourceSize.height() / 2));
+    return QSize(width, height);
+}
+
+
+QImage ImageResizer::resize(const QImage &image) const
+{
+    Q_D(const ImageResizer);
+    const QImage &src = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    if (src.size() != d->sourceSize || d->targetSize.isEmpty() || src.size() == d->targetSize)
+        return src;
+    QImage tmp = src;
+    if (d->targetSize.width() != src.width()) {
+        tmp = QImage(d->targetSize.width(), src.height(), QImage::Format_ARGB32_Premultiplied);
+        for (int y = 0; y < src.height(); ++y)
+            resizeRowHorizontally(reinterpret_cast<const quint32*>(src.constScanLine(y)),
+                                  reinterpret_cast<quint32*>(tmp.scanLine(y)),
+                                  d->horizontal);
+    }
+    if (d->targetSize.height() == tmp.height())
+        return tmp;
+    QImage dst(d->targetSize, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < dst.height(); ++y)
+        resizeRowVertically(tmp, y, dst.scanLine(y), d->vertical);
+    return dst;
+}
+
+
+QSharedPointer<FrameStore> ImageResizer::resize(QSharedPointer<const FrameStore> frames) const
+{
+    QSharedPointer<FrameStore> result(new FrameStore);
+    QList<QImage> uniqueFrames;
+    for (int u = 0; u < frames->uniqueFrameCount(); ++u)
+        uniqueFrames.append(frames->uniqueFrame(u));
+    const QList<QImage> &resized = QtConcurrent::blockingMapped<QList<QImage> >(uniqueFrames, ResizeFunctor(this));
+    for (int i = 0; i < frames->frameCount(); ++i)
+        result->append(resized.at(frames->uniqueIndexes().at(i)), frames->delay(i));
+    return result;
+}
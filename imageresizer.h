@@ -0,0 +1,57 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __IMAGERESIZER_H_
+#define __IMAGERESIZER_H_
+
+#include <QImage>
+#include <QSize>
+#include <QScopedPointer>
+#include <QSharedPointer>
+
+class ImageResizerPrivate;
+class FrameStore;
+
+// Resamples images to a different size in two separable passes, first
+// horizontally, then vertically, with 14 bit fixed point weights. The
+// weights depend only on the source and target size and the filter,
+// so they are computed once in setSize() and then shared by all
+// images. resize() may be called from several threads at once.
+class ImageResizer
+{
+public:
+    ImageResizer(void);
+    ~ImageResizer();
+
+    enum Filter {
+        Bilinear,
+        Lanczos3
+    };
+
+    void setFilter(Filter filter);
+    Filter filter(void) const;
+    void setSize(const QSize &sourceSize, const QSize &targetSize);
+    QSize sourceSize(void) const;
+    QSize targetSize(void) const;
+
+    // Size that fits into the given box, keeping the aspect ratio of
+    // the source. A width or height of 0 leaves that dimension
+    // unconstrained, if both are 0 the source size is kept. Both
+    // dimensions are rounded to even numbers as needed for YUV 4:2:0,
+    // so an odd sized source gets scaled even then.
+    static QSize fit(const QSize &sourceSize, const QSize &box);
+
+    // returns an ARGB32_Premultiplied image of the target size
+    QImage resize(const QImage &image) const;
+    // Resizes the distinct frames of a store in parallel. The frames
+    // are meant for the encoders, so they are composited onto black
+    // and returned as RGB32.
+    QSharedPointer<FrameStore> resize(QSharedPointer<const FrameStore> frames) const;
+
+private:
+    QScopedPointer<ImageResizerPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(ImageResizer)
+    Q_DISABLE_COPY(ImageResizer)
+};
+
+#endif // __IMAGERESIZER_H_
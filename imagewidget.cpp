@@ -4,16 +4,32 @@
 #include <QPainter>
 #include <QMimeData>
 #include <QPixmap>
+#include <QCache>
 #include <QUrl>
 #include <QtCore/QDebug>
 
 #include "imagewidget.h"
+#include "imageresizer.h"
+#include "framestore.h"
 
 
 class ImageWidgetPrivate
 {
 public:
-    ImageWidgetPrivate(void) {}
+    ImageWidgetPrivate(void)
+        : frameIndex(-1)
+    {
+        resizer.setFilter(ImageResizer::Bilinear);
+        cache.setMaxCost(ImageWidget::DefaultCacheBudget / 1024);
+    }
+    QSharedPointer<const FrameStore> frames;
+    // scaled distinct frames, the cost is their size in KB
+    QCache<int, QPixmap> cache;
+    ImageResizer resizer;
+    // what is shown, either a frame or a single image
+    int frameIndex;
+    QImage image;
+    QPixmap current;
 };
 
 
@@ -29,7 +45,94 @@ ImageWidget::ImageWidget(QLabel *parent)
 }
 
 
-static const QRegExp gReAudio("\\.(mp3|m4a)$");
+void ImageWidget::setFrames(QSharedPointer<const FrameStore> frames)
+{
+    Q_D(ImageWidget);
+    d->frames = frames;
+    d->cache.clear();
+    d->frameIndex = -1;
+}
+
+
+void ImageWidget::showFrame(int index)
+{
+    Q_D(ImageWidget);
+    if (d->frames.isNull() || index < 0 || index >= d->frames->frameCount())
+        return;
+    const int unique = d->frames->uniqueIndexes().at(index);
+    const QPixmap *cached = d->cache.object(unique);
+    if (cached != nullptr) {
+        d->current = *cached;
+    }
+    else {
+        d->current = scaled(d->frames->uniqueFrame(unique));
+        // insert() deletes a pixmap costing more than the whole cache at once
+        d->cache.insert(unique, new QPixmap(d->current), qMax(1, d->current.width() * d->current.height() * 4 / 1024));
+    }
+    d->frameIndex = index;
+    d->image = QImage();
+    update();
+}
+
+
+void ImageWidget::showImage(const QImage &image)
+{
+    Q_D(ImageWidget);
+    d->image = image;
+    d->frameIndex = -1;
+    d->current = scaled(image);
+    update();
+}
+
+
+void ImageWidget::setCacheBudget(int bytes)
+{
+    d_ptr->cache.setMaxCost(bytes / 1024);
+}
+
+
+QPixmap ImageWidget::scaled(const QImage &image)
+{
+    Q_D(ImageWidget);
+    const qreal dpr = devicePixelRatio();
+    QSize size = image.size();
+    size.scale(this->size() * dpr, Qt::KeepAspectRatio);
+    if (size.isEmpty())
+        return QPixmap();
+    d->resizer.setSize(image.size(), size);
+    QPixmap pixmap = QPixmap::fromImage(d->resizer.resize(image));
+    pixmap.setDevicePixelRatio(dpr);
+    return pixmap;
+}
+
+
+void ImageWidget::paintEvent(QPaintEvent *e)
+{
+    Q_D(ImageWidget);
+    if (d->current.isNull()) {
+        QLabel::paintEvent(e);
+        return;
+    }
+    QPainter p(this);
+    const QSize &size = d->current.size() / d->current.devicePixelRatio();
+    p.drawPixmap((width() - size.width()) / 2, (height() - size.height()) / 2, d->current);
+}
+
+
+void ImageWidget::resizeEvent(QResizeEvent *e)
+{
+    Q_D(ImageWidget);
+    QLabel::resizeEvent(e);
+    // the scaled frames are only valid for one size
+    d->cache.clear();
+    if (d->frameIndex >= 0)
+        showFrame(d->frameIndex);
+    else if (!d->image.isNull())
+        showImage(d->image);
+}
+
+
+static const QRegExp gReAudio("\\.(mp3|m4a|wav|flac)$");
 static const QRegExp gReVideo("\\.(gif)$");
 
 
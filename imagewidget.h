@@ -14,9 +14,11 @@
 #include <QMouseEvent>
 #include <QKeyEvent>
 #include <QScopedPointer>
+#include <QSharedPointer>
 #include <QSizePolicy>
 
 class ImageWidgetPrivate;
+class FrameStore;
 
 class ImageWidget : public QLabel
 {
@@ -28,11 +30,25 @@ public:
     QSize minimumSizeHint(void) const { return QSize(180, 105); }
     QSize sizeHint(void) const { return QSize(320, 240); }
 
+    static const int DefaultCacheBudget = 128 * 1024 * 1024;
+
+    // Frames are fitted into the widget keeping their aspect ratio.
+    // Each distinct frame is scaled only once per widget size and kept
+    // in a cache of limited size, so showing it again is a mere blit.
+    void setFrames(QSharedPointer<const FrameStore> frames);
+    void showFrame(int index);
+    // shows an image that isn't part of the frames, without caching
+    void showImage(const QImage &image);
+    // memory in bytes the scaled frames may take up
+    void setCacheBudget(int bytes);
+
 signals:
     void gifDropped(const QString &fileName);
     void musicDropped(const QString &fileName);
 
 protected:
+    void paintEvent(QPaintEvent*);
+    void resizeEvent(QResizeEvent*);
     void dragEnterEvent(QDragEnterEvent*);
     void dragLeaveEvent(QDragLeaveEvent*);
     void dropEvent(QDropEvent*);
@@ -42,6 +58,7 @@ private slots:
 private: // methods
     void loadImage(const QString &fileName);
     void loadMusic(const QString &fileName);
+    QPixmap scaled(const QImage &image);
 
 private:
     QScopedPointer<ImageWidgetPrivate> d_ptr;
@@ -23,8 +23,34 @@ SOURCES += main.cpp\
     imagewidget.cpp \
     settingsform.cpp \
     consolewidget.cpp \
+    consolemodel.cpp \
     wavewidget.cpp \
     energywidget.cpp \
+    decimator.cpp \
+    pcmdecoder.cpp \
+    wavdecoder.cpp \
+    flacdecoder.cpp \
+    mp3decoder.cpp \
+    frameextractor.cpp \
+    framestore.cpp \
+    framecache.cpp \
+    audiocache.cpp \
+    imageresizer.cpp \
+    framescheduler.cpp \
+    previewpresenter.cpp \
+    segmentencoder.cpp \
+    encoderbackend.cpp \
+    mencoderbackend.cpp \
+    ffmpegbackend.cpp \
+    videoexporter.cpp \
+    multiexporter.cpp \
+    tempoestimator.cpp \
+    renderjob.cpp \
+    batchqueue.cpp \
+    headlessrenderer.cpp \
+    gifdecoder.cpp \
+    yuvconverter.cpp \
+    framestreamer.cpp \
     kiss_fft.c
 
 HEADERS  += mainwindow.h \
@@ -32,8 +58,35 @@ HEADERS  += mainwindow.h \
     main.h \
     settingsform.h \
     consolewidget.h \
+    consolemodel.h \
     wavewidget.h \
     energywidget.h \
+    decimator.h \
+    pcmdecoder.h \
+    wavdecoder.h \
+    flacdecoder.h \
+    mp3decoder.h \
+    frameextractor.h \
+    framestore.h \
+    framecache.h \
+    audiocache.h \
+    imageresizer.h \
+    framescheduler.h \
+    previewpresenter.h \
+    segmentencoder.h \
+    encoderbackend.h \
+    mencoderbackend.h \
+    ffmpegbackend.h \
+    videoexporter.h \
+    multiexporter.h \
+    tempoestimator.h \
+    renderjob.h \
+    batchqueue.h \
+    headlessrenderer.h \
+    gifdecoder.h \
+    yuvconverter.h \
+    framestreamer.h \
+    boundedqueue.h \
     types.h \
     kiss_fft.h \
     _kiss_fft_guts.h \
@@ -2,9 +2,12 @@
 // All rights reserved.
 
 #include "mainwindow.h"
+#include "headlessrenderer.h"
 #include <QApplication>
+#include <QCoreApplication>
 #include <QTranslator>
 #include <QLocale>
+#include <QTimer>
 #include <QtCore/QDebug>
 
 const QString Company = "c't";
@@ -20,26 +23,24 @@ const QString AppVersion = AppVersionNoDebug + " [DEBUG]";
 #endif
 
 
-int main(int argc, char *argv[])
+static void setupApplication(QCoreApplication &a, QTranslator &translator)
 {
-    QApplication a(argc, argv);
     a.setOrganizationName(Company);
     a.setOrganizationDomain(Company);
     a.setApplicationName(AppName);
     a.setApplicationVersion(AppVersionNoDebug);
 
-    qApp->addLibraryPath("plugins");
-    qApp->addLibraryPath("./plugins");
+    a.addLibraryPath("plugins");
+    a.addLibraryPath("./plugins");
 
 #ifdef Q_OS_MAC
-    qApp->addLibraryPath("../plugins");
+    a.addLibraryPath("../plugins");
 #endif
 
 #ifndef QT_NO_DEBUG
-    qDebug() << qApp->libraryPaths();
+    qDebug() << a.libraryPaths();
 #endif
 
-    QTranslator translator;
     QString translationFile = QString(":/translations/lolqt-%1").arg(QLocale::system().name());
     bool ok = translator.load(translationFile);
     if (ok) {
@@ -50,6 +51,27 @@ int main(int argc, char *argv[])
     else {
         qWarning().nospace() << "Warning: Could not load translations for " << QLocale::system().name() << " locale";
     }
+}
+
+
+int main(int argc, char *argv[])
+{
+    QTranslator translator;
+
+    // rendering from the command line needs neither widgets nor a display
+    if (HeadlessRenderer::isHeadless(argc, argv)) {
+        QCoreApplication a(argc, argv);
+        setupApplication(a, translator);
+        HeadlessRenderer renderer;
+        if (!renderer.parseArguments(a.arguments()))
+            return renderer.exitCode();
+        QTimer::singleShot(0, &renderer, SLOT(start()));
+        a.exec();
+        return renderer.exitCode();
+    }
+
+    QApplication a(argc, argv);
+    setupApplication(a, translator);
 
     MainWindow w;
     w.show();
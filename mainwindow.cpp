@@ -2,7 +2,8 @@
 // All rights reserved.
 
 #include <QMessageBox>
-#include <QMovie>
+#include <QProgressBar>
+#include <QPushButton>
 #include <QMediaPlayer>
 #include <QMediaContent>
 #include <QMediaResource>
@@ -11,14 +12,22 @@
 #include <QAudioBuffer>
 #include <QAudioProbe>
 #include <QThread>
+#include <QCoreApplication>
+#include <QDataStream>
 #include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QDir>
 #include <QSettings>
+#include <QStandardPaths>
 #include <QStringList>
+#include <QRegExp>
 #include <QVector>
 #include <QTime>
+#include <QTimer>
+#include <QPixmap>
+#include <QtConcurrent>
+#include <QFutureWatcher>
 #include <QtCore/QDebug>
 
 #include "mainwindow.h"
@@ -27,6 +36,19 @@
 #include "consolewidget.h"
 #include "wavewidget.h"
 #include "energywidget.h"
+#include "decimator.h"
+#include "pcmdecoder.h"
+#include "frameextractor.h"
+#include "gifdecoder.h"
+#include "framestore.h"
+#include "framecache.h"
+#include "audiocache.h"
+#include "imageresizer.h"
+#include "framescheduler.h"
+#include "previewpresenter.h"
+#include "mencoderbackend.h"
+#include "ffmpegbackend.h"
+#include "videoexporter.h"
 
 class MainWindowPrivate
 {
@@ -37,16 +59,22 @@ public:
         , consoleWidget(new ConsoleWidget)
         , waveWidget(new WaveWidget)
         , energyWidget(new EnergyWidget)
-        , process(nullptr)
-        , movie(new QMovie)
+        , frameExtractor(new FrameExtractor)
+        , progressBar(new QProgressBar)
+        , cancelButton(new QPushButton(QObject::tr("Cancel")))
+        , presenter(nullptr)
+        , gifGeneration(0)
+        , saveAfterProbe(false)
         , audio(new QMediaPlayer)
         , audioDecoder(0)
+        , pcmDecoder(nullptr)
         , probe(new QAudioProbe)
         , originalFPS(0)
         , fps(0)
-        , framesNeeded(0)
         , beatCount(0)
         , frameFilenamePattern("%1-%2.png")
+        , speculating(false)
+        , speculativeDone(false)
     {
         beatSamplingTime.start();
         beatInterval.start();
@@ -58,36 +86,118 @@ public:
     ConsoleWidget *consoleWidget;
     WaveWidget *waveWidget;
     EnergyWidget *energyWidget;
-    QProcess *process;
-    QMovie *movie;
+    FrameExtractor *frameExtractor;
+    FrameCache frameCache;
+    // the music encoded for earlier exports
+    AudioCache audioCache;
+    QProgressBar *progressBar;
+    QPushButton *cancelButton;
+    // the frames of the GIF, shared with the encoder
+    QSharedPointer<const FrameStore> frames;
+    // random access to frames for previews while they are extracted
+    GifDecoder gifDecoder;
+    QString gifFilename;
+    // counts the GIFs loaded, tells the frames of one from the next
+    int gifGeneration;
+    // resumes the playback after a preview
+    QTimer previewTimer;
+    PreviewPresenter *presenter;
+    VideoExporter exporter;
+    MEncoderBackend mencoder;
+    FfmpegBackend ffmpeg;
+    // probes the encoders at startup and after their paths have changed
+    QFutureWatcher<void> encoderProbe;
+    // Save has been clicked while the encoder was being probed
+    bool saveAfterProbe;
     QMediaPlayer *audio;
     QAudioDecoder *audioDecoder;
+    PcmDecoder *pcmDecoder;
+    QFutureWatcher<bool> nativeDecodeWatcher;
     QAudioProbe *probe;
     SampleBuffer samples;
+    // mono samples at the analysis sample rate
+    SampleBuffer analysisSamples;
+    Decimator decimator;
     QString audioFilename;
     QString artist;
     QString title;
     QStringList tmpImageFiles;
+    FrameScheduler scheduler;
     qreal originalFPS;
     qreal fps;
-    int framesNeeded;
     QTime beatInterval;
     QTime beatSamplingTime;
     int beatCount;
     // %1 original filename
     // %2 sequence number (4 digits)
     QString frameFilenamePattern;
+    // A speculative export runs at low priority while the user is
+    // still editing. Save adopts it if nothing has changed since.
+    QTimer speculationTimer;
+    bool speculating;
+    bool speculativeDone;
+    // what the speculative video depends on, empty if there is none
+    QByteArray speculativeKey;
+    QString speculativeFile;
+    // where the speculative video goes once Save has adopted it
+    QString adoptedOutputFile;
+
+    // an export the user hasn't asked for (yet)
+    bool isSpeculative(void) const
+    {
+        return speculating && adoptedOutputFile.isEmpty();
+    }
+
+    // the encoder chosen in the settings, nullptr until the path set
+    // there has been probed
+    EncoderBackend *encoder(void)
+    {
+        if (encoderProbe.isRunning())
+            return nullptr;
+        mencoder.setExecutable(settingsForm->getMencoderPath());
+        ffmpeg.setExecutable(settingsForm->getFfmpegPath());
+        EncoderBackend *backend = (settingsForm->getEncoder() == ffmpeg.name())
+                ? static_cast<EncoderBackend*>(&ffmpeg)
+                : static_cast<EncoderBackend*>(&mencoder);
+        return backend->isProbed() ? backend : nullptr;
+    }
 
     ~MainWindowPrivate()
     {
-        delete movie;
+        encoderProbe.waitForFinished();
+        delete frameExtractor;
+        delete presenter;
         delete audio;
         delete audioDecoder;
+        delete pcmDecoder;
         delete probe;
     }
 };
 
 
+static void probeBackends(QList<EncoderBackend*> backends)
+{
+    foreach (EncoderBackend *backend, backends)
+        backend->probe();
+}
+
+
+// what a video depends on apart from the file it's written to
+static QByteArray exportKey(const ExportOptions &o, const EncoderBackend *encoder, int gifGeneration, qreal bpm, int maxFps)
+{
+    QByteArray key;
+    QDataStream stream(&key, QIODevice::WriteOnly);
+    stream << encoder->name() << encoder->executable()
+           << gifGeneration << bpm << maxFps
+           << QFileInfo(o.outputFile).suffix().toLower()
+           << o.audioFile << o.duration << o.audioBitrate
+           << o.outputSize << int(o.resizeFilter) << int(o.preset) << o.extraOptions
+           << o.frameOffset << o.loopExport
+           << o.subtitleText << o.subtitleFont;
+    return key;
+}
+
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
@@ -106,9 +216,30 @@ MainWindow::MainWindow(QWidget *parent)
 
     ui->horizontalLayout2->addWidget(d->waveWidget);
     QObject::connect(d->waveWidget, SIGNAL(analysisCompleted()), SLOT(analysisCompleted()));
+    QObject::connect(&d->nativeDecodeWatcher, SIGNAL(finished()), SLOT(nativeDecodingFinished()));
 
     ui->horizontalLayout2->addWidget(d->energyWidget);
 
+    d->progressBar->setMaximumWidth(160);
+    d->progressBar->hide();
+    d->cancelButton->hide();
+    ui->statusBar->addPermanentWidget(d->progressBar);
+    ui->statusBar->addPermanentWidget(d->cancelButton);
+    QObject::connect(d->cancelButton, SIGNAL(clicked()), SLOT(cancelFrameExtraction()));
+    d->frameCache.setDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/frames");
+    d->frameExtractor->setCache(&d->frameCache);
+    d->audioCache.setDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/audio");
+    d->exporter.setAudioCache(&d->audioCache);
+    // MEncoder can't encode the audio alone
+    d->exporter.setAudioEncoder(&d->ffmpeg);
+    QObject::connect(d->frameExtractor, SIGNAL(progress(int, int)), SLOT(frameExtractionProgress(int, int)));
+    QObject::connect(d->frameExtractor, SIGNAL(checkpoint(QString, int, QImage)), SLOT(frameCheckpoint(QString, int, QImage)));
+    QObject::connect(d->frameExtractor, SIGNAL(finished(bool)), SLOT(frameExtractionFinished(bool)));
+    QObject::connect(&d->exporter, SIGNAL(output(QString)), SLOT(encoderOutput(QString)));
+    QObject::connect(&d->exporter, SIGNAL(progress(int, int)), SLOT(encodingProgress(int, int)));
+    QObject::connect(&d->exporter, SIGNAL(progressReport(ExportProgress)), SLOT(encodingReport(ExportProgress)));
+    QObject::connect(&d->exporter, SIGNAL(finished(bool)), SLOT(exportFinished(bool)));
+
     QObject::connect(ui->actionOpenImage, SIGNAL(triggered()), SLOT(openImage()));
     QObject::connect(ui->actionOpenAudio, SIGNAL(triggered()), SLOT(openAudio()));
     QObject::connect(ui->actionSaveFrames, SIGNAL(triggered()), SLOT(onSaveCancelClicked()));
@@ -130,6 +261,19 @@ MainWindow::MainWindow(QWidget *parent)
     QObject::connect(d->audio, SIGNAL(metaDataAvailableChanged(bool)), SLOT(metaDataAvailableChanged(bool)));
     QObject::connect(d->probe, SIGNAL(audioBufferProbed(QAudioBuffer)), SLOT(audioBufferReady(QAudioBuffer)));
     QObject::connect(ui->bpmSpinBox, SIGNAL(valueChanged(double)), SLOT(bpmChanged(double)));
+    QObject::connect(ui->offsetSpinBox, SIGNAL(valueChanged(int)), SLOT(previewFrame(int)));
+    d->previewTimer.setSingleShot(true);
+    d->previewTimer.setInterval(1500);
+    QObject::connect(&d->previewTimer, SIGNAL(timeout()), SLOT(resumePlayback()));
+    d->speculationTimer.setSingleShot(true);
+    d->speculationTimer.setInterval(3000);
+    QObject::connect(&d->speculationTimer, SIGNAL(timeout()), SLOT(startSpeculativeExport()));
+    QObject::connect(&d->encoderProbe, SIGNAL(finished()), SLOT(encodersProbed()));
+    QObject::connect(ui->bpmSpinBox, SIGNAL(valueChanged(double)), SLOT(parametersChanged()));
+    QObject::connect(ui->offsetSpinBox, SIGNAL(valueChanged(int)), SLOT(parametersChanged()));
+    QObject::connect(d->audio, SIGNAL(durationChanged(qint64)), SLOT(parametersChanged()));
+    QObject::connect(d->audio, SIGNAL(metaDataAvailableChanged(bool)), SLOT(parametersChanged()));
+    d->presenter = new PreviewPresenter(d->audio, &d->scheduler, d->imageWidget);
 
     QObject::connect(d->audio, SIGNAL(volumeChanged(int)), ui->volumeDial, SLOT(setValue(int)));
     QObject::connect(ui->volumeDial, SIGNAL(valueChanged(int)), d->audio, SLOT(setVolume(int)));
@@ -138,6 +282,39 @@ MainWindow::MainWindow(QWidget *parent)
 
     restoreAppSettings();
     disableSave();
+
+    probeEncoders();
+}
+
+
+// running the encoders takes a moment, so it's done in the background
+void MainWindow::probeEncoders(void)
+{
+    Q_D(MainWindow);
+    if (d->encoderProbe.isRunning())
+        return;
+    d->mencoder.setExecutable(d->settingsForm->getMencoderPath());
+    d->ffmpeg.setExecutable(d->settingsForm->getFfmpegPath());
+    d->encoderProbe.setFuture(QtConcurrent::run(probeBackends, QList<EncoderBackend*>() << &d->mencoder << &d->ffmpeg));
+}
+
+
+void MainWindow::encodersProbed(void)
+{
+    Q_D(MainWindow);
+    // the paths may have been changed again in the meantime
+    if (d->encoder() == nullptr) {
+        probeEncoders();
+        return;
+    }
+    if (d->saveAfterProbe) {
+        d->saveAfterProbe = false;
+        ui->statusBar->clearMessage();
+        saveVideo();
+    }
+    else {
+        startSpeculativeExport();
+    }
 }
 
 
@@ -152,8 +329,8 @@ void MainWindow::closeEvent(QCloseEvent *e)
     Q_D(MainWindow);
     if (!processAllowedToBeCanceled())
         return e->ignore();
-    if (d->process != nullptr)
-        deleteProcess();
+    cancelSpeculativeExport();
+    d->frameExtractor->cancel();
     saveAppSettings();
     cancelAudioAnalysis();
     removeTemporaryFiles();
@@ -166,6 +343,7 @@ void MainWindow::closeEvent(QCloseEvent *e)
 void MainWindow::cancelAudioAnalysis(void)
 {
     Q_D(MainWindow);
+    cancelNativeDecoding();
     d->waveWidget->cancel();
     d->energyWidget->cancel();
 }
@@ -196,7 +374,7 @@ void MainWindow::openAudio(void)
                 this,
                 tr("Open audio file"),
                 d->settingsForm->getOpenDirectory(),
-                tr("Audio files (*.mp3 *.m4a)"));
+                tr("Audio files (*.mp3 *.m4a *.wav *.flac)"));
     if (fileName.isEmpty())
         return;
     QFileInfo fi(fileName);
@@ -214,34 +392,13 @@ void MainWindow::saveVideoAs(void)
 }
 
 
-int gcd(int a, int b) {
-    int tmp;
-    while (a != 0) {
-        tmp = a;
-        a = b % a;
-        b = tmp;
-    }
-    return b;
-}
-
-
 void MainWindow::onSaveCancelClicked(void)
 {
     Q_D(MainWindow);
-    if (d->process == nullptr)
-        createProcess();
-    switch(d->process->state()) {
-    case QProcess::NotRunning:
-    {
-        saveVideo();
-        break;
-    }
-    case QProcess::Starting:
-    case QProcess::Running:
-    default:
+    if (d->exporter.isRunning() && !d->isSpeculative())
         cancelEncoding();
-        break;
-    }
+    else if (!d->tmpImageFiles.isEmpty())
+        saveVideo();
 }
 
 
@@ -249,15 +406,33 @@ void MainWindow::cancelEncoding(void)
 {
     Q_D(MainWindow);
     ui->statusBar->showMessage(tr("Encoding canceled."), 3000);
-    d->process->kill();
-    deleteProcess();
+    cancelSpeculativeExport();
+    d->exporter.cancel();
+    d->progressBar->hide();
     enableSave();
+    removeTemporaryFiles();
 }
 
 
 void MainWindow::saveVideo(void)
 {
     Q_D(MainWindow);
+    EncoderBackend *encoder = d->encoder();
+    if (encoder == nullptr) {
+        // Save goes on once the probe has finished
+        d->saveAfterProbe = true;
+        ui->statusBar->showMessage(tr("Checking the encoder ..."));
+        probeEncoders();
+        return;
+    }
+    if (!encoder->isAvailable()) {
+        QMessageBox::warning(this,
+                             tr("Encoder not found"),
+                             tr("%1 could not be run from \"%2\". Please check the path in the settings.")
+                             .arg(encoder->name())
+                             .arg(encoder->executable()));
+        return;
+    }
     QFileInfo fi(d->settingsForm->getOutputFile());
     if (fi.exists()) {
         QMessageBox::StandardButton button;
@@ -269,104 +444,154 @@ void MainWindow::saveVideo(void)
         if (button != QMessageBox::Yes)
             return;
     }
-    bool addMusicInfoAsSubtitle = false;
-    if (d->settingsForm->getSubtitlesEnabled()) {
-        if (!d->artist.isEmpty() && !d->title.isEmpty() && d->audio->duration() > 11 * 1000) {
-            QFile subtitleFile(this->getSubtitleFilename());
-            const QTime &subStartTime = QTime::fromMSecsSinceStartOfDay(d->audio->duration() - 11 * 1000);
-            const QTime &subEndTime = QTime::fromMSecsSinceStartOfDay(d->audio->duration()- 1 * 1000);
-            if (subtitleFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-                subtitleFile.write("1\n");
-                subtitleFile.write(
-                            QString("%1:%2:%3,000 --> %4:%5:%6,000\n")
-                            .arg(subStartTime.hour(), 2, 10, QChar('0'))
-                            .arg(subStartTime.minute(), 2, 10, QChar('0'))
-                            .arg(subStartTime.second(), 2, 10, QChar('0'))
-                            .arg(subEndTime.hour(), 2, 10, QChar('0'))
-                            .arg(subEndTime.minute(), 2, 10, QChar('0'))
-                            .arg(subEndTime.second(), 2, 10, QChar('0'))
-                            .toLocal8Bit());
-                subtitleFile.write(tr("Music: %1 - %2")
-                                   .arg(d->artist)
-                                   .arg(d->title).toLocal8Bit());
-                subtitleFile.close();
-            }
-            addMusicInfoAsSubtitle = true;
+    // the maximum frame rate may have changed in the settings
+    calculateFPS();
+    const ExportOptions &options = exportOptions();
+    if (!d->speculativeKey.isEmpty()
+            && d->speculativeKey == exportKey(options, encoder, d->gifGeneration, ui->bpmSpinBox->value(), d->settingsForm->getMaxFps())) {
+        if (d->speculativeDone) {
+            if (copySpeculativeVideo(options.outputFile))
+                ui->statusBar->showMessage(tr("Written video to \"%1\".").arg(options.outputFile));
+            else
+                ui->statusBar->showMessage(tr("The video could not be written to \"%1\".").arg(options.outputFile), 5000);
+            return;
         }
-    }
-    QFile frameFileList(this->getFrameFileListFilename());
-    if (frameFileList.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        const int N = d->tmpImageFiles.count();
-        const int frameOffset = ui->offsetSpinBox->value();
-        for (int i = 0; i < d->framesNeeded; ++i) {
-            frameFileList.write(d->tmpImageFiles[(i + frameOffset) % N].toLocal8Bit());
-            frameFileList.write("\n");
+        if (d->speculating) {
+            // the encoder started in the background finishes the video
+            d->adoptedOutputFile = options.outputFile;
+            d->consoleWidget->show();
+            ui->statusBar->showMessage(tr("Finishing the video encoded in the background ..."));
+            disableSave();
+            return;
         }
-        frameFileList.close();
     }
-    const QImage &frame = d->movie->currentImage();
-    int aspectDiv = gcd(frame.width(), frame.height());
-    QString cmdLine =
-            QString("\"%1\"")
-            .arg(d->settingsForm->getMencoderPath()) +
-            QString(" mf://@%1 ")
-            .arg(frameFileList.fileName());
-    QString mOpts = d->settingsForm->getMEncoderOptions();
-    mOpts.replace("%1", QString::number(frame.width()));
-    mOpts.replace("%2", QString::number(frame.height()));
-    mOpts.replace("%3", QString::number(d->fps));
-    mOpts.replace("%4", QString::number(frame.width() / aspectDiv));
-    mOpts.replace("%5", QString::number(frame.height() / aspectDiv));
-    mOpts.replace("%6", QString::number(d->settingsForm->getAudioBitrate()));
-    mOpts.replace("%7", QString::number(QThread::idealThreadCount()));
-    cmdLine += mOpts +
-            QString(" -audiofile \"%1\"")
-            .arg(d->audioFilename) +
-            QString(" -o \"%1\"")
-            .arg(d->settingsForm->getOutputFile());
-    if (addMusicInfoAsSubtitle)
-        cmdLine +=
-                QString(" -sub \"%1\"")
-                .arg(this->getSubtitleFilename()) +
-                QString(" -font \"%1\"")
-                .arg(d->settingsForm->getSubtitleFont()) +
-                QString(" -subfont-text-scale 3");
-    disableSave();
+    cancelSpeculativeExport();
+    // frame files of an extraction without writing are written by the
+    // exporter in the background
+    d->exporter.setEncoder(encoder);
+    d->exporter.setFrames(d->frames, d->tmpImageFiles);
+    d->exporter.setScheduler(&d->scheduler);
+    d->exporter.setOptions(options);
     d->consoleWidget->clear();
     d->consoleWidget->show();
-    d->consoleWidget->out(cmdLine);
-    d->process->start(cmdLine);
+    if (!d->exporter.start()) {
+        ui->statusBar->showMessage(d->exporter.errorString(), 5000);
+        return;
+    }
+    disableSave();
 }
 
 
-void MainWindow::createProcess(void)
+ExportOptions MainWindow::exportOptions(void)
 {
     Q_D(MainWindow);
-    d->process = new QProcess;
-    QObject::connect(d->process, SIGNAL(readyReadStandardOutput()), this, SLOT(processOutput()));
-    QObject::connect(d->process, SIGNAL(readyReadStandardError()), this, SLOT(processErrorOutput()));
-    QObject::connect(d->process, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(processFinished(int, QProcess::ExitStatus)));
+    ExportOptions options;
+    options.outputFile = d->settingsForm->getOutputFile();
+    options.tempDirectory = d->settingsForm->getTempDirectory();
+    options.audioFile = d->audioFilename;
+    options.duration = d->audio->duration();
+    options.audioBitrate = d->settingsForm->getAudioBitrate();
+    options.outputSize = d->settingsForm->getOutputSize();
+    options.resizeFilter = d->settingsForm->getResizeFilter();
+    options.preset = d->settingsForm->getEncoderPreset();
+    options.extraOptions = d->settingsForm->getEncoderOptions();
+    options.frameOffset = ui->offsetSpinBox->value();
+    options.streamFrames = d->settingsForm->getStreamFrames();
+    options.loopExport = d->settingsForm->getLoopExport();
+    options.segmentedExport = d->settingsForm->getSegmentedExport();
+    // swapping the music only remuxes the last video
+    options.reuseVideo = true;
+    options.progressLogFile = VideoExporter::defaultProgressLogFile();
+    if (d->settingsForm->getSubtitlesEnabled() && !d->artist.isEmpty() && !d->title.isEmpty()) {
+        options.subtitleText = tr("Music: %1 - %2").arg(d->artist).arg(d->title);
+        options.subtitleFont = d->settingsForm->getSubtitleFont();
+    }
+    return options;
 }
 
 
-void MainWindow::deleteProcess(void)
+void MainWindow::parametersChanged(void)
 {
     Q_D(MainWindow);
-    Q_ASSERT(d->process != nullptr);
-    QObject::disconnect(d->process, SIGNAL(readyReadStandardOutput()), this, SLOT(processOutput()));
-    QObject::disconnect(d->process, SIGNAL(readyReadStandardError()), this, SLOT(processErrorOutput()));
-    QObject::disconnect(d->process, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(processFinished(int, QProcess::ExitStatus)));
-    d->process->waitForFinished();
-    delete d->process;
-    d->process = nullptr;
-    // d->consoleWidget->hide();
+    // an adopted speculative export is what the user has asked for
+    if (!d->adoptedOutputFile.isEmpty())
+        return;
+    cancelSpeculativeExport();
+    if (d->settingsForm->getSpeculativeExport())
+        d->speculationTimer.start();
+}
+
+
+void MainWindow::startSpeculativeExport(void)
+{
+    Q_D(MainWindow);
+    if (!d->settingsForm->getSpeculativeExport() || d->exporter.isRunning() || d->frameExtractor->isRunning())
+        return;
+    if (d->frames.isNull() || d->tmpImageFiles.isEmpty() || d->audioFilename.isEmpty())
+        return;
+    EncoderBackend *encoder = d->encoder();
+    if (encoder == nullptr) {
+        probeEncoders();
+        return;
+    }
+    if (!encoder->isAvailable())
+        return;
+    calculateFPS();
+    ExportOptions options = exportOptions();
+    d->speculativeKey = exportKey(options, encoder, d->gifGeneration, ui->bpmSpinBox->value(), d->settingsForm->getMaxFps());
+    d->speculativeFile = QString("%1/%2-%3-background.%4")
+            .arg(options.tempDirectory)
+            .arg(AppName)
+            .arg(QCoreApplication::applicationPid())
+            .arg(QFileInfo(options.outputFile).suffix());
+    options.outputFile = d->speculativeFile;
+    // one encoder process at the lowest priority, so that the user
+    // doesn't notice
+    options.lowPriority = true;
+    options.segmentedExport = false;
+    d->exporter.setEncoder(encoder);
+    d->exporter.setFrames(d->frames, d->tmpImageFiles);
+    d->exporter.setScheduler(&d->scheduler);
+    d->exporter.setOptions(options);
+    if (!d->exporter.start()) {
+        d->speculativeKey.clear();
+        return;
+    }
+    d->speculating = true;
+    d->speculativeDone = false;
+}
+
+
+void MainWindow::cancelSpeculativeExport(void)
+{
+    Q_D(MainWindow);
+    d->speculationTimer.stop();
+    if (d->speculating) {
+        d->speculating = false;
+        d->exporter.cancel();
+        removeTemporaryFiles();
+    }
+    d->speculativeDone = false;
+    d->speculativeKey.clear();
+    d->adoptedOutputFile.clear();
+    if (!d->speculativeFile.isEmpty())
+        QFile::remove(d->speculativeFile);
+}
+
+
+bool MainWindow::copySpeculativeVideo(const QString &outputFile)
+{
+    Q_D(MainWindow);
+    // copied, so it can be saved again under another name
+    QFile::remove(outputFile);
+    return QFile::copy(d->speculativeFile, outputFile);
 }
 
 
 bool MainWindow::processAllowedToBeCanceled(void)
 {
     Q_D(MainWindow);
-    if (d->process != nullptr && d->process->state() == QProcess::Running) {
+    if (d->exporter.isRunning() && !d->isSpeculative()) {
         QMessageBox::StandardButton button;
         button = QMessageBox::question(
                     this,
@@ -375,7 +600,7 @@ bool MainWindow::processAllowedToBeCanceled(void)
                        " If you quit, the process will be cancelled and the results be lost."
                        " Do you really want to quit?"));
         if (button == QMessageBox::Yes) {
-            d->process->close();
+            d->exporter.cancel();
             return true;
         }
         else {
@@ -386,55 +611,66 @@ bool MainWindow::processAllowedToBeCanceled(void)
 }
 
 
-QString MainWindow::getSubtitleFilename(void) const
-{
-    return d_ptr->settingsForm->getTempDirectory() + "/" + AppName + "-subtitles.srt";
-}
-
-
-QString MainWindow::getFrameFileListFilename(void) const
+void MainWindow::removeTemporaryFiles(void)
 {
-    return d_ptr->settingsForm->getTempDirectory() + "/" + AppName + "-list.txt";
+    Q_D(MainWindow);
+    if (!d->frameExtractor->isCached())
+        foreach (QString tmpImageFile, d->tmpImageFiles)
+            QFile::remove(tmpImageFile);
 }
 
 
-void MainWindow::removeTemporaryFiles(void)
+void MainWindow::encoderOutput(const QString &out)
 {
     Q_D(MainWindow);
-    foreach (QString tmpImageFile, d->tmpImageFiles)
-        QFile::remove(tmpImageFile);
-    QFile::remove(this->getFrameFileListFilename());
-    QFile::remove(this->getSubtitleFilename());
+    d->consoleWidget->out(out);
 }
 
 
-void MainWindow::processOutput(void)
+void MainWindow::encodingProgress(int done, int total)
 {
     Q_D(MainWindow);
-    const QByteArray &buf = d->process->readAllStandardOutput();
-    ui->statusBar->showMessage(buf);
-    d->consoleWidget->out(buf);
+    if (d->isSpeculative())
+        return;
+    d->progressBar->setRange(0, total);
+    d->progressBar->setValue(done);
+    d->progressBar->show();
 }
 
 
-void MainWindow::processErrorOutput(void)
+void MainWindow::encodingReport(const ExportProgress &report)
 {
     Q_D(MainWindow);
-    const QByteArray &buf = d->process->readAllStandardError();
-    d->consoleWidget->out(buf);
+    if (d->isSpeculative())
+        return;
+    ui->statusBar->showMessage(report.toString());
 }
 
 
-void MainWindow::processFinished(int exitCode, QProcess::ExitStatus exitStatus)
+void MainWindow::exportFinished(bool ok)
 {
-    Q_UNUSED(exitCode);
     Q_D(MainWindow);
-    if (exitStatus == QProcess::NormalExit)
-        ui->statusBar->showMessage(tr("Written video to \"%1\".").arg(d->settingsForm->getOutputFile()));
+    QString outputFile = d->exporter.options().outputFile;
+    if (d->speculating) {
+        d->speculating = false;
+        d->speculativeDone = ok;
+        if (d->adoptedOutputFile.isEmpty()) {
+            // kept for the next save
+            removeTemporaryFiles();
+            return;
+        }
+        outputFile = d->adoptedOutputFile;
+        d->adoptedOutputFile.clear();
+        ok = ok && copySpeculativeVideo(outputFile);
+    }
+    d->progressBar->hide();
+    if (ok)
+        ui->statusBar->showMessage(tr("Written video to \"%1\".").arg(outputFile));
+    else if (!d->exporter.errorString().isEmpty())
+        ui->statusBar->showMessage(d->exporter.errorString());
     else
-        ui->statusBar->showMessage(tr("Warning! MEncoder exited unexpectedly. Video may not have been written."));
+        ui->statusBar->showMessage(tr("Warning! The encoder exited unexpectedly. Video may not have been written."));
     enableSave();
-    deleteProcess();
     removeTemporaryFiles();
 }
 
@@ -485,13 +721,13 @@ void MainWindow::consoleClosed(void)
 void MainWindow::calculateFPS(void)
 {
     Q_D(MainWindow);
-    if (d->movie->frameCount() > 0) {
-        qreal bpm = ui->bpmSpinBox->value();
-        d->fps = bpm / 60.0 * d->movie->frameCount();
+    if (!d->frames.isNull() && d->frames->frameCount() > 0) {
+        d->scheduler.setFrameCount(d->frames->frameCount());
+        d->scheduler.setBpm(ui->bpmSpinBox->value());
+        d->scheduler.setMaxFps(d->settingsForm->getMaxFps());
+        d->fps = d->scheduler.fps();
+        d->presenter->refresh();
         ui->fpsDoubleSpinBox->setValue(d->fps);
-        d->movie->setSpeed(qRound(100 / d->originalFPS * d->fps));
-        qreal duration = d->audio->duration() > 0 ? 1e-3 * d->audio->duration() : 1;
-        d->framesNeeded = qRound(d->fps * duration);
     }
 }
 
@@ -511,44 +747,134 @@ void MainWindow::bpmChanged(double)
 void MainWindow::analyzeMovie(const QString &fileName)
 {
     Q_D(MainWindow);
-    d->movie->stop();
-    d->movie->setFileName(fileName);
-    QFileInfo fi(fileName);
-    const int nFrames = d->movie->frameCount();
-    if (d->movie->isValid() && nFrames > 0) {
+    d->frameExtractor->cancel();
+    d->presenter->stop();
+    d->previewTimer.stop();
+    parametersChanged();
+    ++d->gifGeneration;
+    d->frames.clear();
+    d->presenter->setFrames(d->frames);
+    d->imageWidget->setFrames(d->frames);
+    d->tmpImageFiles.clear();
+    disableSave();
+    ui->offsetSpinBox->setEnabled(false);
+    d->gifFilename = fileName;
+    if (d->gifDecoder.open(fileName)) {
+        const int nFrames = d->gifDecoder.frameCount();
+        // frames can be previewed by seeking before the extraction has finished
         ui->offsetSpinBox->setMaximum(nFrames - 1);
         ui->offsetSpinBox->setValue(0);
         ui->offsetSpinBox->setEnabled(true);
-        d->tmpImageFiles.clear();
-        qreal duration = 0;
-        d->movie->jumpToFrame(0);
-        for (int i = 0; i < nFrames; ++i) {
-            const QString &fqSavePath =
-                    d->settingsForm->getTempDirectory() +
-                    "/" +
-                    d->frameFilenamePattern.arg(fi.baseName()).arg(i, 4, 10, QChar('0'));
-            const QImage &frame = d->movie->currentImage();
-            frame.save(fqSavePath);
-            duration += d->movie->nextFrameDelay();
-            d->tmpImageFiles.push_back(fqSavePath);
-            d->movie->jumpToNextFrame();
-        }
-        d->originalFPS = 1e3 * qreal(nFrames) / duration;
-        d->fps = d->originalFPS;
-        ui->statusBar->showMessage(tr("%1 frames, %2 fps, %3 ms")
-                                   .arg(nFrames)
-                                   .arg(d->originalFPS, 0, 'g', 4)
-                                   .arg(int(duration)), 3000);
-        if (!d->audioFilename.isEmpty())
-            enableSave();
-        d->imageWidget->setMovie(d->movie);
-        d->movie->start();
-        calculateFPS();
+        previewFrame(0);
+        d->progressBar->setRange(0, nFrames);
+        d->progressBar->setValue(0);
+        d->progressBar->show();
+        d->cancelButton->show();
+        ui->statusBar->showMessage(tr("Extracting frames ..."));
+        d->frameExtractor->setWriteFiles(!d->settingsForm->getStreamFrames());
+        d->frameCache.setMaxSize(qint64(d->settingsForm->getFrameCacheSize()) * 1024 * 1024);
+        d->frameExtractor->start(fileName,
+                                 d->settingsForm->getTempDirectory(),
+                                 d->frameFilenamePattern);
+    }
+}
+
+
+void MainWindow::frameExtractionProgress(int done, int total)
+{
+    Q_D(MainWindow);
+    d->progressBar->setRange(0, total);
+    d->progressBar->setValue(done);
+}
+
+
+void MainWindow::frameExtractionFinished(bool ok)
+{
+    Q_D(MainWindow);
+    // only the current extraction reports its end, see FrameExtractor
+    d->progressBar->hide();
+    d->cancelButton->hide();
+    if (!ok) {
+        ui->statusBar->showMessage(tr("Extracting frames failed: %1").arg(d->frameExtractor->errorString()), 5000);
+        return;
+    }
+    d->frames = d->frameExtractor->frameStore();
+    const int nFrames = d->frames->frameCount();
+    const qreal duration = d->frames->totalDuration();
+    d->tmpImageFiles = d->frameExtractor->fileNames();
+    d->originalFPS = 1e3 * qreal(nFrames) / duration;
+    d->fps = d->originalFPS;
+    ui->statusBar->showMessage(tr("%1 frames (%2 distinct, %3 KB), %4 fps, %5 ms")
+                               .arg(nFrames)
+                               .arg(d->frames->uniqueFrameCount())
+                               .arg(d->frames->memoryUsage() / 1024)
+                               .arg(d->originalFPS, 0, 'g', 4)
+                               .arg(int(duration)), 3000);
+    if (!d->audioFilename.isEmpty())
+        enableSave();
+    d->presenter->setFrames(d->frames);
+    d->imageWidget->setFrames(d->frames);
+    calculateFPS();
+    parametersChanged();
+    if (!d->previewTimer.isActive())
+        resumePlayback();
+}
+
+
+void MainWindow::previewFrame(int frame)
+{
+    Q_D(MainWindow);
+    if (!ui->offsetSpinBox->isEnabled())
+        return;
+    // the decoded frames if they are complete, else seek in the GIF
+    if (!d->frames.isNull()) {
+        d->presenter->stop();
+        d->imageWidget->showFrame(frame);
     }
     else {
-        disableSave();
-        ui->offsetSpinBox->setEnabled(false);
+        // far ahead of the checkpoints the extractor has sent so far
+        // the frame would have to be decoded on this thread
+        if (d->frameExtractor->isRunning() && !d->gifDecoder.isSeekable(frame))
+            return;
+        const QImage &image = d->gifDecoder.frame(frame);
+        if (image.isNull())
+            return;
+        d->presenter->stop();
+        d->imageWidget->showImage(image);
     }
+    d->previewTimer.start();
+}
+
+
+void MainWindow::frameCheckpoint(const QString &fileName, int frameNumber, const QImage &canvas)
+{
+    Q_D(MainWindow);
+    // may still be queued from the GIF opened before
+    if (fileName == d->gifFilename)
+        d->gifDecoder.addCheckpoint(frameNumber, canvas);
+}
+
+
+void MainWindow::resumePlayback(void)
+{
+    Q_D(MainWindow);
+    if (d->frames.isNull())
+        return;
+    d->presenter->setOffset(ui->offsetSpinBox->value());
+    d->presenter->start();
+}
+
+
+void MainWindow::cancelFrameExtraction(void)
+{
+    Q_D(MainWindow);
+    d->frameExtractor->cancel();
+    if (!d->frameExtractor->isCached())
+        foreach (QString frameFile, d->frameExtractor->fileNames())
+            QFile::remove(frameFile);
+    d->progressBar->hide();
+    d->cancelButton->hide();
+    ui->statusBar->showMessage(tr("Frame extraction canceled."), 3000);
 }
 
 
@@ -558,30 +884,54 @@ void MainWindow::analyzeAudio(const QString &fileName)
 
     cancelAudioAnalysis();
     d->audioFilename = fileName;
+    parametersChanged();
 
     if (d->audioDecoder) {
         QObject::disconnect(d->audioDecoder, SIGNAL(bufferReady()));
         QObject::disconnect(d->audioDecoder, SIGNAL(finished()));
         delete d->audioDecoder;
+        d->audioDecoder = nullptr;
     }
-    d->audioDecoder = new QAudioDecoder;
-    QObject::connect(d->audioDecoder, SIGNAL(bufferReady()), SLOT(readAudioBuffer()));
-    QObject::connect(d->audioDecoder, SIGNAL(finished()), SLOT(finishedAudioBuffer()));
 
     d->samples.clear();
-
-    d->audioDecoder->setSourceFilename(fileName);
-    d->audioDecoder->start();
+    d->analysisSamples.clear();
+    d->decimator.reset();
+
+    d->pcmDecoder = PcmDecoder::create(fileName);
+    if (d->pcmDecoder != nullptr && d->pcmDecoder->open(fileName)) {
+        ui->statusBar->showMessage(tr("Decoding audio ..."));
+        // the settings widget must not be read from the worker thread
+        d->nativeDecodeWatcher.setFuture(QtConcurrent::run(this, &MainWindow::decodeNative, d->settingsForm->getAnalysisSampleRate()));
+    }
+    else {
+        if (d->pcmDecoder != nullptr) {
+            qWarning() << "MainWindow::analyzeAudio():" << d->pcmDecoder->errorString();
+            delete d->pcmDecoder;
+            d->pcmDecoder = nullptr;
+        }
+        startAudioDecoder(fileName);
+    }
 
     d->audio->setMedia(QUrl::fromLocalFile(fileName));
     d->audio->play();
 
     ui->volumeDial->setEnabled(true);
-    if (d->movie->isValid() && d->movie->frameCount() > 0)
+    if (!d->tmpImageFiles.isEmpty())
         enableSave();
 }
 
 
+void MainWindow::startAudioDecoder(const QString &fileName)
+{
+    Q_D(MainWindow);
+    d->audioDecoder = new QAudioDecoder;
+    QObject::connect(d->audioDecoder, SIGNAL(bufferReady()), SLOT(readAudioBuffer()));
+    QObject::connect(d->audioDecoder, SIGNAL(finished()), SLOT(finishedAudioBuffer()));
+    d->audioDecoder->setSourceFilename(fileName);
+    d->audioDecoder->start();
+}
+
+
 void MainWindow::readAudioBuffer(void)
 {
     Q_D(MainWindow);
@@ -589,8 +939,13 @@ void MainWindow::readAudioBuffer(void)
     if (!buf.isValid())
         return;
     if (buf.format().sampleSize() == 8 * sizeof(SampleBufferType)) {
+        const SampleBufferType *data = buf.constData<SampleBufferType>();
         for (int i = 0; i < buf.sampleCount(); ++i)
-            d->samples.append(buf.constData<SampleBufferType>()[i]);
+            d->samples.append(data[i]);
+        d->decimator.setFormat(buf.format().sampleRate(),
+                               buf.format().channelCount(),
+                               d->settingsForm->getAnalysisSampleRate());
+        d->decimator.process(data, buf.frameCount(), d->analysisSamples);
         ui->statusBar->showMessage(tr("Decoding audio ... %1%")
                                    .arg(100LL * buf.startTime() / d->audioDecoder->duration()));
     }
@@ -601,9 +956,72 @@ void MainWindow::finishedAudioBuffer(void)
 {
     Q_D(MainWindow);
     d->samples.squeeze();
+    d->decimator.flush(d->analysisSamples);
+    audioDecoded();
+}
+
+
+bool MainWindow::decodeNative(int analysisSampleRate)
+{
+    Q_D(MainWindow);
+    PcmDecoder *decoder = d->pcmDecoder;
+    if (!decoder->decode(d->samples))
+        return false;
+    // analyze the mapped file in place if the decoder provides the samples without decoding
+    const SampleBufferType *data = decoder->constData();
+    if (data == nullptr)
+        data = d->samples.constData();
+    d->decimator.setFormat(decoder->sampleRate(),
+                           decoder->channelCount(),
+                           analysisSampleRate);
+    d->decimator.process(data, int(decoder->frameCount()), d->analysisSamples);
+    d->decimator.flush(d->analysisSamples);
+    return !decoder->isCanceled();
+}
+
+
+void MainWindow::cancelNativeDecoding(void)
+{
+    Q_D(MainWindow);
+    if (d->pcmDecoder == nullptr)
+        return;
+    d->pcmDecoder->cancel();
+    d->nativeDecodeWatcher.waitForFinished();
+    delete d->pcmDecoder;
+    d->pcmDecoder = nullptr;
+}
+
+
+void MainWindow::nativeDecodingFinished(void)
+{
+    Q_D(MainWindow);
+    if (d->pcmDecoder == nullptr || d->pcmDecoder->isCanceled())
+        return;
+    const bool ok = d->nativeDecodeWatcher.result();
+    if (!ok)
+        qWarning() << "MainWindow::nativeDecodingFinished():" << d->pcmDecoder->errorString();
+    delete d->pcmDecoder;
+    d->pcmDecoder = nullptr;
+    if (ok) {
+        audioDecoded();
+    }
+    else {
+        // retry the slow but sure way
+        d->samples.clear();
+        d->analysisSamples.clear();
+        d->decimator.reset();
+        startAudioDecoder(d->audioFilename);
+    }
+}
+
+
+void MainWindow::audioDecoded(void)
+{
+    Q_D(MainWindow);
+    d->analysisSamples.squeeze();
     ui->statusBar->showMessage(tr("Analyzing audio ..."));
     d->waveWidget->setSamples(d->samples, d->audio->duration());
-    d->energyWidget->setSamples(d->samples);
+    d->energyWidget->setSamples(d->analysisSamples);
 }
 
 
@@ -652,9 +1070,21 @@ void MainWindow::saveAppSettings(void)
     settings.setValue("Settings/openDir", d->settingsForm->getOpenDirectory());
     settings.setValue("Settings/tmpDir", d->settingsForm->getTempDirectory());
     settings.setValue("Settings/mencoderPath", d->settingsForm->getMencoderPath());
+    settings.setValue("Settings/ffmpegPath", d->settingsForm->getFfmpegPath());
+    settings.setValue("Settings/encoder", d->settingsForm->getEncoder());
+    settings.setValue("Settings/encoderPreset", int(d->settingsForm->getEncoderPreset()));
     settings.setValue("Settings/audioBitrate", d->settingsForm->getAudioBitrate());
-    settings.setValue("Settings/mencoderOptions", d->settingsForm->getMEncoderOptions());
+    settings.setValue("Settings/analysisSampleRate", d->settingsForm->getAnalysisSampleRate());
+    settings.setValue("Settings/encoderOptions", d->settingsForm->getEncoderOptions());
     settings.setValue("Settings/subtitleFont", d->settingsForm->getSubtitleFont());
+    settings.setValue("Settings/streamFrames", d->settingsForm->getStreamFrames());
+    settings.setValue("Settings/loopExport", d->settingsForm->getLoopExport());
+    settings.setValue("Settings/frameCacheSize", d->settingsForm->getFrameCacheSize());
+    settings.setValue("Settings/outputSize", d->settingsForm->getOutputSize());
+    settings.setValue("Settings/resizeFilter", int(d->settingsForm->getResizeFilter()));
+    settings.setValue("Settings/maxFps", d->settingsForm->getMaxFps());
+    settings.setValue("Settings/segmentedExport", d->settingsForm->getSegmentedExport());
+    settings.setValue("Settings/speculativeExport", d->settingsForm->getSpeculativeExport());
     settings.setValue("Settings/volume", d->audio->volume());
     settings.setValue("Settings/frameOffset", ui->offsetSpinBox->value());
     settings.setValue("Console/geometry", d->consoleWidget->saveGeometry());
@@ -672,9 +1102,21 @@ void MainWindow::restoreAppSettings(void)
     d->settingsForm->setOpenDirectory(settings.value("Settings/openDir", d->settingsForm->getOpenDirectory()).toString());
     d->settingsForm->setTempDirectory(settings.value("Settings/tmpDir", d->settingsForm->getTempDirectory()).toString());
     d->settingsForm->setMencoderPath(settings.value("Settings/mencoderPath", d->settingsForm->getMencoderPath()).toString());
-    d->settingsForm->setMEncoderOptions(settings.value("Settings/mencoderOptions", d->settingsForm->getMEncoderOptions()).toString());
+    d->settingsForm->setFfmpegPath(settings.value("Settings/ffmpegPath", d->settingsForm->getFfmpegPath()).toString());
+    d->settingsForm->setEncoder(settings.value("Settings/encoder", d->settingsForm->getEncoder()).toString());
+    d->settingsForm->setEncoderPreset(EncoderBackend::Preset(settings.value("Settings/encoderPreset", int(d->settingsForm->getEncoderPreset())).toInt()));
+    d->settingsForm->setEncoderOptions(settings.value("Settings/encoderOptions", d->settingsForm->getEncoderOptions()).toStringList());
     d->settingsForm->setSubtitleFont(settings.value("Settings/subtitleFont", d->settingsForm->getSubtitleFont()).toString());
+    d->settingsForm->setStreamFrames(settings.value("Settings/streamFrames", d->settingsForm->getStreamFrames()).toBool());
+    d->settingsForm->setLoopExport(settings.value("Settings/loopExport", d->settingsForm->getLoopExport()).toBool());
+    d->settingsForm->setFrameCacheSize(settings.value("Settings/frameCacheSize", d->settingsForm->getFrameCacheSize()).toInt());
+    d->settingsForm->setOutputSize(settings.value("Settings/outputSize", d->settingsForm->getOutputSize()).toSize());
+    d->settingsForm->setResizeFilter(ImageResizer::Filter(settings.value("Settings/resizeFilter", int(d->settingsForm->getResizeFilter())).toInt()));
+    d->settingsForm->setMaxFps(settings.value("Settings/maxFps", d->settingsForm->getMaxFps()).toInt());
+    d->settingsForm->setSegmentedExport(settings.value("Settings/segmentedExport", d->settingsForm->getSegmentedExport()).toBool());
+    d->settingsForm->setSpeculativeExport(settings.value("Settings/speculativeExport", d->settingsForm->getSpeculativeExport()).toBool());
     d->settingsForm->setAudioBitrate(settings.value("Settings/audioBitrate", d->settingsForm->getAudioBitrate()).toInt());
+    d->settingsForm->setAnalysisSampleRate(settings.value("Settings/analysisSampleRate", d->settingsForm->getAnalysisSampleRate()).toInt());
     d->audio->setVolume(settings.value("Settings/volume", 50).toInt());
     ui->offsetSpinBox->setValue(settings.value("Settings/frameOffset", 0).toInt());
 }
@@ -5,11 +5,11 @@
 #define __MAINWINDOW_H_
 
 #include <QMainWindow>
-#include <QProcess>
 #include <QScopedPointer>
 #include <QAudioBuffer>
 #include <QAudioDecoder>
 #include "imagewidget.h"
+#include "videoexporter.h"
 #include "main.h"
 
 namespace Ui {
@@ -37,12 +37,19 @@ private slots:
     void onSaveCancelClicked(void);
     void about(void);
     void analyzeMovie(const QString &fileName);
+    void frameExtractionProgress(int, int);
+    void frameExtractionFinished(bool);
+    void cancelFrameExtraction(void);
+    void previewFrame(int);
+    void frameCheckpoint(const QString &fileName, int frameNumber, const QImage &canvas);
+    void resumePlayback(void);
     void analyzeAudio(const QString &fileName);
     void durationChanged(qint64);
     void bpmChanged(double);
-    void processOutput(void);
-    void processErrorOutput(void);
-    void processFinished(int, QProcess::ExitStatus);
+    void encoderOutput(const QString&);
+    void encodingProgress(int, int);
+    void encodingReport(const ExportProgress&);
+    void exportFinished(bool);
     void audioBufferReady(const QAudioBuffer&);
     void metaDataAvailableChanged(bool);
     void setVolume(void);
@@ -50,23 +57,31 @@ private slots:
     void consoleClosed(void);
     void readAudioBuffer(void);
     void finishedAudioBuffer(void);
+    void nativeDecodingFinished(void);
     void countBeat(void);
     void analysisCompleted(void);
+    void parametersChanged(void);
+    void startSpeculativeExport(void);
+    void encodersProbed(void);
 
 private: // methods
+    void probeEncoders(void);
     void cancelEncoding(void);
     void saveVideo(void);
+    ExportOptions exportOptions(void);
+    void cancelSpeculativeExport(void);
+    bool copySpeculativeVideo(const QString &outputFile);
     void saveAppSettings(void);
     void restoreAppSettings(void);
-    void createProcess(void);
-    void deleteProcess(void);
     bool processAllowedToBeCanceled(void);
     void enableSave(void);
     void disableSave(void);
     void calculateFPS(void);
     void cancelAudioAnalysis(void);
-    QString getSubtitleFilename(void) const;
-    QString getFrameFileListFilename(void) const;
+    bool decodeNative(int analysisSampleRate);
+    void cancelNativeDecoding(void);
+    void audioDecoded(void);
+    void startAudioDecoder(const QString &fileName);
     void removeTemporaryFiles(void);
 
 private: // variables
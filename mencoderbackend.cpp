@@ -0,0 +1,173 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QFileInfo>
+#include <QRegExp>
+#include <QtCore/QDebug>
+
+#include "mencoderbackend.h"
+
+// x264 presets and constant rate factors per quality preset
+static const char *X264Presets[] = { "ultrafast", "veryfast", "medium", "veryslow:tune=film:frameref=15:fast_pskip=0" };
+static const int X264Crf[] = { 23, 21, 19, 15 };
+// see https://wiki.archlinux.org/index.php/MEncoder
+static const char *LavcPresets[] = { "mbd=0", "mbd=1", "mbd=2:trell", "mbd=2:trell:v4mv:mv0:dia=2" };
+// repeated frames dropped in a row at most
+static const int MaxDecimatedFrames = 1000;
+
+
+static int gcd(int a, int b)
+{
+    while (b != 0) {
+        const int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+
+MEncoderBackend::MEncoderBackend(void)
+{
+    // ...
+}
+
+
+QString MEncoderBackend::name(void) const
+{
+    return "MEncoder";
+}
+
+
+bool MEncoderBackend::probeExecutable(QStringList *encoders, bool *threads) const
+{
+    // both lists look like "   x264     - H.264 encoding"
+    static const QRegExp codecLine("^\\s+(\\w+)\\s+-\\s");
+    const QByteArray &output = run(QStringList() << "-ovc" << "help") + run(QStringList() << "-oac" << "help");
+    if (!output.contains("Available codecs"))
+        return false;
+    foreach (QString line, QString::fromLocal8Bit(output).split('\n')) {
+        QRegExp re(codecLine);
+        if (re.indexIn(line) == 0)
+            encoders->append(re.cap(1));
+    }
+    // both encoders accept a threads option
+    *threads = encoders->contains("x264") || encoders->contains("lavc");
+    return true;
+}
+
+
+QByteArray MEncoderBackend::frameList(const QStringList &frameFiles, qreal) const
+{
+    QByteArray list;
+    foreach (QString frameFile, frameFiles)
+        list.append(frameFile.toLocal8Bit()).append('\n');
+    return list;
+}
+
+
+QStringList MEncoderBackend::muxArguments(const EncoderParams &params) const
+{
+    QStringList args;
+    if (QFileInfo(params.outputFile).suffix().toLower() == "avi")
+        args << "-of" << "avi";
+    else
+        args << "-of" << "lavf";
+    if (params.frames > 0)
+        args << "-frames" << QString::number(params.frames);
+    if (params.audioFile.isEmpty()) {
+        args << "-nosound";
+    }
+    else {
+        args << "-audiofile" << params.audioFile;
+        if (!audioFormat(params).isEmpty())
+            args << "-oac" << "mp3lame" << "-lameopts" << QString("cbr:br=%1").arg(params.audioBitrate);
+        else
+            args << "-oac" << "copy";
+    }
+    if (!params.subtitleFile.isEmpty()) {
+        args << "-sub" << params.subtitleFile
+             << "-font" << params.subtitleFont
+             << "-subfont-text-scale" << "3";
+        if (params.subtitleDelay != 0)
+            args << "-subdelay" << QString::number(params.subtitleDelay);
+    }
+    return args;
+}
+
+
+EncoderCommand MEncoderBackend::encodeCommand(const EncoderParams &params) const
+{
+    QStringList args;
+    if (params.frameListFile.isEmpty()) {
+        args << "-" << "-demuxer" << "y4m";
+    }
+    else {
+        args << QString("mf://@%1").arg(params.frameListFile)
+             << "-mf" << QString("w=%1:h=%2:fps=%3:type=png")
+                .arg(params.size.width())
+                .arg(params.size.height())
+                .arg(params.fps);
+    }
+    // Repeated frames are dropped and written as zero length frames,
+    // which keeps the frame rate constant. Only AVI has those.
+    if (QFileInfo(params.outputFile).suffix().toLower() == "avi")
+        args << "-vf" << QString("decimate=%1:0:0:0").arg(MaxDecimatedFrames);
+    const int threads = supportsThreads() ? params.threads : 1;
+    if (params.codec == H264 && hasEncoder("x264")) {
+        args << "-ovc" << "x264"
+             << "-x264encopts" << QString("preset=%1:crf=%2:threads=%3")
+                .arg(X264Presets[params.preset])
+                .arg(X264Crf[params.preset])
+                .arg(threads)
+             << "-ofps" << QString::number(params.fps);
+    }
+    else {
+        const int aspectDiv = gcd(params.size.width(), params.size.height());
+        args << "-ovc" << "lavc"
+             << "-lavcopts" << QString("vcodec=mpeg4:%1:aspect=%2/%3:threads=%4")
+                .arg(LavcPresets[params.preset])
+                .arg(params.size.width() / aspectDiv)
+                .arg(params.size.height() / aspectDiv)
+                .arg(threads);
+    }
+    args << muxArguments(params) << params.extraOptions << "-o" << params.outputFile;
+    return EncoderCommand(executable(), args);
+}
+
+
+EncoderCommand MEncoderBackend::concatCommand(const QStringList &inputFiles, const QString &, const EncoderParams &params) const
+{
+    QStringList args;
+    // the extra options are meant for the encoding pass
+    args << inputFiles << "-ovc" << "copy" << muxArguments(params) << "-o" << params.outputFile;
+    return EncoderCommand(executable(), args);
+}
+
+
+QString MEncoderBackend::audioFormat(const EncoderParams &params) const
+{
+    return !params.audioEncoded && hasEncoder("mp3lame") ? "mp3" : QString();
+}
+
+
+EncoderCommand MEncoderBackend::audioCommand(const EncoderParams &, const QString &) const
+{
+    // MEncoder refuses to run without a video stream
+    return EncoderCommand();
+}
+
+
+EncoderBackend::LineType MEncoderBackend::parseLine(const QString &line, EncoderProgress *progress) const
+{
+    // e.g. "Pos:   4.0s    100f (12%) 48.31fps Trem:   0min   1mb  A-V:0.000 [1843:0]",
+    // the bracket holds the video and audio bitrates in kbit/s
+    QRegExp re("Pos:\\s*([-\\d.]+)s\\s+(\\d+)f\\s*\\(\\s*\\d+%\\)\\s*([\\d.]+)fps(?:.*\\[(\\d+):\\d+\\])?");
+    if (re.indexIn(line) < 0)
+        return OutputLine;
+    progress->time = qMax(0.0, re.cap(1).toDouble());
+    progress->frames = re.cap(2).toInt();
+    progress->fps = re.cap(3).toDouble();
+    progress->bitrate = re.cap(4).toDouble();
+    return ProgressEndLine;
+}
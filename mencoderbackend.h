@@ -0,0 +1,32 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __MENCODERBACKEND_H_
+#define __MENCODERBACKEND_H_
+
+#include "encoderbackend.h"
+
+// Drives MEncoder. H.264 is encoded with x264 if MEncoder has been
+// built with it, MPEG-4 with libavcodec otherwise. Frame lists are
+// read through the mf:// demuxer.
+class MEncoderBackend : public EncoderBackend
+{
+public:
+    MEncoderBackend(void);
+
+    QString name(void) const;
+    QByteArray frameList(const QStringList &frameFiles, qreal fps) const;
+    EncoderCommand encodeCommand(const EncoderParams &params) const;
+    EncoderCommand concatCommand(const QStringList &inputFiles, const QString &listFile, const EncoderParams &params) const;
+    QString audioFormat(const EncoderParams &params) const;
+    EncoderCommand audioCommand(const EncoderParams &params, const QString &format) const;
+    LineType parseLine(const QString &line, EncoderProgress *progress) const;
+
+protected:
+    bool probeExecutable(QStringList *encoders, bool *threads) const;
+
+private: // methods
+    QStringList muxArguments(const EncoderParams &params) const;
+};
+
+#endif // __MENCODERBACKEND_H_
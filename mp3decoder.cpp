@@ -0,0 +1,421 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtCore/QDebug>
+#include <string.h>
+
+#include "mp3decoder.h"
+
+
+struct Mp3FrameHeader {
+    int length;
+    int sampleRate;
+    int channels;
+    int samplesPerFrame;
+    int sideInfoSize;
+    bool mpeg1;
+    bool crc;
+};
+
+
+struct Mp3Segment {
+    Mp3Segment(void)
+        : data(nullptr)
+        , size(0)
+        , firstFrame(0)
+        , frames(0)
+        , canceled(nullptr)
+        , ok(false)
+    { /* ... */ }
+    const uchar *data;
+    qint64 size;
+    int firstFrame;
+    // number of frames that belong to this segment, not counting the preroll
+    int frames;
+    QAudioFormat format;
+    SampleBuffer samples;
+    const volatile bool *canceled;
+    bool ok;
+};
+
+
+static bool parseHeader(const uchar *p, Mp3FrameHeader &h)
+{
+    static const int Bitrates[2][3][16] = {
+        { // MPEG 1, layer I, II, III
+          { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+          { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+          { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 }
+        },
+        { // MPEG 2 and 2.5, layer I, II, III
+          { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+          { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+          { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 }
+        }
+    };
+    static const int SampleRates[3] = { 44100, 48000, 32000 };
+    if (p[0] != 0xff || (p[1] & 0xe0) != 0xe0)
+        return false;
+    // 0: MPEG 2.5, 1: reserved, 2: MPEG 2, 3: MPEG 1
+    const int version = (p[1] >> 3) & 3;
+    const int layer = 4 - ((p[1] >> 1) & 3);
+    const int bitrateIndex = p[2] >> 4;
+    const int sampleRateIndex = (p[2] >> 2) & 3;
+    // free format bitstreams aren't supported
+    if (version == 1 || layer == 4 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3)
+        return false;
+    h.mpeg1 = (version == 3);
+    h.crc = (p[1] & 1) == 0;
+    h.channels = ((p[3] >> 6) == 3) ? 1 : 2;
+    h.sampleRate = SampleRates[sampleRateIndex] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+    const int bitrate = 1000 * Bitrates[h.mpeg1 ? 0 : 1][layer - 1][bitrateIndex];
+    const int padding = (p[2] >> 1) & 1;
+    switch (layer) {
+    case 1:
+        h.samplesPerFrame = 384;
+        h.length = (12 * bitrate / h.sampleRate + padding) * 4;
+        break;
+    case 2:
+        h.samplesPerFrame = 1152;
+        h.length = 144 * bitrate / h.sampleRate + padding;
+        break;
+    default:
+        h.samplesPerFrame = h.mpeg1 ? 1152 : 576;
+        h.length = (h.mpeg1 ? 144 : 72) * bitrate / h.sampleRate + padding;
+        break;
+    }
+    if (h.mpeg1)
+        h.sideInfoSize = (h.channels == 1) ? 17 : 32;
+    else
+        h.sideInfoSize = (h.channels == 1) ? 9 : 17;
+    return true;
+}
+
+
+static inline bool sameStream(const Mp3FrameHeader &a, const Mp3FrameHeader &b)
+{
+    return a.sampleRate == b.sampleRate && a.samplesPerFrame == b.samplesPerFrame && a.mpeg1 == b.mpeg1;
+}
+
+
+static void decodeSegment(Mp3Segment &segment)
+{
+    QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char*>(segment.data), int(segment.size));
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    Mp3SegmentDecoder decoder(segment.format, segment.samples, segment.canceled);
+    segment.ok = decoder.run(&buffer);
+}
+
+
+Mp3Decoder::Mp3Decoder(void)
+    : mMap(nullptr)
+    , mSize(0)
+    , mSamplesPerFrame(0)
+    , mEncoderDelay(0)
+    , mEncoderPadding(0)
+{
+    // ...
+}
+
+
+Mp3Decoder::~Mp3Decoder()
+{
+    if (mMap != nullptr)
+        mFile.unmap(const_cast<uchar*>(mMap));
+}
+
+
+bool Mp3Decoder::open(const QString &fileName)
+{
+    mFile.setFileName(fileName);
+    if (!mFile.open(QIODevice::ReadOnly)) {
+        mErrorString = mFile.errorString();
+        return false;
+    }
+    mSize = mFile.size();
+    mMap = mFile.map(0, mSize);
+    if (mMap == nullptr) {
+        mErrorString = mFile.errorString();
+        return false;
+    }
+    qint64 pos = 0;
+    if (mSize > 10 && memcmp(mMap, "ID3", 3) == 0) {
+        const qint64 tagSize = (mMap[6] << 21) | (mMap[7] << 14) | (mMap[8] << 7) | mMap[9];
+        pos = 10 + tagSize + ((mMap[5] & 0x10) ? 10 : 0);
+    }
+    if (!scanFrames(pos)) {
+        mErrorString = QObject::tr("No MPEG audio frames found");
+        return false;
+    }
+    return true;
+}
+
+
+bool Mp3Decoder::scanFrames(qint64 pos)
+{
+    mFrameOffsets.clear();
+    Mp3FrameHeader first;
+    Mp3FrameHeader h;
+    Mp3FrameHeader next;
+    bool synced = false;
+    while (pos + 4 <= mSize) {
+        // a header only counts if the following frame starts with a matching header, too
+        if (!parseHeader(mMap + pos, h) || pos + h.length + 4 > mSize ||
+                !parseHeader(mMap + pos + h.length, next) || !sameStream(h, next) ||
+                (synced && !sameStream(h, first))) {
+            // accept a frame without valid successor, e.g. the last one before a trailing tag
+            if (synced && parseHeader(mMap + pos, h) && sameStream(h, first) && pos + h.length <= mSize) {
+                mFrameOffsets.append(pos);
+                pos += h.length;
+                continue;
+            }
+            ++pos;
+            continue;
+        }
+        if (!synced) {
+            first = h;
+            synced = true;
+            mSampleRate = h.sampleRate;
+            mChannels = h.channels;
+            mSamplesPerFrame = h.samplesPerFrame;
+            // a Xing/Info or VBRI frame carries no audio
+            const uchar *tag = mMap + pos + 4 + (h.crc ? 2 : 0) + h.sideInfoSize;
+            const int tagSpace = int(mMap + pos + h.length - tag);
+            if (tagSpace >= 8 && (memcmp(tag, "Xing", 4) == 0 || memcmp(tag, "Info", 4) == 0)) {
+                parseInfoFrame(tag, tagSpace);
+                pos += h.length;
+                continue;
+            }
+            if (h.length >= 40 && memcmp(mMap + pos + 36, "VBRI", 4) == 0) {
+                pos += h.length;
+                continue;
+            }
+        }
+        mFrameOffsets.append(pos);
+        pos += h.length;
+    }
+    if (mFrameOffsets.isEmpty())
+        return false;
+    mFrameOffsets.append(pos);
+    mFrameCount = qint64(mFrameOffsets.size() - 1) * mSamplesPerFrame;
+    return true;
+}
+
+
+void Mp3Decoder::parseInfoFrame(const uchar *tag, int length)
+{
+    const quint32 flags = (tag[4] << 24) | (tag[5] << 16) | (tag[6] << 8) | tag[7];
+    int lame = 8;
+    if (flags & 0x1) // frame count
+        lame += 4;
+    if (flags & 0x2) // byte count
+        lame += 4;
+    if (flags & 0x4) // seek table
+        lame += 100;
+    if (flags & 0x8) // quality
+        lame += 4;
+    // the LAME extension stores encoder delay and padding as two 12 bit values
+    if (lame + 24 <= length) {
+        const uchar *p = tag + lame + 21;
+        mEncoderDelay = (p[0] << 4) | (p[1] >> 4);
+        mEncoderPadding = ((p[1] & 0x0f) << 8) | p[2];
+    }
+}
+
+
+int Mp3Decoder::overlapFrames(int firstFrame) const
+{
+    // the bit reservoir reaches back at most 511 bytes; two more
+    // frames settle the MDCT overlap and the synthesis filterbank
+    static const qint64 MaxReservoir = 511;
+    int frame = firstFrame;
+    while (frame > 0 && mFrameOffsets[firstFrame] - mFrameOffsets[frame] < MaxReservoir)
+        --frame;
+    return qMin(firstFrame, firstFrame - frame + 2);
+}
+
+
+QAudioFormat Mp3Decoder::pcmFormat(void) const
+{
+    QAudioFormat format;
+    format.setCodec("audio/pcm");
+    format.setSampleRate(mSampleRate);
+    format.setChannelCount(mChannels);
+    format.setSampleSize(8 * sizeof(SampleBufferType));
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    return format;
+}
+
+
+void Mp3Decoder::setupSegment(Mp3Segment &segment, qint64 begin, int firstFrame, int lastFrame)
+{
+    segment.data = mMap + begin;
+    segment.size = mFrameOffsets[lastFrame] - begin;
+    segment.firstFrame = firstFrame;
+    segment.frames = lastFrame - firstFrame;
+    segment.format = pcmFormat();
+    segment.canceled = &mCanceled;
+}
+
+
+bool Mp3Decoder::decode(SampleBuffer &samples)
+{
+    const int nFrames = mFrameOffsets.size() - 1;
+    const int nSegments = qBound(1, nFrames / MinSegmentFrames, QThread::idealThreadCount());
+    if (decodeSegments(nSegments, samples))
+        return true;
+    if (mCanceled || nSegments == 1)
+        return false;
+    // the platform decoder doesn't behave as assumed, e.g. it doesn't
+    // put out mSamplesPerFrame samples per frame or needs a longer
+    // preroll, so decode the file sequentially
+    mErrorString.clear();
+    samples.clear();
+    return decodeSegments(1, samples);
+}
+
+
+bool Mp3Decoder::decodeSegments(int nSegments, SampleBuffer &samples)
+{
+    const int nFrames = mFrameOffsets.size() - 1;
+    QVector<Mp3Segment> segments(nSegments);
+    for (int i = 0; i < nSegments; ++i) {
+        const int firstFrame = int(qint64(nFrames) * i / nSegments);
+        const int lastFrame = int(qint64(nFrames) * (i + 1) / nSegments);
+        // the first segment starts at the beginning of the file so
+        // that the decoder gets to see the tags and the Info frame
+        const qint64 begin = (i == 0) ? 0 : mFrameOffsets[firstFrame - overlapFrames(firstFrame)];
+        setupSegment(segments[i], begin, firstFrame, lastFrame);
+    }
+    QtConcurrent::blockingMap(segments, decodeSegment);
+    if (mCanceled)
+        return false;
+
+    // the last samples of every segment belong to its own frames,
+    // whatever the decoder made of the preroll frames before them
+    const int samplesPerFrame = mSamplesPerFrame * mChannels;
+    int total = 0;
+    for (int i = 0; i < nSegments; ++i) {
+        const Mp3Segment &segment = segments[i];
+        const int take = (i == 0) ? segment.samples.size() : segment.frames * samplesPerFrame;
+        if (!segment.ok || segment.samples.size() < take) {
+            mErrorString = QObject::tr("Decoding MPEG audio segment %1 failed").arg(i);
+            return false;
+        }
+        total += take;
+    }
+    samples.resize(total);
+    SampleBufferType *dst = samples.data();
+    for (int i = 0; i < nSegments; ++i) {
+        const SampleBuffer &src = segments[i].samples;
+        const int take = (i == 0) ? src.size() : segments[i].frames * samplesPerFrame;
+        memcpy(dst, src.constData() + src.size() - take, take * sizeof(SampleBufferType));
+        dst += take;
+    }
+    if (nSegments > 1 && !seamsMatch(segments, samples)) {
+        mErrorString = QObject::tr("The decoded MPEG audio segments don't fit together");
+        return false;
+    }
+    // a gapless decoder trims encoder delay and padding; only the first
+    // segment contains the LAME tag, so do the trimming at the end here
+    const bool gapless = segments[0].samples.size() < segments[0].frames * samplesPerFrame;
+    if (nSegments > 1 && gapless && mEncoderPadding > 0) {
+        const qint64 length = qint64(nFrames) * mSamplesPerFrame - mEncoderDelay - mEncoderPadding;
+        if (length > 0 && length * mChannels < samples.size())
+            samples.resize(int(length * mChannels));
+    }
+    mFrameCount = samples.size() / mChannels;
+    return true;
+}
+
+
+bool Mp3Decoder::seamsMatch(const QVector<Mp3Segment> &segments, const SampleBuffer &samples)
+{
+    // a few frames on either side of every seam are decoded once more,
+    // this time with a longer preroll before the seam, and compared to
+    // the stitched samples. A mismatch before the seam means the
+    // preroll of the window was too short, one after the seam that
+    // of the segment, a shifted signal that the decoder didn't put out
+    // mSamplesPerFrame samples per frame.
+    const int samplesPerFrame = mSamplesPerFrame * mChannels;
+    // a gapless decoder has dropped the encoder delay from the first segment
+    const int shift = segments[0].frames * samplesPerFrame - segments[0].samples.size();
+    QVector<Mp3Segment> windows(segments.size() - 1);
+    for (int i = 1; i < segments.size(); ++i) {
+        const int seam = segments[i].firstFrame;
+        const int firstFrame = seam - SeamCheckFrames;
+        const int lastFrame = seam + SeamCheckFrames;
+        setupSegment(windows[i - 1], mFrameOffsets[firstFrame - overlapFrames(firstFrame)], firstFrame, lastFrame);
+    }
+    QtConcurrent::blockingMap(windows, decodeSegment);
+    foreach (const Mp3Segment &window, windows) {
+        const int count = window.frames * samplesPerFrame;
+        const int offset = window.firstFrame * samplesPerFrame - shift;
+        if (!window.ok || window.samples.size() < count || offset < 0 || offset + count > samples.size())
+            return false;
+        const SampleBufferType *a = window.samples.constData() + window.samples.size() - count;
+        const SampleBufferType *b = samples.constData() + offset;
+        for (int j = 0; j < count; ++j)
+            if (qAbs(int(a[j]) - int(b[j])) > SeamTolerance)
+                return false;
+    }
+    return true;
+}
+
+
+Mp3SegmentDecoder::Mp3SegmentDecoder(const QAudioFormat &format, SampleBuffer &samples, const volatile bool *canceled)
+    : mSamples(samples)
+    , mCanceled(canceled)
+    , mOk(false)
+{
+    mDecoder.setAudioFormat(format);
+    QObject::connect(&mDecoder, SIGNAL(bufferReady()), SLOT(readBuffer()));
+    QObject::connect(&mDecoder, SIGNAL(finished()), SLOT(finished()));
+    QObject::connect(&mDecoder, SIGNAL(error(QAudioDecoder::Error)), SLOT(failed(QAudioDecoder::Error)));
+}
+
+
+bool Mp3SegmentDecoder::run(QIODevice *device)
+{
+    mDecoder.setSourceDevice(device);
+    mDecoder.start();
+    mLoop.exec();
+    return mOk && !*mCanceled;
+}
+
+
+void Mp3SegmentDecoder::readBuffer(void)
+{
+    const QAudioBuffer &buf = mDecoder.read();
+    if (*mCanceled) {
+        mDecoder.stop();
+        mLoop.quit();
+        return;
+    }
+    if (!buf.isValid() || buf.format().sampleSize() != 8 * sizeof(SampleBufferType))
+        return;
+    const int offset = mSamples.size();
+    mSamples.resize(offset + buf.sampleCount());
+    memcpy(mSamples.data() + offset, buf.constData(), buf.sampleCount() * sizeof(SampleBufferType));
+}
+
+
+void Mp3SegmentDecoder::finished(void)
+{
+    mOk = true;
+    mLoop.quit();
+}
+
+
+void Mp3SegmentDecoder::failed(QAudioDecoder::Error)
+{
+    qWarning() << "Mp3SegmentDecoder::failed():" << mDecoder.errorString();
+    mOk = false;
+    mLoop.quit();
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __MP3DECODER_H_
+#define __MP3DECODER_H_
+
+#include <QObject>
+#include <QFile>
+#include <QVector>
+#include <QEventLoop>
+#include <QAudioFormat>
+#include <QAudioDecoder>
+#include "pcmdecoder.h"
+
+struct Mp3Segment;
+
+// Decodes MPEG audio files in parallel. The bitstream is scanned for
+// frame headers and cut into one segment per core at frame boundaries.
+// Each segment is preceded by enough frames to fill the bit reservoir
+// and the synthesis filterbank. The samples of these extra frames are
+// discarded when the segments are stitched together. The seams are
+// decoded once more with a longer preroll to check the result; if it
+// differs, the file is decoded sequentially instead.
+class Mp3Decoder : public PcmDecoder
+{
+public:
+    Mp3Decoder(void);
+    ~Mp3Decoder();
+
+    static const int MinSegmentFrames = 400;
+    // frames on either side of a seam that are checked
+    static const int SeamCheckFrames = 8;
+    // decoders may dither, so allow for a difference in the last bit
+    static const int SeamTolerance = 1;
+
+    bool open(const QString &fileName);
+    bool decode(SampleBuffer &samples);
+
+private: // methods
+    bool scanFrames(qint64 pos);
+    void parseInfoFrame(const uchar *frame, int length);
+    int overlapFrames(int firstFrame) const;
+    QAudioFormat pcmFormat(void) const;
+    void setupSegment(Mp3Segment &segment, qint64 begin, int firstFrame, int lastFrame);
+    bool decodeSegments(int nSegments, SampleBuffer &samples);
+    bool seamsMatch(const QVector<Mp3Segment> &segments, const SampleBuffer &samples);
+
+private:
+    QFile mFile;
+    const uchar *mMap;
+    qint64 mSize;
+    // file offsets of all audio frames plus the end of the last one
+    QVector<qint64> mFrameOffsets;
+    int mSamplesPerFrame;
+    int mEncoderDelay;
+    int mEncoderPadding;
+};
+
+
+// Drives a QAudioDecoder over one segment in the calling thread's
+// own event loop.
+class Mp3SegmentDecoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    Mp3SegmentDecoder(const QAudioFormat &format, SampleBuffer &samples, const volatile bool *canceled);
+    bool run(QIODevice *device);
+
+private slots:
+    void readBuffer(void);
+    void finished(void);
+    void failed(QAudioDecoder::Error);
+
+private:
+    QAudioDecoder mDecoder;
+    QEventLoop mLoop;
+    SampleBuffer &mSamples;
+    const volatile bool *mCanceled;
+    bool mOk;
+};
+
+#endif // __MP3DECODER_H_
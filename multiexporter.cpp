@@ -0,0 +1,374 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QFutureWatcher>
+#include <QPair>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+#include <QtCore/QDebug>
+
+#include "multiexporter.h"
+#include "framestore.h"
+#include "imageresizer.h"
+
+
+class MultiExporterPrivate {
+public:
+    MultiExporterPrivate(void)
+        : encoder(nullptr)
+        , audioCache(nullptr)
+        , audioEncoder(nullptr)
+        , scheduler(nullptr)
+        , running(0)
+        , scaling(false)
+        , scaleCanceled(false)
+    { /* ... */ }
+    EncoderBackend *encoder;
+    AudioCache *audioCache;
+    EncoderBackend *audioEncoder;
+    QSharedPointer<const FrameStore> frames;
+    QStringList frameFiles;
+    const FrameScheduler *scheduler;
+    ExportOptions options;
+    QList<ExportVariant> variants;
+    // options of the main output and the variants of the current run
+    QList<ExportOptions> outputs;
+    // the first one writes the main output
+    QList<VideoExporter*> exporters;
+    // one scaler per size of the outputs, each with its frames
+    QList<ImageResizer*> resizers;
+    QList<QPair<QSize, QSharedPointer<const FrameStore> > > scaledFrames;
+    // the sizes are scaled in the background before the exporters start
+    QFutureWatcher<QList<QSharedPointer<const FrameStore> > > scaleWatcher;
+    bool scaling;
+    volatile bool scaleCanceled;
+    QVector<int> done;
+    QVector<int> total;
+    QVector<ExportProgress> reports;
+    // exporters not finished yet
+    int running;
+    QStringList failedFiles;
+    QString errorString;
+
+    ~MultiExporterPrivate()
+    {
+        qDeleteAll(resizers);
+    }
+};
+
+
+// scales the frames to one size after the other, each on all cores
+static QList<QSharedPointer<const FrameStore> > scaleFrames(QSharedPointer<const FrameStore> frames, QList<const ImageResizer*> resizers, const volatile bool *canceled)
+{
+    QList<QSharedPointer<const FrameStore> > scaled;
+    foreach (const ImageResizer *resizer, resizers) {
+        if (*canceled)
+            break;
+        scaled.append(resizer->resize(frames));
+    }
+    return scaled;
+}
+
+
+MultiExporter::MultiExporter(QObject *parent)
+    : QObject(parent)
+    , d_ptr(new MultiExporterPrivate)
+{
+    Q_D(MultiExporter);
+    d->exporters.append(createExporter());
+    QObject::connect(&d->scaleWatcher, SIGNAL(finished()), SLOT(framesScaled()));
+}
+
+
+MultiExporter::~MultiExporter()
+{
+    cancel();
+}
+
+
+VideoExporter *MultiExporter::createExporter(void)
+{
+    VideoExporter *exporter = new VideoExporter(this);
+    QObject::connect(exporter, SIGNAL(output(QString)), SIGNAL(output(QString)));
+    QObject::connect(exporter, SIGNAL(progress(int, int)), SLOT(exporterProgress(int, int)));
+    QObject::connect(exporter, SIGNAL(progressReport(ExportProgress)), SLOT(exporterReport(ExportProgress)));
+    QObject::connect(exporter, SIGNAL(finished(bool)), SLOT(exporterFinished(bool)));
+    return exporter;
+}
+
+
+void MultiExporter::setEncoder(EncoderBackend *encoder)
+{
+    d_ptr->encoder = encoder;
+}
+
+
+void MultiExporter::setAudioCache(AudioCache *cache)
+{
+    d_ptr->audioCache = cache;
+}
+
+
+void MultiExporter::setAudioEncoder(EncoderBackend *encoder)
+{
+    d_ptr->audioEncoder = encoder;
+}
+
+
+void MultiExporter::setFrames(QSharedPointer<const FrameStore> frames, const QStringList &frameFiles)
+{
+    Q_D(MultiExporter);
+    d->frames = frames;
+    d->frameFiles = frameFiles;
+}
+
+
+void MultiExporter::setScheduler(const FrameScheduler *scheduler)
+{
+    Q_D(MultiExporter);
+    d->scheduler = scheduler;
+    d->exporters.first()->setScheduler(scheduler);
+}
+
+
+void MultiExporter::setOptions(const ExportOptions &options)
+{
+    Q_D(MultiExporter);
+    d->options = options;
+    d->exporters.first()->setOptions(options);
+}
+
+
+const ExportOptions &MultiExporter::options(void) const
+{
+    return d_ptr->options;
+}
+
+
+void MultiExporter::setVariants(const QList<ExportVariant> &variants)
+{
+    d_ptr->variants = variants;
+}
+
+
+const QList<ExportVariant> &MultiExporter::variants(void) const
+{
+    return d_ptr->variants;
+}
+
+
+int MultiExporter::frameCount(void) const
+{
+    // all outputs have the same schedule
+    return d_ptr->exporters.first()->frameCount();
+}
+
+
+bool MultiExporter::isRunning(void) const
+{
+    return d_ptr->running > 0 || d_ptr->scaling;
+}
+
+
+QString MultiExporter::errorString(void) const
+{
+    return d_ptr->errorString;
+}
+
+
+bool MultiExporter::start(void)
+{
+    Q_D(MultiExporter);
+    if (isRunning())
+        return false;
+    d->errorString.clear();
+    d->failedFiles.clear();
+    if (d->frames.isNull() || d->frames->frameCount() == 0) {
+        d->errorString = tr("There are no frames to encode.");
+        return false;
+    }
+    const int nOutputs = 1 + d->variants.count();
+    QList<ExportOptions> outputs;
+    ExportOptions options = d->options;
+    if (nOutputs > 1) {
+        // the cores are shared among the encoders
+        if (options.threads <= 0)
+            options.threads = qMax(1, QThread::idealThreadCount() / nOutputs);
+        options.segmentedExport = false;
+        options.reuseVideo = false;
+    }
+    outputs.append(options);
+    foreach (ExportVariant variant, d->variants) {
+        if (variant.outputFile == options.outputFile) {
+            d->errorString = tr("The variants must be written to files of their own.");
+            return false;
+        }
+        options.outputFile = variant.outputFile;
+        options.outputSize = variant.outputSize;
+        options.preset = variant.preset;
+        options.codec = variant.codec;
+        outputs.append(options);
+    }
+    // the exporters of the last run's variants
+    while (d->exporters.count() > 1)
+        d->exporters.takeLast()->deleteLater();
+    qDeleteAll(d->resizers);
+    d->resizers.clear();
+    d->scaledFrames.clear();
+    d->done = QVector<int>(nOutputs, 0);
+    d->total = QVector<int>(nOutputs, 0);
+    d->reports = QVector<ExportProgress>(nOutputs);
+    d->outputs = outputs;
+    // the frames are scaled once per size
+    QList<const ImageResizer*> resizers;
+    foreach (ExportOptions o, outputs) {
+        const QSize &size = ImageResizer::fit(d->frames->size(), o.outputSize);
+        bool known = size == d->frames->size();
+        for (int j = 0; j < d->scaledFrames.count() && !known; ++j)
+            known = d->scaledFrames.at(j).first == size;
+        if (known)
+            continue;
+        ImageResizer *resizer = new ImageResizer;
+        resizer->setFilter(o.resizeFilter);
+        resizer->setSize(d->frames->size(), size);
+        d->resizers.append(resizer);
+        resizers.append(resizer);
+        d->scaledFrames.append(qMakePair(size, QSharedPointer<const FrameStore>()));
+    }
+    if (resizers.isEmpty())
+        return startExporters();
+    // scaling takes too long for the calling thread
+    d->scaling = true;
+    d->scaleCanceled = false;
+    d->scaleWatcher.setFuture(QtConcurrent::run(scaleFrames, d->frames, resizers, &d->scaleCanceled));
+    return true;
+}
+
+
+void MultiExporter::framesScaled(void)
+{
+    Q_D(MultiExporter);
+    if (!d->scaling || d->scaleCanceled)
+        return;
+    d->scaling = false;
+    const QList<QSharedPointer<const FrameStore> > &scaled = d->scaleWatcher.result();
+    for (int i = 0; i < scaled.count(); ++i)
+        d->scaledFrames[i].second = scaled.at(i);
+    if (!startExporters())
+        emit finished(false);
+}
+
+
+bool MultiExporter::startExporters(void)
+{
+    Q_D(MultiExporter);
+    for (int i = 0; i < d->outputs.count(); ++i) {
+        ExportOptions o = d->outputs.at(i);
+        const QSize &size = ImageResizer::fit(d->frames->size(), o.outputSize);
+        QSharedPointer<const FrameStore> frames = d->frames;
+        QStringList frameFiles = d->frameFiles;
+        if (size != d->frames->size()) {
+            frameFiles.clear();
+            frames.clear();
+            for (int j = 0; j < d->scaledFrames.count() && frames.isNull(); ++j)
+                if (d->scaledFrames.at(j).first == size)
+                    frames = d->scaledFrames.at(j).second;
+        }
+        // the frames are in the output size already
+        o.outputSize = QSize();
+        if (i > 0)
+            d->exporters.append(createExporter());
+        VideoExporter *exporter = d->exporters.at(i);
+        exporter->setEncoder(d->encoder);
+        exporter->setAudioCache(d->audioCache);
+        exporter->setAudioEncoder(d->audioEncoder);
+        exporter->setFrames(frames, frameFiles);
+        exporter->setScheduler(d->scheduler);
+        exporter->setOptions(o);
+    }
+    foreach (VideoExporter *exporter, d->exporters) {
+        if (!exporter->start()) {
+            d->errorString = exporter->errorString();
+            cancel();
+            return false;
+        }
+        ++d->running;
+    }
+    return true;
+}
+
+
+void MultiExporter::cancel(void)
+{
+    Q_D(MultiExporter);
+    d->scaleCanceled = true;
+    d->scaleWatcher.waitForFinished();
+    d->scaling = false;
+    foreach (VideoExporter *exporter, d->exporters)
+        exporter->cancel();
+    d->running = 0;
+}
+
+
+void MultiExporter::exporterProgress(int done, int total)
+{
+    Q_D(MultiExporter);
+    const int i = d->exporters.indexOf(qobject_cast<VideoExporter*>(sender()));
+    if (i < 0)
+        return;
+    d->done[i] = done;
+    d->total[i] = total;
+    int allDone = 0;
+    int allTotal = 0;
+    for (int j = 0; j < d->done.count(); ++j) {
+        allDone += d->done.at(j);
+        allTotal += d->total.at(j);
+    }
+    emit progress(allDone, allTotal);
+}
+
+
+void MultiExporter::exporterReport(const ExportProgress &report)
+{
+    Q_D(MultiExporter);
+    const int i = d->exporters.indexOf(qobject_cast<VideoExporter*>(sender()));
+    if (i < 0)
+        return;
+    if (d->exporters.count() == 1) {
+        emit progressReport(report);
+        return;
+    }
+    d->reports[i] = report;
+    // the outputs as a whole are as far as the one lagging behind
+    ExportProgress all;
+    all.pass = report.pass;
+    all.passes = report.passes;
+    all.remaining = 0;
+    foreach (ExportProgress r, d->reports) {
+        all.pass = qMin(all.pass, r.pass);
+        all.passes = qMax(all.passes, r.passes);
+        all.frames += r.frames;
+        all.totalFrames += r.totalFrames;
+        all.fps += r.fps;
+        all.elapsed = qMax(all.elapsed, r.elapsed);
+        all.remaining = (all.remaining < 0 || r.remaining < 0) ? -1 : qMax(all.remaining, r.remaining);
+    }
+    emit progressReport(all);
+}
+
+
+void MultiExporter::exporterFinished(bool ok)
+{
+    Q_D(MultiExporter);
+    VideoExporter *exporter = qobject_cast<VideoExporter*>(sender());
+    if (exporter == nullptr || d->running == 0)
+        return;
+    if (!ok)
+        d->failedFiles.append(exporter->options().outputFile);
+    if (--d->running > 0)
+        return;
+    if (!d->failedFiles.isEmpty())
+        d->errorString = tr("%1 could not be written.").arg(d->failedFiles.join(", "));
+    emit finished(d->failedFiles.isEmpty());
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __MULTIEXPORTER_H_
+#define __MULTIEXPORTER_H_
+
+#include <QObject>
+#include <QList>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QScopedPointer>
+#include <QSharedPointer>
+
+#include "videoexporter.h"
+
+class MultiExporterPrivate;
+class AudioCache;
+class FrameStore;
+class FrameScheduler;
+
+
+// A further output of an export, e.g. a smaller video or one with a
+// more widely supported codec.
+struct ExportVariant {
+    ExportVariant(void)
+        : preset(EncoderBackend::Balanced)
+        , codec(EncoderBackend::H264)
+    { /* ... */ }
+    QString outputFile;
+    // 0 leaves a dimension unconstrained, see ImageResizer::fit()
+    QSize outputSize;
+    EncoderBackend::Preset preset;
+    EncoderBackend::Codec codec;
+};
+
+
+// Encodes the main output and its variants at the same time from one
+// set of frames and one schedule. Every output gets an exporter, and
+// with it an encoder process, of its own. The frames are scaled once
+// per size in the background, and outputs of the same size share them
+// and their YUV data. As each encoder pulls the frames
+// it needs from the shared store, a slow encoder only holds back its
+// own stream and no frames pile up for it. Without variants this is
+// the same as a plain VideoExporter.
+class MultiExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MultiExporter(QObject *parent = nullptr);
+    ~MultiExporter();
+
+    void setEncoder(EncoderBackend *encoder);
+    void setAudioCache(AudioCache *cache);
+    void setAudioEncoder(EncoderBackend *encoder);
+    // the files are used by outputs in the size of the frames only
+    void setFrames(QSharedPointer<const FrameStore> frames, const QStringList &frameFiles = QStringList());
+    void setScheduler(const FrameScheduler *scheduler);
+    // options of the main output, the variants differ in the file,
+    // the size, the preset and the codec only
+    void setOptions(const ExportOptions &options);
+    const ExportOptions &options(void) const;
+    void setVariants(const QList<ExportVariant> &variants);
+    const QList<ExportVariant> &variants(void) const;
+    int frameCount(void) const;
+
+    // returns false if the export can't be started; if the frames are
+    // scaled first, an exporter failing to start emits finished(false)
+    bool start(void);
+    // stops all encoders without emitting finished()
+    void cancel(void);
+    bool isRunning(void) const;
+    QString errorString(void) const;
+
+signals:
+    void output(const QString&);
+    // summed over the outputs
+    void progress(int done, int total);
+    void progressReport(const ExportProgress&);
+    // once all outputs are done, ok only if all of them are written
+    void finished(bool ok);
+
+private slots:
+    void exporterProgress(int done, int total);
+    void exporterReport(const ExportProgress &report);
+    void exporterFinished(bool ok);
+    void framesScaled(void);
+
+private: // methods
+    VideoExporter *createExporter(void);
+    bool startExporters(void);
+
+private:
+    QScopedPointer<MultiExporterPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(MultiExporter)
+    Q_DISABLE_COPY(MultiExporter)
+};
+
+#endif // __MULTIEXPORTER_H_
@@ -0,0 +1,55 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QRegExp>
+#include <QtCore/QDebug>
+
+#include "pcmdecoder.h"
+#include "wavdecoder.h"
+#include "flacdecoder.h"
+#include "mp3decoder.h"
+
+
+static const QRegExp gReWav("\\.wav$", Qt::CaseInsensitive);
+static const QRegExp gReFlac("\\.flac$", Qt::CaseInsensitive);
+static const QRegExp gReMp3("\\.mp3$", Qt::CaseInsensitive);
+
+
+PcmDecoder::PcmDecoder(void)
+    : mSampleRate(0)
+    , mChannels(0)
+    , mFrameCount(0)
+    , mCanceled(false)
+{
+    // ...
+}
+
+
+PcmDecoder::~PcmDecoder()
+{
+    // ...
+}
+
+
+PcmDecoder *PcmDecoder::create(const QString &fileName)
+{
+    if (fileName.contains(gReWav))
+        return new WavDecoder;
+    if (fileName.contains(gReFlac))
+        return new FlacDecoder;
+    if (fileName.contains(gReMp3))
+        return new Mp3Decoder;
+    return nullptr;
+}
+
+
+bool PcmDecoder::canDecode(const QString &fileName)
+{
+    return fileName.contains(gReWav) || fileName.contains(gReFlac) || fileName.contains(gReMp3);
+}
+
+
+qint64 PcmDecoder::duration(void) const
+{
+    return mSampleRate > 0 ? 1000 * mFrameCount / mSampleRate : 0;
+}
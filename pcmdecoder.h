@@ -0,0 +1,51 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __PCMDECODER_H_
+#define __PCMDECODER_H_
+
+#include <QString>
+#include "types.h"
+
+// Base class of the built-in audio decoders. In contrast to
+// QAudioDecoder these decode the complete file in one go, preferably
+// on a worker thread. WAV and FLAC don't depend on the platform's
+// media backend at all.
+class PcmDecoder
+{
+public:
+    PcmDecoder(void);
+    virtual ~PcmDecoder();
+
+    // returns a decoder able to handle the file or nullptr if the
+    // file has to go through QAudioDecoder
+    static PcmDecoder *create(const QString &fileName);
+    static bool canDecode(const QString &fileName);
+
+    virtual bool open(const QString &fileName) = 0;
+    // decodes the whole file into interleaved 16 bit samples
+    virtual bool decode(SampleBuffer &samples) = 0;
+    // interleaved 16 bit samples read in place if the decoder can
+    // provide them without decoding, nullptr otherwise
+    virtual const SampleBufferType *constData(void) const { return nullptr; }
+
+    int sampleRate(void) const { return mSampleRate; }
+    int channelCount(void) const { return mChannels; }
+    qint64 frameCount(void) const { return mFrameCount; }
+    qint64 duration(void) const;
+    const QString &errorString(void) const { return mErrorString; }
+    void cancel(void) { mCanceled = true; }
+    bool isCanceled(void) const { return mCanceled; }
+
+protected:
+    int mSampleRate;
+    int mChannels;
+    qint64 mFrameCount;
+    QString mErrorString;
+    volatile bool mCanceled;
+
+private:
+    Q_DISABLE_COPY(PcmDecoder)
+};
+
+#endif // __PCMDECODER_H_
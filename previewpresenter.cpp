@@ -0,0 +1,156 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QTimer>
+#include <QElapsedTimer>
+#include <qmath.h>
+
+#include "previewpresenter.h"
+#include "framescheduler.h"
+#include "framestore.h"
+#include "imagewidget.h"
+
+
+class PreviewPresenterPrivate {
+public:
+    PreviewPresenterPrivate(QMediaPlayer *player, const FrameScheduler *scheduler, ImageWidget *widget)
+        : player(player)
+        , scheduler(scheduler)
+        , widget(widget)
+        , running(false)
+        , offset(0)
+        , shownFrame(-1)
+        , lastPosition(-1)
+    { /* ... */ }
+    QMediaPlayer *player;
+    const FrameScheduler *scheduler;
+    ImageWidget *widget;
+    QSharedPointer<const FrameStore> frames;
+    QTimer timer;
+    bool running;
+    int offset;
+    int shownFrame;
+    // QMediaPlayer::position() advances in steps of some ten
+    // milliseconds, in between the clock is interpolated
+    qint64 lastPosition;
+    QElapsedTimer sinceLastPosition;
+    QElapsedTimer freeClock;
+
+    qint64 clock(void);
+};
+
+
+qint64 PreviewPresenterPrivate::clock(void)
+{
+    switch (player->state()) {
+    case QMediaPlayer::StoppedState:
+        lastPosition = -1;
+        return freeClock.elapsed();
+    case QMediaPlayer::PausedState:
+        lastPosition = -1;
+        return player->position();
+    default:
+        break;
+    }
+    const qint64 position = player->position();
+    if (position != lastPosition) {
+        lastPosition = position;
+        sinceLastPosition.start();
+        return position;
+    }
+    return position + qRound(sinceLastPosition.elapsed() * player->playbackRate());
+}
+
+
+PreviewPresenter::PreviewPresenter(QMediaPlayer *player, const FrameScheduler *scheduler, ImageWidget *widget, QObject *parent)
+    : QObject(parent)
+    , d_ptr(new PreviewPresenterPrivate(player, scheduler, widget))
+{
+    Q_D(PreviewPresenter);
+    d->timer.setSingleShot(true);
+    d->timer.setTimerType(Qt::PreciseTimer);
+    d->freeClock.start();
+    QObject::connect(&d->timer, SIGNAL(timeout()), SLOT(present()));
+    QObject::connect(player, SIGNAL(stateChanged(QMediaPlayer::State)), SLOT(refresh()));
+    // seeking while paused
+    QObject::connect(player, SIGNAL(positionChanged(qint64)), SLOT(refresh()));
+}
+
+
+PreviewPresenter::~PreviewPresenter()
+{
+    // ...
+}
+
+
+void PreviewPresenter::setFrames(QSharedPointer<const FrameStore> frames)
+{
+    Q_D(PreviewPresenter);
+    d->frames = frames;
+    d->shownFrame = -1;
+}
+
+
+void PreviewPresenter::setOffset(int offset)
+{
+    d_ptr->offset = offset;
+    refresh();
+}
+
+
+bool PreviewPresenter::isActive(void) const
+{
+    return d_ptr->running;
+}
+
+
+void PreviewPresenter::start(void)
+{
+    Q_D(PreviewPresenter);
+    d->running = true;
+    d->shownFrame = -1;
+    present();
+}
+
+
+void PreviewPresenter::stop(void)
+{
+    Q_D(PreviewPresenter);
+    d->running = false;
+    d->timer.stop();
+}
+
+
+void PreviewPresenter::refresh(void)
+{
+    if (d_ptr->running)
+        present();
+}
+
+
+void PreviewPresenter::present(void)
+{
+    Q_D(PreviewPresenter);
+    d->timer.stop();
+    const qreal fps = d->scheduler->fps();
+    if (!d->running || d->frames.isNull() || d->frames->frameCount() != d->scheduler->frameCount() || fps <= 0)
+        return;
+    const qint64 now = d->clock();
+    const int videoFrame = qFloor(1e-3 * now * fps);
+    const int frame = d->scheduler->frameAt(videoFrame, d->offset);
+    if (frame != d->shownFrame) {
+        d->widget->showFrame(frame);
+        d->shownFrame = frame;
+    }
+    // paused music resumes via stateChanged()
+    if (d->player->state() == QMediaPlayer::PausedState)
+        return;
+    // sleep until the video frame showing a different GIF frame, which
+    // is at most one beat away
+    int next = videoFrame + 1;
+    const int last = videoFrame + d->scheduler->framesPerBeat();
+    while (next < last && d->scheduler->frameAt(next, d->offset) == frame)
+        ++next;
+    const qint64 due = qCeil(1e3 * next / fps);
+    d->timer.start(int(qBound(qint64(1), due - now, qint64(1000))));
+}
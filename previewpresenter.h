@@ -0,0 +1,51 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __PREVIEWPRESENTER_H_
+#define __PREVIEWPRESENTER_H_
+
+#include <QObject>
+#include <QMediaPlayer>
+#include <QSharedPointer>
+#include <QScopedPointer>
+
+class PreviewPresenterPrivate;
+class FrameStore;
+class FrameScheduler;
+class ImageWidget;
+
+// Plays the animation in sync with the music. The presenter has no
+// frame rate of its own: it reads the playback position of the media
+// player and shows the GIF frame the exported video has at that
+// position, according to the frame scheduler. The widget is updated
+// only when that frame changes, and the timer sleeps until the next
+// change. Without music playing a free running clock is used instead.
+class PreviewPresenter : public QObject
+{
+    Q_OBJECT
+
+public:
+    PreviewPresenter(QMediaPlayer *player, const FrameScheduler *scheduler, ImageWidget *widget, QObject *parent = nullptr);
+    ~PreviewPresenter();
+
+    void setFrames(QSharedPointer<const FrameStore> frames);
+    // shift of the animation against the beat in GIF frames
+    void setOffset(int offset);
+    bool isActive(void) const;
+
+public slots:
+    void start(void);
+    void stop(void);
+    // call when the schedule has changed, e.g. after a change of bpm
+    void refresh(void);
+
+private slots:
+    void present(void);
+
+private:
+    QScopedPointer<PreviewPresenterPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(PreviewPresenter)
+    Q_DISABLE_COPY(PreviewPresenter)
+};
+
+#endif // __PREVIEWPRESENTER_H_
@@ -0,0 +1,386 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QAudioDecoder>
+#include <QAudioBuffer>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <QtCore/QDebug>
+
+#include "renderjob.h"
+#include "frameextractor.h"
+#include "framestore.h"
+#include "framecache.h"
+#include "audiocache.h"
+#include "framescheduler.h"
+#include "pcmdecoder.h"
+#include "decimator.h"
+#include "tempoestimator.h"
+
+
+class RenderJobPrivate {
+public:
+    RenderJobPrivate(void)
+        : bpm(0)
+        , maxFps(FrameScheduler::DefaultMaxFps)
+        , encoder(nullptr)
+        , audioEncoder(nullptr)
+        , pcmDecoder(nullptr)
+        , audioDecoder(nullptr)
+        , duration(0)
+        , framesDone(false)
+        , audioDone(false)
+        , prepared(false)
+        , stopped(false)
+    { /* ... */ }
+    QString gifFile;
+    // 0 until the tempo has been estimated
+    qreal bpm;
+    int maxFps;
+    ExportOptions options;
+    QList<ExportVariant> variants;
+    EncoderBackend *encoder;
+    EncoderBackend *audioEncoder;
+    FrameCache frameCache;
+    AudioCache audioCache;
+    FrameExtractor frameExtractor;
+    FrameScheduler scheduler;
+    MultiExporter exporter;
+    PcmDecoder *pcmDecoder;
+    QFutureWatcher<bool> nativeDecodeWatcher;
+    QAudioDecoder *audioDecoder;
+    Decimator decimator;
+    // mono samples at the analysis sample rate, only if the tempo
+    // has to be estimated
+    SampleBuffer analysisSamples;
+    qint64 duration;
+    bool framesDone;
+    bool audioDone;
+    bool prepared;
+    // set once the job has failed or been canceled
+    bool stopped;
+    QString errorString;
+
+    void deleteDecoders(void)
+    {
+        if (pcmDecoder != nullptr) {
+            pcmDecoder->cancel();
+            nativeDecodeWatcher.waitForFinished();
+            delete pcmDecoder;
+            pcmDecoder = nullptr;
+        }
+        if (audioDecoder != nullptr) {
+            audioDecoder->stop();
+            audioDecoder->deleteLater();
+            audioDecoder = nullptr;
+        }
+    }
+
+    ~RenderJobPrivate()
+    {
+        deleteDecoders();
+    }
+};
+
+
+RenderJob::RenderJob(QObject *parent)
+    : QObject(parent)
+    , d_ptr(new RenderJobPrivate)
+{
+    Q_D(RenderJob);
+    QObject::connect(&d->frameExtractor, SIGNAL(finished(bool)), SLOT(frameExtractionFinished(bool)));
+    QObject::connect(&d->nativeDecodeWatcher, SIGNAL(finished()), SLOT(nativeDecodingFinished()));
+    QObject::connect(&d->exporter, SIGNAL(output(QString)), SIGNAL(output(QString)));
+    QObject::connect(&d->exporter, SIGNAL(progress(int, int)), SIGNAL(progress(int, int)));
+    QObject::connect(&d->exporter, SIGNAL(progressReport(ExportProgress)), SIGNAL(progressReport(ExportProgress)));
+    QObject::connect(&d->exporter, SIGNAL(finished(bool)), SLOT(exportFinished(bool)));
+}
+
+
+RenderJob::~RenderJob()
+{
+    cancel();
+}
+
+
+void RenderJob::setGifFile(const QString &fileName)
+{
+    d_ptr->gifFile = fileName;
+}
+
+
+QString RenderJob::gifFile(void) const
+{
+    return d_ptr->gifFile;
+}
+
+
+void RenderJob::setBpm(qreal bpm)
+{
+    d_ptr->bpm = bpm;
+}
+
+
+qreal RenderJob::bpm(void) const
+{
+    return d_ptr->bpm;
+}
+
+
+void RenderJob::setMaxFps(int fps)
+{
+    d_ptr->maxFps = fps;
+}
+
+
+void RenderJob::setCacheDirectory(const QString &directory)
+{
+    if (directory.isEmpty())
+        return;
+    d_ptr->frameCache.setDirectory(directory + "/frames");
+    d_ptr->audioCache.setDirectory(directory + "/audio");
+}
+
+
+void RenderJob::setOptions(const ExportOptions &options)
+{
+    d_ptr->options = options;
+}
+
+
+const ExportOptions &RenderJob::options(void) const
+{
+    return d_ptr->options;
+}
+
+
+void RenderJob::setVariants(const QList<ExportVariant> &variants)
+{
+    d_ptr->variants = variants;
+}
+
+
+void RenderJob::setEncoder(EncoderBackend *encoder)
+{
+    d_ptr->encoder = encoder;
+}
+
+
+void RenderJob::setAudioEncoder(EncoderBackend *encoder)
+{
+    d_ptr->audioEncoder = encoder;
+}
+
+
+bool RenderJob::isPrepared(void) const
+{
+    return d_ptr->prepared;
+}
+
+
+QString RenderJob::errorString(void) const
+{
+    return d_ptr->errorString;
+}
+
+
+void RenderJob::prepare(void)
+{
+    Q_D(RenderJob);
+    // the frames are only kept in memory, unless they go to the cache
+    d->frameExtractor.setWriteFiles(false);
+    d->frameExtractor.setCache(&d->frameCache);
+    d->frameExtractor.start(d->gifFile, d->options.tempDirectory, "%1-%2.png");
+    d->pcmDecoder = PcmDecoder::create(d->options.audioFile);
+    if (d->pcmDecoder != nullptr && d->pcmDecoder->open(d->options.audioFile)) {
+        d->duration = d->pcmDecoder->duration();
+        // without the need to analyze it the audio isn't decoded at all
+        if (d->bpm > 0 && d->duration > 0) {
+            delete d->pcmDecoder;
+            d->pcmDecoder = nullptr;
+            d->audioDone = true;
+        }
+        else {
+            d->nativeDecodeWatcher.setFuture(QtConcurrent::run(this, &RenderJob::decodeNative));
+        }
+    }
+    else {
+        delete d->pcmDecoder;
+        d->pcmDecoder = nullptr;
+        d->audioDecoder = new QAudioDecoder;
+        QObject::connect(d->audioDecoder, SIGNAL(bufferReady()), SLOT(readAudioBuffer()));
+        QObject::connect(d->audioDecoder, SIGNAL(finished()), SLOT(audioDecoderFinished()));
+        QObject::connect(d->audioDecoder, SIGNAL(error(QAudioDecoder::Error)), SLOT(audioDecoderError()));
+        d->audioDecoder->setSourceFilename(d->options.audioFile);
+        d->audioDecoder->start();
+    }
+}
+
+
+bool RenderJob::decodeNative(void)
+{
+    Q_D(RenderJob);
+    PcmDecoder *decoder = d->pcmDecoder;
+    // there's no waveform to show, so samples which can be read in
+    // place, e.g. from a mapped WAV file, aren't copied
+    SampleBuffer samples;
+    const SampleBufferType *data = decoder->constData();
+    if (data == nullptr) {
+        if (!decoder->decode(samples))
+            return false;
+        data = samples.constData();
+    }
+    d->duration = decoder->duration();
+    if (d->bpm > 0)
+        return true;
+    d->decimator.setFormat(decoder->sampleRate(), decoder->channelCount());
+    d->decimator.process(data, int(decoder->frameCount()), d->analysisSamples);
+    d->decimator.flush(d->analysisSamples);
+    if (decoder->isCanceled())
+        return false;
+    // the analysis runs on this worker, too
+    d->bpm = TempoEstimator::estimate(d->analysisSamples, Decimator::DefaultOutputRate);
+    d->analysisSamples = SampleBuffer();
+    return true;
+}
+
+
+void RenderJob::nativeDecodingFinished(void)
+{
+    Q_D(RenderJob);
+    if (d->pcmDecoder == nullptr)
+        return;
+    const bool ok = d->nativeDecodeWatcher.result();
+    const QString &errorString = d->pcmDecoder->errorString();
+    delete d->pcmDecoder;
+    d->pcmDecoder = nullptr;
+    if (!ok) {
+        fail(tr("Decoding %1 failed: %2").arg(d->options.audioFile).arg(errorString));
+        return;
+    }
+    d->audioDone = true;
+    checkPrepared();
+}
+
+
+void RenderJob::readAudioBuffer(void)
+{
+    Q_D(RenderJob);
+    const QAudioBuffer &buf = d->audioDecoder->read();
+    if (!buf.isValid())
+        return;
+    d->duration = qMax(d->duration, (buf.startTime() + buf.duration()) / 1000);
+    if (d->bpm > 0 || buf.format().sampleSize() != 8 * sizeof(SampleBufferType))
+        return;
+    d->decimator.setFormat(buf.format().sampleRate(), buf.format().channelCount());
+    d->decimator.process(buf.constData<SampleBufferType>(), buf.frameCount(), d->analysisSamples);
+}
+
+
+void RenderJob::audioDecoderFinished(void)
+{
+    Q_D(RenderJob);
+    if (d->bpm <= 0) {
+        d->decimator.flush(d->analysisSamples);
+        d->bpm = TempoEstimator::estimate(d->analysisSamples, Decimator::DefaultOutputRate);
+        d->analysisSamples = SampleBuffer();
+    }
+    d->audioDone = true;
+    checkPrepared();
+}
+
+
+void RenderJob::audioDecoderError(void)
+{
+    Q_D(RenderJob);
+    fail(tr("Decoding %1 failed: %2").arg(d->options.audioFile).arg(d->audioDecoder->errorString()));
+}
+
+
+void RenderJob::frameExtractionFinished(bool ok)
+{
+    Q_D(RenderJob);
+    if (d->stopped)
+        return;
+    if (!ok) {
+        fail(tr("Extracting frames from %1 failed: %2").arg(d->gifFile).arg(d->frameExtractor.errorString()));
+        return;
+    }
+    d->framesDone = true;
+    checkPrepared();
+}
+
+
+void RenderJob::checkPrepared(void)
+{
+    Q_D(RenderJob);
+    if (!d->framesDone || !d->audioDone || d->stopped)
+        return;
+    if (d->duration <= 0) {
+        fail(tr("%1 contains no audio.").arg(d->options.audioFile));
+        return;
+    }
+    if (d->bpm <= 0) {
+        fail(tr("The tempo of %1 could not be estimated.").arg(d->options.audioFile));
+        return;
+    }
+    QSharedPointer<const FrameStore> frames = d->frameExtractor.frameStore();
+    d->scheduler.setFrameCount(frames->frameCount());
+    d->scheduler.setBpm(d->bpm);
+    d->scheduler.setMaxFps(d->maxFps);
+    d->options.duration = d->duration;
+    d->prepared = true;
+    emit prepared();
+}
+
+
+void RenderJob::encode(void)
+{
+    Q_D(RenderJob);
+    if (!d->prepared || d->stopped)
+        return;
+    d->exporter.setEncoder(d->encoder);
+    d->exporter.setAudioCache(&d->audioCache);
+    d->exporter.setAudioEncoder(d->audioEncoder);
+    // files in the cache can be read by the encoder, all others are
+    // written by the exporter if needed
+    d->exporter.setFrames(d->frameExtractor.frameStore(), d->frameExtractor.isCached() ? d->frameExtractor.fileNames() : QStringList());
+    d->exporter.setScheduler(&d->scheduler);
+    d->exporter.setOptions(d->options);
+    d->exporter.setVariants(d->variants);
+    emit message(tr("%1 frames at %2 fps").arg(d->exporter.frameCount()).arg(d->scheduler.fps(), 0, 'g', 4));
+    if (!d->exporter.start())
+        fail(d->exporter.errorString());
+}
+
+
+void RenderJob::exportFinished(bool ok)
+{
+    Q_D(RenderJob);
+    if (!ok) {
+        fail(tr("The encoder failed: %1").arg(d->exporter.errorString()));
+        return;
+    }
+    emit finished(true);
+}
+
+
+void RenderJob::cancel(void)
+{
+    Q_D(RenderJob);
+    d->stopped = true;
+    d->frameExtractor.cancel();
+    d->exporter.cancel();
+    d->deleteDecoders();
+}
+
+
+void RenderJob::fail(const QString &message)
+{
+    Q_D(RenderJob);
+    if (d->stopped)
+        return;
+    d->errorString = message;
+    cancel();
+    emit finished(false);
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __RENDERJOB_H_
+#define __RENDERJOB_H_
+
+#include <QObject>
+#include <QString>
+#include <QScopedPointer>
+
+#include "multiexporter.h"
+
+class RenderJobPrivate;
+class EncoderBackend;
+
+
+// Renders one video from an animated GIF and a piece of music without
+// any widgets. prepare() extracts the frames while the music is
+// decoded and, if no tempo was given, analyzed; both run in the
+// background. Once prepared() has been emitted, encode() hands the
+// frames to a MultiExporter. The steps are separate so that the
+// number of concurrent encoders can be limited by the caller.
+class RenderJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RenderJob(QObject *parent = nullptr);
+    ~RenderJob();
+
+    void setGifFile(const QString &fileName);
+    QString gifFile(void) const;
+    // 0 means the tempo is estimated from the music
+    void setBpm(qreal bpm);
+    // the given or estimated tempo
+    qreal bpm(void) const;
+    void setMaxFps(int fps);
+    // directory of the frame and audio caches, none if empty
+    void setCacheDirectory(const QString &directory);
+    void setOptions(const ExportOptions &options);
+    const ExportOptions &options(void) const;
+    // further outputs encoded at the same time
+    void setVariants(const QList<ExportVariant> &variants);
+    // must have been probed before encode() is called
+    void setEncoder(EncoderBackend *encoder);
+    // encodes the audio for the cache if the encoder can't do that
+    void setAudioEncoder(EncoderBackend *encoder);
+    bool isPrepared(void) const;
+    QString errorString(void) const;
+
+public slots:
+    void prepare(void);
+    void encode(void);
+    // stops all work without emitting finished()
+    void cancel(void);
+
+signals:
+    void message(const QString&);
+    void output(const QString&);
+    void progress(int done, int total);
+    void progressReport(const ExportProgress&);
+    void prepared(void);
+    void finished(bool ok);
+
+private slots:
+    void frameExtractionFinished(bool ok);
+    void nativeDecodingFinished(void);
+    void readAudioBuffer(void);
+    void audioDecoderFinished(void);
+    void audioDecoderError(void);
+    void exportFinished(bool ok);
+
+private: // methods
+    bool decodeNative(void);
+    void checkPrepared(void);
+    void fail(const QString &message);
+
+private:
+    QScopedPointer<RenderJobPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(RenderJob)
+    Q_DISABLE_COPY(RenderJob)
+};
+
+#endif // __RENDERJOB_H_
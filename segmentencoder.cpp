@@ -0,0 +1,241 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QtCore/QDebug>
+
+#include "segmentencoder.h"
+#include "framestreamer.h"
+#include "framestore.h"
+
+
+struct Segment {
+    Segment(void)
+        : process(nullptr)
+        , streamer(nullptr)
+        , streamFrames(false)
+        , done(0)
+        , finished(false)
+    { /* ... */ }
+    EncoderCommand command;
+    EncoderOutputReader reader;
+    QVector<int> sequence;
+    QProcess *process;
+    FrameStreamer *streamer;
+    bool streamFrames;
+    int done;
+    bool finished;
+};
+
+
+class SegmentEncoderPrivate {
+public:
+    SegmentEncoderPrivate(void)
+        : encoder(nullptr)
+        , fps(25)
+        , running(false)
+    { /* ... */ }
+    const EncoderBackend *encoder;
+    QSharedPointer<const FrameStore> frames;
+    qreal fps;
+    QVector<Segment> segments;
+    bool running;
+
+    int totalFrames(void) const
+    {
+        int total = 0;
+        foreach (const Segment &segment, segments)
+            total += segment.sequence.size();
+        return total;
+    }
+    int doneFrames(void) const
+    {
+        int done = 0;
+        foreach (const Segment &segment, segments)
+            done += segment.done;
+        return done;
+    }
+};
+
+
+SegmentEncoder::SegmentEncoder(QObject *parent)
+    : QObject(parent)
+    , d_ptr(new SegmentEncoderPrivate)
+{
+    // ...
+}
+
+
+SegmentEncoder::~SegmentEncoder()
+{
+    cancel();
+}
+
+
+void SegmentEncoder::setEncoder(const EncoderBackend *encoder)
+{
+    d_ptr->encoder = encoder;
+}
+
+
+void SegmentEncoder::setFrames(QSharedPointer<const FrameStore> frames, qreal fps)
+{
+    Q_D(SegmentEncoder);
+    d->frames = frames;
+    d->fps = fps;
+}
+
+
+void SegmentEncoder::addSegment(const EncoderCommand &command, const QVector<int> &sequence, bool streamFrames)
+{
+    Segment segment;
+    segment.command = command;
+    segment.sequence = sequence;
+    segment.streamFrames = streamFrames;
+    d_ptr->segments.append(segment);
+}
+
+
+int SegmentEncoder::segmentCount(void) const
+{
+    return d_ptr->segments.size();
+}
+
+
+EncoderProgress SegmentEncoder::encoderProgress(int segment) const
+{
+    return d_ptr->segments.at(segment).reader.progress();
+}
+
+
+void SegmentEncoder::clear(void)
+{
+    cancel();
+    d_ptr->segments.clear();
+}
+
+
+void SegmentEncoder::start(void)
+{
+    Q_D(SegmentEncoder);
+    d->running = true;
+    for (int i = 0; i < d->segments.size(); ++i) {
+        Segment &segment = d->segments[i];
+        segment.done = 0;
+        segment.finished = false;
+        segment.reader = EncoderOutputReader(d->encoder);
+        segment.process = new QProcess;
+        QObject::connect(segment.process, SIGNAL(readyReadStandardOutput()), SLOT(readOutput()));
+        QObject::connect(segment.process, SIGNAL(readyReadStandardError()), SLOT(readOutput()));
+        QObject::connect(segment.process, SIGNAL(finished(int, QProcess::ExitStatus)), SLOT(segmentFinished(int, QProcess::ExitStatus)));
+        if (segment.streamFrames) {
+            segment.streamer = new FrameStreamer(segment.process);
+            segment.streamer->setFrames(d->frames);
+            segment.streamer->setSequence(segment.sequence);
+            segment.streamer->setFrameRate(d->fps);
+            QObject::connect(segment.streamer, SIGNAL(progress(int, int)), SLOT(segmentProgress(int, int)));
+        }
+        segment.process->start(segment.command.program, segment.command.arguments);
+    }
+    emit progress(0, d->totalFrames());
+}
+
+
+void SegmentEncoder::cancel(void)
+{
+    Q_D(SegmentEncoder);
+    d->running = false;
+    for (int i = 0; i < d->segments.size(); ++i) {
+        Segment &segment = d->segments[i];
+        if (segment.process == nullptr)
+            continue;
+        QObject::disconnect(segment.process, 0, this, 0);
+        segment.process->kill();
+        segment.process->waitForFinished();
+        // this may be called from a slot of one of the processes
+        if (segment.streamer != nullptr)
+            segment.streamer->deleteLater();
+        segment.streamer = nullptr;
+        segment.process->deleteLater();
+        segment.process = nullptr;
+    }
+}
+
+
+bool SegmentEncoder::isRunning(void) const
+{
+    return d_ptr->running;
+}
+
+
+int SegmentEncoder::indexOf(QObject *sender) const
+{
+    Q_D(const SegmentEncoder);
+    for (int i = 0; i < d->segments.size(); ++i)
+        if (d->segments.at(i).process == sender || d->segments.at(i).streamer == sender)
+            return i;
+    return -1;
+}
+
+
+void SegmentEncoder::readOutput(void)
+{
+    Q_D(SegmentEncoder);
+    QProcess *process = qobject_cast<QProcess*>(sender());
+    const int i = indexOf(process);
+    if (process == nullptr || i < 0)
+        return;
+    Segment &segment = d->segments[i];
+    bool progressed = false;
+    const QString &out = segment.reader.read(process->readAllStandardOutput(), &progressed);
+    const QByteArray &err = process->readAllStandardError();
+    const QString &prefix = QString("[%1] ").arg(i + 1);
+    if (!out.isEmpty())
+        emit output(prefix + out);
+    if (!err.isEmpty())
+        emit output(prefix + QString::fromLocal8Bit(err));
+    if (progressed) {
+        segment.done = qMin(segment.reader.progress().scheduledFrames(d->fps), segment.sequence.size());
+        emit progress(d->doneFrames(), d->totalFrames());
+    }
+}
+
+
+void SegmentEncoder::segmentProgress(int done, int total)
+{
+    Q_D(SegmentEncoder);
+    Q_UNUSED(total);
+    const int i = indexOf(sender());
+    // the encoder's own reports are closer to the truth
+    if (i < 0 || d->segments.at(i).reader.hasProgress())
+        return;
+    d->segments[i].done = done;
+    emit progress(d->doneFrames(), d->totalFrames());
+}
+
+
+void SegmentEncoder::segmentFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    Q_D(SegmentEncoder);
+    const int i = indexOf(sender());
+    if (i < 0 || !d->running)
+        return;
+    Segment &segment = d->segments[i];
+    segment.finished = true;
+    const QString &rest = segment.reader.flush();
+    if (!rest.isEmpty())
+        emit output(QString("[%1] ").arg(i + 1) + rest);
+    segment.done = segment.sequence.size();
+    emit progress(d->doneFrames(), d->totalFrames());
+    if (exitStatus != QProcess::NormalExit || exitCode != 0) {
+        qWarning() << "SegmentEncoder: segment" << i << "failed with exit code" << exitCode;
+        // the other segments are of no use anymore
+        cancel();
+        emit finished(false);
+        return;
+    }
+    foreach (const Segment &other, d->segments)
+        if (!other.finished)
+            return;
+    cancel();
+    emit finished(true);
+}
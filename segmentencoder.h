@@ -0,0 +1,64 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __SEGMENTENCODER_H_
+#define __SEGMENTENCODER_H_
+
+#include <QObject>
+#include <QProcess>
+#include <QVector>
+#include <QSharedPointer>
+#include <QScopedPointer>
+
+#include "encoderbackend.h"
+
+class SegmentEncoderPrivate;
+class FrameStore;
+
+// Runs one encoder process per segment of the video, all at the same
+// time. Segments either read their frames from a list file named in
+// their arguments, or get them streamed to their standard input.
+// Progress is reported in frames summed over all segments, as the
+// encoders report them or, until they do, as they have been streamed.
+// If one of the encoders fails, the others are killed.
+class SegmentEncoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SegmentEncoder(QObject *parent = nullptr);
+    ~SegmentEncoder();
+
+    // reads the progress reports from the encoders' output
+    void setEncoder(const EncoderBackend *encoder);
+    // frames and rate for segments that get their frames streamed
+    void setFrames(QSharedPointer<const FrameStore> frames, qreal fps);
+    void addSegment(const EncoderCommand &command, const QVector<int> &sequence, bool streamFrames);
+    int segmentCount(void) const;
+    // the last progress report of a segment's encoder
+    EncoderProgress encoderProgress(int segment) const;
+    void clear(void);
+    void start(void);
+    void cancel(void);
+    bool isRunning(void) const;
+
+signals:
+    void output(const QString&);
+    void progress(int done, int total);
+    void finished(bool ok);
+
+private slots:
+    void readOutput(void);
+    void segmentProgress(int done, int total);
+    void segmentFinished(int exitCode, QProcess::ExitStatus exitStatus);
+
+private: // methods
+    int indexOf(QObject *sender) const;
+
+private:
+    QScopedPointer<SegmentEncoderPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(SegmentEncoder)
+    Q_DISABLE_COPY(SegmentEncoder)
+};
+
+#endif // __SEGMENTENCODER_H_
@@ -7,15 +7,12 @@
 
 #include <QDir>
 #include <QFileDialog>
-#include <QMessageBox>
 #include <QtCore/QDebug>
 
 class SettingsFormPrivate {
 public:
     SettingsFormPrivate(void)
-        : dirty(false)
     { /* ... */ }
-    bool dirty;
 };
 
 SettingsForm::SettingsForm(QDialog *parent)
@@ -29,41 +26,28 @@ SettingsForm::SettingsForm(QDialog *parent)
     setWindowTitle(QString("%1 - Settings").arg(AppName));
 
     ui->mencoderPathLineEdit->setText(QDir::currentPath() + "/mencoder.exe");
+    ui->ffmpegPathLineEdit->setText(QDir::currentPath() + "/ffmpeg.exe");
     ui->outputFileLineEdit->setText(QDir::homePath() + "/output.avi");
     ui->openDirectoryLineEdit->setText(QDir::homePath());
     ui->tmpDirectoryLineEdit->setText(QDir::tempPath());
-    ui->mencoderOptionsPlainTextEdit->setPlainText("-mf w=%1:h=%2:fps=%3:type=png"
-                                         " -of avi"
-                                         " -ovc lavc"
-                                         " -lavcopts vcodec=mpeg4:mbd=2:trell:v4mv:mv0:dia=2:aspect=%4/%5"
-                                         " -oac mp3lame"
-                                         " -lameopts cbr:br=%6");
     ui->subtitleFontLineEdit->setText(QDir::currentPath() + "/big_noodle_titling.ttf");
 
     QObject::connect(ui->chooseOpenDirectoryPushButton, SIGNAL(clicked()), SLOT(chooseOpenDirectory()));
     QObject::connect(ui->chooseOutputFilePushButton, SIGNAL(clicked()), SLOT(chooseOutputFile()));
     QObject::connect(ui->chooseTmpDirectoryPushButton, SIGNAL(clicked()), SLOT(chooseTempDirectory()));
     QObject::connect(ui->chooseMencoderPushButton, SIGNAL(clicked()), SLOT(chooseMencoder()));
+    QObject::connect(ui->chooseFfmpegPushButton, SIGNAL(clicked()), SLOT(chooseFfmpeg()));
     QObject::connect(ui->closePushButton, SIGNAL(clicked()), SLOT(close()));
-    QObject::connect(ui->mencoderPresetsComboBox, SIGNAL(currentIndexChanged(int)), SLOT(mencoderPresetChanged(int)));
-    QObject::connect(ui->mencoderOptionsPlainTextEdit, SIGNAL(textChanged()), SLOT(mencoderOptionsChanged()));
-
-    // see https://wiki.archlinux.org/index.php/MEncoder
-    ui->mencoderPresetsComboBox->addItem(QString(), QVariant());
-    ui->mencoderPresetsComboBox->addItem(
-                tr("high quality MPEG4 (lavc) encoding"),
-                "-mf w=%1:h=%2:fps=%3:type=png "
-                "-of avi -ovc lavc "
-                "-lavcopts vcodec=mpeg4:mbd=2:trell:v4mv:mv0:dia=2:aspect=%4/%5 "
-                "-oac copy");
-    ui->mencoderPresetsComboBox->addItem(
-                tr("high quality H.264 (x264) encoding"),
-                "-mf w=%1:h=%2:fps=%3:type=png "
-                "-oac copy -ovc x264 "
-                "-x264encopts preset=veryslow:tune=film:crf=15:frameref=15:fast_pskip=0:threads=%7 "
-                "-ofps %3");
+
+    ui->encoderComboBox->addItem("MEncoder");
+    ui->encoderComboBox->addItem("ffmpeg");
+    // the order follows EncoderBackend::Preset
+    ui->encoderPresetComboBox->addItem(tr("fastest (x264 ultrafast)"));
+    ui->encoderPresetComboBox->addItem(tr("fast (x264 veryfast)"));
+    ui->encoderPresetComboBox->addItem(tr("balanced (x264 medium)"));
+    ui->encoderPresetComboBox->addItem(tr("high quality (x264 veryslow)"));
+    ui->encoderPresetComboBox->setCurrentIndex(EncoderBackend::Balanced);
     qDebug() << "EOF SettingsForm::SettingsForm()";
-    d_ptr->dirty = false;
 }
 
 
@@ -121,15 +105,81 @@ void SettingsForm::setMencoderPath(const QString &path)
 }
 
 
-QString SettingsForm::getMEncoderOptions(void) const
+QString SettingsForm::getFfmpegPath(void) const
+{
+    return ui->ffmpegPathLineEdit->text();
+}
+
+
+void SettingsForm::setFfmpegPath(const QString &path)
 {
-    return ui->mencoderOptionsPlainTextEdit->toPlainText().replace("\n", " ");
+    ui->ffmpegPathLineEdit->setText(path);
+}
+
+
+QString SettingsForm::getEncoder(void) const
+{
+    return ui->encoderComboBox->currentText();
+}
+
+
+void SettingsForm::setEncoder(const QString &name)
+{
+    const int idx = ui->encoderComboBox->findText(name);
+    if (idx >= 0)
+        ui->encoderComboBox->setCurrentIndex(idx);
+}
+
+
+EncoderBackend::Preset SettingsForm::getEncoderPreset(void) const
+{
+    return EncoderBackend::Preset(ui->encoderPresetComboBox->currentIndex());
+}
+
+
+void SettingsForm::setEncoderPreset(EncoderBackend::Preset preset)
+{
+    ui->encoderPresetComboBox->setCurrentIndex(int(preset));
+}
+
+
+// splits at white space except inside double quotes
+QStringList SettingsForm::getEncoderOptions(void) const
+{
+    QStringList options;
+    QString option;
+    bool quoted = false;
+    bool inOption = false;
+    foreach (QChar c, ui->encoderOptionsPlainTextEdit->toPlainText()) {
+        if (c == '"') {
+            quoted = !quoted;
+            inOption = true;
+        }
+        else if (c.isSpace() && !quoted) {
+            if (inOption)
+                options.append(option);
+            option.clear();
+            inOption = false;
+        }
+        else {
+            option += c;
+            inOption = true;
+        }
+    }
+    if (inOption)
+        options.append(option);
+    return options;
 }
 
 
-void SettingsForm::setMEncoderOptions(const QString &mencoderOptions)
+void SettingsForm::setEncoderOptions(const QStringList &options)
 {
-    ui->mencoderOptionsPlainTextEdit->setPlainText(mencoderOptions);
+    QStringList words;
+    foreach (QString option, options)
+        words.append(option.contains(' ') || option.isEmpty()
+                     ? QString("\"%1\"").arg(option)
+                     : option);
+    ui->encoderOptionsPlainTextEdit->setPlainText(words.join(' '));
 }
 
 
@@ -156,6 +206,18 @@ void SettingsForm::setAudioBitrate(int kbps)
 }
 
 
+int SettingsForm::getAnalysisSampleRate(void) const
+{
+    return ui->analysisSampleRateSpinBox->value();
+}
+
+
+void SettingsForm::setAnalysisSampleRate(int hz)
+{
+    ui->analysisSampleRateSpinBox->setValue(hz);
+}
+
+
 bool SettingsForm::getSubtitlesEnabled() const
 {
     return ui->showArtistTitleCheckBox->isChecked();
@@ -168,6 +230,103 @@ void SettingsForm::setSubtitlesEnabled(bool enabled)
 }
 
 
+bool SettingsForm::getStreamFrames(void) const
+{
+    return ui->streamFramesCheckBox->isChecked();
+}
+
+
+void SettingsForm::setStreamFrames(bool enabled)
+{
+    ui->streamFramesCheckBox->setChecked(enabled);
+}
+
+
+bool SettingsForm::getLoopExport(void) const
+{
+    return ui->loopExportCheckBox->isChecked();
+}
+
+
+void SettingsForm::setLoopExport(bool enabled)
+{
+    ui->loopExportCheckBox->setChecked(enabled);
+}
+
+
+int SettingsForm::getFrameCacheSize(void) const
+{
+    return ui->frameCacheSizeSpinBox->value();
+}
+
+
+void SettingsForm::setFrameCacheSize(int megabytes)
+{
+    ui->frameCacheSizeSpinBox->setValue(megabytes);
+}
+
+
+QSize SettingsForm::getOutputSize(void) const
+{
+    return QSize(ui->outputWidthSpinBox->value(), ui->outputHeightSpinBox->value());
+}
+
+
+void SettingsForm::setOutputSize(const QSize &size)
+{
+    ui->outputWidthSpinBox->setValue(size.width());
+    ui->outputHeightSpinBox->setValue(size.height());
+}
+
+
+ImageResizer::Filter SettingsForm::getResizeFilter(void) const
+{
+    return ImageResizer::Filter(ui->resizeFilterComboBox->currentIndex());
+}
+
+
+void SettingsForm::setResizeFilter(ImageResizer::Filter filter)
+{
+    ui->resizeFilterComboBox->setCurrentIndex(int(filter));
+}
+
+
+int SettingsForm::getMaxFps(void) const
+{
+    return ui->maxFpsSpinBox->value();
+}
+
+
+void SettingsForm::setMaxFps(int fps)
+{
+    ui->maxFpsSpinBox->setValue(fps);
+}
+
+
+bool SettingsForm::getSegmentedExport(void) const
+{
+    return ui->segmentedExportCheckBox->isChecked();
+}
+
+
+void SettingsForm::setSegmentedExport(bool enabled)
+{
+    ui->segmentedExportCheckBox->setChecked(enabled);
+}
+
+
+bool SettingsForm::getSpeculativeExport(void) const
+{
+    return ui->speculativeExportCheckBox->isChecked();
+}
+
+
+void SettingsForm::setSpeculativeExport(bool enabled)
+{
+    ui->speculativeExportCheckBox->setChecked(enabled);
+}
+
+
 bool SettingsForm::chooseOutputFile(void)
 {
     const QString &outDir =
@@ -220,32 +379,13 @@ void SettingsForm::chooseMencoder(void)
 }
 
 
-void SettingsForm::mencoderPresetChanged(int idx)
-{
-    Q_D(SettingsForm);
-    bool doOverwrite = true;
-    if (d->dirty) {
-        QMessageBox::StandardButton choice = QMessageBox::question(
-                    this,
-                    tr("Really overwrite changes?"),
-                    tr("You've made changes to the MEncoder options. "
-                       "Do you really want to overwrite them by choosing a preset?"));
-        if (choice != QMessageBox::Yes)
-            doOverwrite = false;
-    }
-    if (doOverwrite) {
-        const QVariant &data = ui->mencoderPresetsComboBox->itemData(idx);
-        if (!data.isNull()) {
-            ui->mencoderOptionsPlainTextEdit->setPlainText(data.toString());
-            d->dirty = false;
-        }
-    }
-}
-
-
-void SettingsForm::mencoderOptionsChanged(void)
+void SettingsForm::chooseFfmpeg(void)
 {
-    Q_D(SettingsForm);
-    qDebug() << "SettingsForm::mencoderOptionsChanged()";
-    d->dirty = true;
+    const QString &path =
+            QFileDialog::getOpenFileName(
+                this,
+                tr("Select ffmpeg binary"));
+    if (path.isEmpty())
+        return;
+    ui->ffmpegPathLineEdit->setText(path);
 }
@@ -6,6 +6,11 @@
 
 #include <QDialog>
 #include <QScopedPointer>
+#include <QSize>
+#include <QStringList>
+
+#include "imageresizer.h"
+#include "encoderbackend.h"
 
 namespace Ui {
 class SettingsForm;
@@ -29,24 +34,45 @@ public:
     void setTempDirectory(const QString&);
     QString getMencoderPath(void) const;
     void setMencoderPath(const QString&);
-    QString getMEncoderOptions(void) const;
-    void setMEncoderOptions(const QString&);
+    QString getFfmpegPath(void) const;
+    void setFfmpegPath(const QString&);
+    QString getEncoder(void) const;
+    void setEncoder(const QString&);
+    EncoderBackend::Preset getEncoderPreset(void) const;
+    void setEncoderPreset(EncoderBackend::Preset);
+    QStringList getEncoderOptions(void) const;
+    void setEncoderOptions(const QStringList&);
     QString getSubtitleFont(void) const;
     void setSubtitleFont(const QString&);
     int getAudioBitrate(void) const;
     void setAudioBitrate(int);
+    int getAnalysisSampleRate(void) const;
+    void setAnalysisSampleRate(int);
     bool getSubtitlesEnabled(void) const;
     void setSubtitlesEnabled(bool);
+    bool getStreamFrames(void) const;
+    void setStreamFrames(bool);
+    bool getLoopExport(void) const;
+    void setLoopExport(bool);
+    int getFrameCacheSize(void) const;
+    void setFrameCacheSize(int);
+    QSize getOutputSize(void) const;
+    void setOutputSize(const QSize&);
+    ImageResizer::Filter getResizeFilter(void) const;
+    void setResizeFilter(ImageResizer::Filter);
+    int getMaxFps(void) const;
+    void setMaxFps(int);
+    bool getSegmentedExport(void) const;
+    void setSegmentedExport(bool);
+    bool getSpeculativeExport(void) const;
+    void setSpeculativeExport(bool);
 
 public slots:
     bool chooseOutputFile(void);
     void chooseOpenDirectory(void);
     void chooseTempDirectory(void);
     void chooseMencoder(void);
-
-private slots:
-    void mencoderPresetChanged(int);
-    void mencoderOptionsChanged(void);
+    void chooseFfmpeg(void);
 
 private: // methods
 
@@ -0,0 +1,88 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QVector>
+#include <qmath.h>
+
+#include "tempoestimator.h"
+
+// rate of the onset strength envelope
+static const int EnvelopeRate = 200;
+// at least this many beats at the lowest tempo are needed
+static const int MinBeats = 8;
+static const qreal PreferredBpm = 120;
+// width of the preference in octaves
+static const qreal PreferenceWidth = 1.4;
+
+
+qreal TempoEstimator::estimate(const SampleBuffer &samples, int sampleRate)
+{
+    const int hop = sampleRate / EnvelopeRate;
+    if (hop <= 0)
+        return 0;
+    // the exact rate, the hop size is rounded
+    const qreal envelopeRate = qreal(sampleRate) / hop;
+    const int nFrames = samples.size() / hop;
+    const int minLag = qFloor(60 * envelopeRate / MaxBpm);
+    const int maxLag = qCeil(60 * envelopeRate / MinBpm);
+    if (nFrames < MinBeats * maxLag)
+        return 0;
+    // log compressed loudness per frame
+    QVector<qreal> loudness(nFrames);
+    const SampleBufferType *s = samples.constData();
+    for (int i = 0; i < nFrames; ++i) {
+        qint64 sum = 0;
+        for (int j = 0; j < hop; ++j)
+            sum += qAbs(int(*s++));
+        loudness[i] = qLn(1 + qreal(sum) / hop);
+    }
+    // half-wave rectified difference without its mean
+    QVector<qreal> onset(nFrames, 0);
+    qreal mean = 0;
+    for (int i = 1; i < nFrames; ++i) {
+        onset[i] = qMax(qreal(0), loudness.at(i) - loudness.at(i - 1));
+        mean += onset.at(i);
+    }
+    mean /= nFrames;
+    for (int i = 0; i < nFrames; ++i)
+        onset[i] -= mean;
+    // The autocorrelation from half the shortest up to twice the
+    // longest lag, so that the second beat and the offbeat back up
+    // the beat. The scores go one lag beyond the longest for the
+    // interpolation below, their second beat included.
+    QVector<qreal> acf(2 * (maxLag + 1) + 1, 0);
+    for (int lag = minLag / 2; lag < acf.size(); ++lag) {
+        qreal sum = 0;
+        const qreal *a = onset.constData();
+        const qreal *b = onset.constData() + lag;
+        for (int i = nFrames - lag; i > 0; --i)
+            sum += *a++ * *b++;
+        acf[lag] = sum / (nFrames - lag);
+    }
+    int bestLag = 0;
+    qreal bestScore = 0;
+    QVector<qreal> score(maxLag + 2, 0);
+    for (int lag = minLag; lag <= maxLag + 1; ++lag) {
+        const qreal bpm = 60 * envelopeRate / lag;
+        const qreal octaves = qLn(bpm / PreferredBpm) / qLn(2.0) / PreferenceWidth;
+        const qreal weight = qExp(-0.5 * octaves * octaves);
+        score[lag] = weight * (acf.at(lag) + 0.5 * acf.at(2 * lag) + 0.25 * acf.at(lag / 2));
+        if (lag <= maxLag && score.at(lag) > bestScore) {
+            bestScore = score.at(lag);
+            bestLag = lag;
+        }
+    }
+    if (bestLag == 0)
+        return 0;
+    // the peak lies between the lags, interpolate it by a parabola
+    qreal lag = bestLag;
+    if (bestLag > minLag) {
+        const qreal l = score.at(bestLag - 1);
+        const qreal c = score.at(bestLag);
+        const qreal r = score.at(bestLag + 1);
+        const qreal denominator = l - 2 * c + r;
+        if (denominator < 0)
+            lag += 0.5 * (l - r) / denominator;
+    }
+    return 60 * envelopeRate / lag;
+}
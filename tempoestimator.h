@@ -0,0 +1,25 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __TEMPOESTIMATOR_H_
+#define __TEMPOESTIMATOR_H_
+
+#include "types.h"
+
+// Estimates the tempo of music from mono samples, e.g. those put out
+// by the Decimator. The onset strength, i.e. the rise of the loudness
+// in short frames, is autocorrelated, and the lag of the strongest
+// periodicity between MinBpm and MaxBpm is taken as the beat. Tempos
+// near 120 bpm are slightly preferred to avoid picking half or double
+// the tempo.
+class TempoEstimator
+{
+public:
+    static const int MinBpm = 60;
+    static const int MaxBpm = 180;
+
+    // returns 0 if the samples are too short to tell
+    static qreal estimate(const SampleBuffer &samples, int sampleRate);
+};
+
+#endif // __TEMPOESTIMATOR_H_
@@ -0,0 +1,296 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+# All rights reserved.
+
+# Writes the GIFs tst_gifdecoder checks GifDecoder against, and a PNG
+# of every frame as it must look once composited. The references are
+# composited here, independently of the decoder under test: the canvas
+# starts out transparent, disposal 2 clears the frame's rectangle to
+# transparent and disposal 3 restores what was there before. Every GIF
+# is decoded again with a decoder of its own before it is written.
+#
+# Run from this directory: python3 makegifs.py
+
+import random
+import struct
+import zlib
+
+TRANSPARENT = (0, 0, 0, 0)
+
+GLOBAL_PALETTE = [
+    (255, 255, 255), (255, 0, 0), (0, 255, 0), (0, 0, 255),
+    (255, 255, 0), (255, 0, 255), (0, 255, 255), (0, 0, 0),
+]
+LOCAL_PALETTE = [(255, 128, 0), (128, 128, 128), (0, 0, 128), (255, 192, 203)]
+
+
+class Frame:
+    def __init__(self, left, top, width, height, pixels, delay,
+                 disposal=0, transparent=None, palette=None, interlaced=False):
+        self.left = left
+        self.top = top
+        self.width = width
+        self.height = height
+        # palette indexes, row by row in display order
+        self.pixels = pixels
+        # in 1/100 s as stored in the file
+        self.delay = delay
+        self.disposal = disposal
+        self.transparent = transparent
+        # local color table, the global one if None
+        self.palette = palette
+        self.interlaced = interlaced
+
+
+def pattern(width, height, colors, seed, transparent=None):
+    rng = random.Random(seed)
+    pixels = []
+    for y in range(height):
+        for x in range(width):
+            # runs of a color, so that the LZW table fills with strings
+            c = ((x // 3) + y * 2 + seed) % colors
+            if rng.random() < 0.2:
+                c = rng.randrange(colors)
+            if transparent is not None and (x + y) % 4 == 0:
+                c = transparent
+            pixels.append(c)
+    return pixels
+
+
+def table_bits(palette):
+    bits = 0
+    while (2 << bits) < len(palette):
+        bits += 1
+    return bits
+
+
+def packed_palette(palette):
+    bits = table_bits(palette)
+    entries = list(palette) + [(0, 0, 0)] * ((2 << bits) - len(palette))
+    return bytes(c for rgb in entries for c in rgb), bits
+
+
+def lzw_encode(indexes, min_code_size):
+    clear = 1 << min_code_size
+    end = clear + 1
+    out = bytearray()
+    buffer = 0
+    count = 0
+
+    def emit(code, size):
+        nonlocal buffer, count
+        buffer |= code << count
+        count += size
+        while count >= 8:
+            out.append(buffer & 0xff)
+            buffer >>= 8
+            count -= 8
+
+    def reset():
+        return {(i,): i for i in range(clear)}, clear + 2, min_code_size + 1
+
+    table, next_code, code_size = reset()
+    emit(clear, code_size)
+    string = ()
+    for index in indexes:
+        extended = string + (index,)
+        if extended in table:
+            string = extended
+            continue
+        emit(table[string], code_size)
+        if next_code == 4096:
+            emit(clear, code_size)
+            table, next_code, code_size = reset()
+        else:
+            table[extended] = next_code
+            next_code += 1
+            # the decoder adds its entry one code later, so it widens
+            # its codes when the table is one past the current width
+            if next_code > (1 << code_size) and code_size < 12:
+                code_size += 1
+        string = (index,)
+    if string:
+        emit(table[string], code_size)
+    emit(end, code_size)
+    if count > 0:
+        out.append(buffer & 0xff)
+    return bytes(out)
+
+
+def lzw_decode(data, min_code_size, pixel_count):
+    clear = 1 << min_code_size
+    end = clear + 1
+    pos = 0
+    buffer = 0
+    count = 0
+    table = []
+    code_size = min_code_size + 1
+    previous = None
+    result = []
+    while len(result) < pixel_count:
+        while count < code_size:
+            buffer |= data[pos] << count
+            pos += 1
+            count += 8
+        code = buffer & ((1 << code_size) - 1)
+        buffer >>= code_size
+        count -= code_size
+        if code == clear:
+            table = [(i,) for i in range(clear)] + [None, None]
+            code_size = min_code_size + 1
+            previous = None
+            continue
+        if code == end:
+            break
+        if previous is None:
+            string = table[code]
+        elif code < len(table):
+            string = table[code]
+            table.append(previous + string[:1])
+        else:
+            assert code == len(table)
+            string = previous + previous[:1]
+            table.append(string)
+        if len(table) == (1 << code_size) and code_size < 12:
+            code_size += 1
+        result.extend(string)
+        previous = string
+    return result
+
+
+def interlace(pixels, width, height):
+    rows = [pixels[y * width:(y + 1) * width] for y in range(height)]
+    order = (list(range(0, height, 8)) + list(range(4, height, 8))
+             + list(range(2, height, 4)) + list(range(1, height, 2)))
+    return [p for y in order for p in rows[y]]
+
+
+def sub_blocks(data):
+    out = bytearray()
+    for i in range(0, len(data), 255):
+        chunk = data[i:i + 255]
+        out.append(len(chunk))
+        out += chunk
+    out.append(0)
+    return bytes(out)
+
+
+def write_gif(file_name, width, height, frames):
+    table, bits = packed_palette(GLOBAL_PALETTE)
+    gif = bytearray(b"GIF89a")
+    gif += struct.pack("<HHBBB", width, height, 0x80 | (7 << 4) | bits, 0, 0)
+    gif += table
+    # loop forever
+    gif += b"\x21\xff\x0bNETSCAPE2.0\x03\x01\x00\x00\x00"
+    for frame in frames:
+        flags = (frame.disposal << 2) | (1 if frame.transparent is not None else 0)
+        gif += struct.pack("<BBBBHBB", 0x21, 0xf9, 4, flags, frame.delay,
+                           frame.transparent or 0, 0)
+        palette = frame.palette or GLOBAL_PALETTE
+        flags = 0x40 if frame.interlaced else 0
+        local = b""
+        if frame.palette is not None:
+            local, local_bits = packed_palette(frame.palette)
+            flags |= 0x80 | local_bits
+        gif += struct.pack("<BHHHHB", 0x2c, frame.left, frame.top,
+                           frame.width, frame.height, flags)
+        gif += local
+        min_code_size = max(2, table_bits(palette) + 1)
+        stored = interlace(frame.pixels, frame.width, frame.height) if frame.interlaced else frame.pixels
+        data = lzw_encode(stored, min_code_size)
+        assert lzw_decode(data, min_code_size, len(stored)) == stored, file_name
+        gif.append(min_code_size)
+        gif += sub_blocks(data)
+    gif.append(0x3b)
+    with open(file_name, "wb") as f:
+        f.write(gif)
+
+
+def write_png(file_name, width, height, rgba):
+    raw = bytearray()
+    for y in range(height):
+        raw.append(0)
+        for p in rgba[y * width:(y + 1) * width]:
+            raw += bytes(p)
+
+    def chunk(tag, data):
+        return (struct.pack(">I", len(data)) + tag + data
+                + struct.pack(">I", zlib.crc32(tag + data) & 0xffffffff))
+
+    png = b"\x89PNG\r\n\x1a\n"
+    png += chunk(b"IHDR", struct.pack(">IIBBBBB", width, height, 8, 6, 0, 0, 0))
+    png += chunk(b"IDAT", zlib.compress(bytes(raw), 9))
+    png += chunk(b"IEND", b"")
+    with open(file_name, "wb") as f:
+        f.write(png)
+
+
+def composite(width, height, frames):
+    canvas = [TRANSPARENT] * (width * height)
+    images = []
+    for frame in frames:
+        palette = frame.palette or GLOBAL_PALETTE
+        inside = [(x, y)
+                  for y in range(frame.top, min(height, frame.top + frame.height))
+                  for x in range(frame.left, min(width, frame.left + frame.width))]
+        saved = {(x, y): canvas[y * width + x] for x, y in inside}
+        for x, y in inside:
+            index = frame.pixels[(y - frame.top) * frame.width + (x - frame.left)]
+            if index != frame.transparent:
+                canvas[y * width + x] = palette[index] + (255,)
+        images.append(list(canvas))
+        if frame.disposal == 2:
+            for x, y in inside:
+                canvas[y * width + x] = TRANSPARENT
+        elif frame.disposal == 3:
+            for x, y in inside:
+                canvas[y * width + x] = saved[(x, y)]
+    return images
+
+
+def make(name, width, height, frames):
+    write_gif(name + ".gif", width, height, frames)
+    for i, image in enumerate(composite(width, height, frames)):
+        write_png("%s-%d.png" % (name, i), width, height, image)
+
+
+def disposal_frames(disposal):
+    return [
+        Frame(0, 0, 20, 14, pattern(20, 14, 8, 1), 10, disposal),
+        Frame(3, 2, 10, 8, pattern(10, 8, 8, 2, transparent=0), 5, disposal, transparent=0),
+        Frame(8, 5, 9, 7, pattern(9, 7, 8, 3), 0, disposal),
+        Frame(1, 8, 6, 5, pattern(6, 5, 8, 4, transparent=7), 25, disposal, transparent=7),
+    ]
+
+
+def main():
+    for disposal, name in enumerate(["none", "keep", "background", "previous"]):
+        make("disposal-" + name, 20, 14, disposal_frames(disposal))
+    make("interlaced", 20, 14, [
+        Frame(0, 0, 20, 14, pattern(20, 14, 8, 5), 4),
+        # all four passes
+        Frame(2, 1, 16, 12, pattern(16, 12, 8, 6), 4, interlaced=True),
+        # only some of the passes have rows
+        Frame(0, 10, 20, 3, pattern(20, 3, 8, 7), 4, interlaced=True),
+        Frame(5, 0, 7, 1, pattern(7, 1, 8, 8), 4, interlaced=True),
+    ])
+    make("transparent", 20, 14, [
+        # leaves most of the canvas transparent
+        Frame(4, 4, 8, 6, pattern(8, 6, 8, 9), 7),
+        Frame(0, 0, 20, 14, pattern(20, 14, 8, 10, transparent=3), 7, 2, transparent=3),
+        Frame(6, 3, 10, 9, pattern(10, 9, 8, 11, transparent=5), 1, transparent=5),
+        Frame(0, 0, 20, 14, [2] * (20 * 14), 7, transparent=2),
+    ])
+    rng = random.Random(12)
+    big_palette = [(rng.randrange(256), rng.randrange(256), rng.randrange(256)) for _ in range(256)]
+    make("local-palette", 100, 60, [
+        Frame(0, 0, 100, 60, pattern(100, 60, 8, 13), 10),
+        Frame(10, 5, 30, 20, pattern(30, 20, 4, 14), 10, palette=LOCAL_PALETTE),
+        Frame(20, 10, 40, 30, pattern(40, 30, 8, 15, transparent=1), 10, transparent=1),
+        # random indexes fill the LZW table, which gets cleared on the way
+        Frame(0, 0, 100, 60, [rng.randrange(256) for _ in range(100 * 60)], 10, palette=big_palette),
+    ])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,16 @@
+# Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+# All rights reserved.
+
+QT       += core gui testlib
+
+TARGET = tst_gifdecoder
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += tst_gifdecoder.cpp \
+    ../../gifdecoder.cpp
+
+HEADERS += ../../gifdecoder.h
@@ -0,0 +1,157 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QtTest>
+#include <QMovie>
+#include <QImage>
+
+#include "gifdecoder.h"
+
+
+// Compares the frames GifDecoder composites from the GIFs in data with
+// the reference images next to them, which makegifs.py has written
+// along with the GIFs. Also decodes all frames of the sample GIF with
+// GifDecoder and with QMovie, which the frame extractor used before.
+// Run with e.g. -iterations 10 for stable numbers.
+class TestGifDecoder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase(void);
+    void composite_data(void);
+    void composite(void);
+    void frames(void);
+    void benchmarkGifDecoder(void);
+    void benchmarkQMovie(void);
+
+private:
+    QString mFileName;
+};
+
+
+void TestGifDecoder::initTestCase(void)
+{
+    mFileName = QFINDTESTDATA("../../deploy/sampledata/cat-on-treadmill.gif");
+    QVERIFY(!mFileName.isEmpty());
+}
+
+
+// describes the first pixel in which the images differ, empty if none
+static QString firstDifference(const QImage &image, const QImage &reference)
+{
+    if (image.size() != reference.size())
+        return QString("%1x%2 instead of %3x%4")
+                .arg(image.width()).arg(image.height())
+                .arg(reference.width()).arg(reference.height());
+    for (int y = 0; y < image.height(); ++y) {
+        const QRgb *a = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        const QRgb *b = reinterpret_cast<const QRgb*>(reference.constScanLine(y));
+        for (int x = 0; x < image.width(); ++x)
+            if (a[x] != b[x])
+                return QString("pixel (%1, %2) is #%3 instead of #%4")
+                        .arg(x).arg(y)
+                        .arg(a[x], 8, 16, QChar('0'))
+                        .arg(b[x], 8, 16, QChar('0'));
+    }
+    return QString();
+}
+
+
+void TestGifDecoder::composite_data(void)
+{
+    QTest::addColumn<QString>("name");
+    // delays of 10 ms or less are read as 100 ms
+    QTest::addColumn<QVector<int> >("delays");
+    const QVector<int> &disposalDelays = QVector<int>() << 100 << 50 << 100 << 250;
+    QTest::newRow("disposal none") << "disposal-none" << disposalDelays;
+    QTest::newRow("disposal keep") << "disposal-keep" << disposalDelays;
+    QTest::newRow("disposal background") << "disposal-background" << disposalDelays;
+    QTest::newRow("disposal previous") << "disposal-previous" << disposalDelays;
+    QTest::newRow("interlaced") << "interlaced" << (QVector<int>() << 40 << 40 << 40 << 40);
+    QTest::newRow("transparent") << "transparent" << (QVector<int>() << 70 << 70 << 100 << 70);
+    QTest::newRow("local palette") << "local-palette" << (QVector<int>() << 100 << 100 << 100 << 100);
+}
+
+
+void TestGifDecoder::composite(void)
+{
+    QFETCH(QString, name);
+    QFETCH(QVector<int>, delays);
+    const QString &fileName = QFINDTESTDATA("data/" + name + ".gif");
+    QVERIFY(!fileName.isEmpty());
+    GifDecoder decoder;
+    QVERIFY(decoder.open(fileName));
+    QCOMPARE(decoder.frameCount(), delays.count());
+    QCOMPARE(decoder.delays(), delays);
+    QCOMPARE(decoder.loopCount(), 0);
+    QList<QImage> references;
+    for (int i = 0; i < decoder.frameCount(); ++i) {
+        const QImage reference(QFINDTESTDATA(QString("data/%1-%2.png").arg(name).arg(i)));
+        QVERIFY(!reference.isNull());
+        references.append(reference.convertToFormat(QImage::Format_ARGB32));
+    }
+    for (int i = 0; i < decoder.frameCount(); ++i) {
+        const QImage &image = decoder.read();
+        QCOMPARE(image.format(), QImage::Format_ARGB32);
+        const QString &difference = firstDifference(image, references.at(i));
+        QVERIFY2(difference.isEmpty(), qPrintable(QString("frame %1: %2").arg(i).arg(difference)));
+    }
+    QVERIFY(decoder.read().isNull());
+    // random access from the checkpoints, backwards
+    for (int i = decoder.frameCount() - 1; i >= 0; --i) {
+        const QString &difference = firstDifference(decoder.frame(i), references.at(i));
+        QVERIFY2(difference.isEmpty(), qPrintable(QString("frame(%1): %2").arg(i).arg(difference)));
+    }
+}
+
+
+void TestGifDecoder::frames(void)
+{
+    GifDecoder decoder;
+    QVERIFY(decoder.open(mFileName));
+    QMovie movie(mFileName);
+    QVERIFY(movie.isValid());
+    QCOMPARE(decoder.frameCount(), movie.frameCount());
+    QCOMPARE(decoder.size(), movie.frameRect().size());
+    // frame() resumes from the nearest checkpoint
+    const QImage &last = decoder.frame(decoder.frameCount() - 1);
+    decoder.rewind();
+    QImage image;
+    for (int i = 0; i < decoder.frameCount(); ++i)
+        image = decoder.read();
+    QCOMPARE(image, last);
+    QVERIFY(decoder.read().isNull());
+}
+
+
+void TestGifDecoder::benchmarkGifDecoder(void)
+{
+    QBENCHMARK {
+        GifDecoder decoder;
+        QVERIFY(decoder.open(mFileName));
+        int frames = 0;
+        while (!decoder.read().isNull())
+            ++frames;
+        QCOMPARE(frames, decoder.frameCount());
+    }
+}
+
+
+void TestGifDecoder::benchmarkQMovie(void)
+{
+    QBENCHMARK {
+        QMovie movie(mFileName);
+        QVERIFY(movie.isValid());
+        // jumpToNextFrame() starts over after the last frame of a loop
+        for (int i = 0; i < movie.frameCount(); ++i) {
+            QVERIFY(i == 0 ? movie.jumpToFrame(0) : movie.jumpToNextFrame());
+            // the composited frame, like GifDecoder::read() returns it
+            QVERIFY(!movie.currentImage().isNull());
+        }
+    }
+}
+
+
+QTEST_MAIN(TestGifDecoder)
+#include "tst_gifdecoder.moc"
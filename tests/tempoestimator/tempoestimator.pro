@@ -0,0 +1,18 @@
+# Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+# All rights reserved.
+
+QT       += core testlib
+QT       -= gui
+
+TARGET = tst_tempoestimator
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += tst_tempoestimator.cpp \
+    ../../tempoestimator.cpp
+
+HEADERS += ../../tempoestimator.h \
+    ../../types.h
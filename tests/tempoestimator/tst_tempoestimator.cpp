@@ -0,0 +1,70 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QtTest>
+#include <qmath.h>
+
+#include "tempoestimator.h"
+
+// the rate the Decimator puts out
+static const int SampleRate = 11025;
+
+
+// Estimates the tempo of click tracks whose tempo is known.
+class TestTempoEstimator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void clickTrack_data(void);
+    void clickTrack(void);
+    void tooShort(void);
+
+private:
+    static SampleBuffer clicks(qreal bpm, int seconds);
+};
+
+
+// 10 ms bursts of a decaying 1 kHz tone on every beat, silence between
+SampleBuffer TestTempoEstimator::clicks(qreal bpm, int seconds)
+{
+    SampleBuffer samples(SampleRate * seconds, 0);
+    const qreal period = 60 * SampleRate / bpm;
+    const int clickLength = SampleRate / 100;
+    for (int beat = 0; qRound(beat * period) < samples.size(); ++beat) {
+        const int start = qRound(beat * period);
+        for (int i = 0; i < clickLength && start + i < samples.size(); ++i)
+            samples[start + i] = SampleBufferType(16000 * qExp(-400.0 * i / SampleRate) * qSin(2 * M_PI * 1000 * i / SampleRate));
+    }
+    return samples;
+}
+
+
+void TestTempoEstimator::clickTrack_data(void)
+{
+    QTest::addColumn<qreal>("bpm");
+    QTest::newRow("lowest") << qreal(TempoEstimator::MinBpm);
+    QTest::newRow("75") << qreal(75);
+    QTest::newRow("100") << qreal(100);
+    QTest::newRow("120") << qreal(120);
+    QTest::newRow("150") << qreal(150);
+    QTest::newRow("highest") << qreal(TempoEstimator::MaxBpm);
+}
+
+
+void TestTempoEstimator::clickTrack(void)
+{
+    QFETCH(qreal, bpm);
+    const qreal estimated = TempoEstimator::estimate(clicks(bpm, 20), SampleRate);
+    QVERIFY2(qAbs(estimated - bpm) < 1, qPrintable(QString("%1 bpm estimated").arg(estimated)));
+}
+
+
+void TestTempoEstimator::tooShort(void)
+{
+    QCOMPARE(TempoEstimator::estimate(clicks(120, 2), SampleRate), qreal(0));
+}
+
+
+QTEST_APPLESS_MAIN(TestTempoEstimator)
+#include "tst_tempoestimator.moc"
@@ -0,0 +1,7 @@
+# Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+# All rights reserved.
+
+TEMPLATE = subdirs
+
+SUBDIRS += gifdecoder \
+    tempoestimator
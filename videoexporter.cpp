@@ -0,0 +1,1066 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QStandardPaths>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+#include <QTime>
+#include <QtConcurrent>
+#include <QtCore/QDebug>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "videoexporter.h"
+#include "framestore.h"
+#include "framescheduler.h"
+#include "frameextractor.h"
+#include "framestreamer.h"
+#include "segmentencoder.h"
+#include "audiocache.h"
+#include "main.h"
+
+// upper limit for the number of input files of a concatenation
+static const int MaxLoopChunkCopies = 64;
+// the subtitle is shown from 11 to 1 seconds before the end
+static const qint64 SubtitleLead = 11 * 1000;
+static const qint64 SubtitleTrail = 1 * 1000;
+// milliseconds between two progress reports written to the log
+static const qint64 LogInterval = 1000;
+static const char *PresetNames[] = { "ultrafast", "veryfast", "balanced", "hq" };
+
+static QAtomicInt instanceCount;
+
+
+// writes the files of a range of the frame sequence to a list in the
+// format the encoder reads
+static bool writeFrameList(const EncoderBackend *encoder, const QString &fileName, const QStringList &frameFiles, const QVector<int> &sequence, int begin, int end, qreal fps)
+{
+    QFile frameFileList(fileName);
+    if (!frameFileList.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    QStringList files;
+    for (int i = begin; i < end; ++i)
+        files.append(frameFiles.at(sequence.at(i)));
+    frameFileList.write(encoder->frameList(files, fps));
+    frameFileList.close();
+    return true;
+}
+
+
+// Gives the file from the second name to, which takes neither time nor
+// space, or returns false if the file system can't do that.
+static bool linkFile(const QString &from, const QString &to)
+{
+#ifdef WIN32
+    return CreateHardLinkW((LPCWSTR)to.utf16(), (LPCWSTR)from.utf16(), NULL) != 0;
+#else
+    return ::link(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#endif
+}
+
+
+static bool copyFile(const QString &from, const QString &to)
+{
+    return QFile::copy(from, to);
+}
+
+
+static void lowerPriority(QProcess *process)
+{
+    // 0 would mean this process
+    if (!process->pid())
+        return;
+#ifdef WIN32
+    SetPriorityClass(process->pid()->hProcess, IDLE_PRIORITY_CLASS);
+#else
+    setpriority(PRIO_PROCESS, process->pid(), 19);
+#endif
+}
+
+
+// The part of starting an export that runs in the background: the
+// frames are scaled to the video size and written to files if the
+// encoder reads them from there, or converted to YUV if it's fed with
+// a stream, and the music is hashed for the audio cache.
+struct FramePreparation {
+    FramePreparation(void)
+        : resizer(nullptr)
+        , keepFiles(false)
+        , convert(false)
+        , audioBitrate(0)
+        , canceled(nullptr)
+        , writeErrors(0)
+    { /* ... */ }
+    QSharedPointer<const FrameStore> frames;
+    // one per frame, replaced by the written files
+    QStringList frameFiles;
+    // scales the frames if set
+    const ImageResizer *resizer;
+    // the distinct frames in the video size are written to these
+    QStringList uniqueFiles;
+    // the unique files are the frame files, only missing ones are written
+    bool keepFiles;
+    // fills the store's YUV frames, which the streamers share
+    bool convert;
+    // the music to look up in the audio cache, none if empty
+    QString audioFile;
+    QString audioFormat;
+    int audioBitrate;
+    const volatile bool *canceled;
+    QSharedPointer<const FrameStore> outputFrames;
+    QString audioKey;
+    int writeErrors;
+};
+
+
+static FramePreparation prepareFrames(FramePreparation job)
+{
+    job.outputFrames = (job.resizer != nullptr) ? job.resizer->resize(job.frames) : job.frames;
+    if (job.convert && !*job.canceled)
+        job.outputFrames->i420Frames();
+    if (!job.audioFile.isEmpty() && !*job.canceled)
+        job.audioKey = AudioCache::key(job.audioFile, job.audioFormat, job.audioBitrate);
+    if (job.uniqueFiles.isEmpty() || *job.canceled)
+        return job;
+    if (job.keepFiles) {
+        // an extraction without writing leaves the files to the export
+        QStringList missingFiles = job.uniqueFiles;
+        for (int i = 0; i < missingFiles.count(); ++i)
+            if (QFileInfo(missingFiles.at(i)).exists())
+                missingFiles[i].clear();
+        job.writeErrors = FrameExtractor::writeFrames(*job.outputFrames, missingFiles);
+        return job;
+    }
+    job.writeErrors = FrameExtractor::writeFrames(*job.outputFrames, job.uniqueFiles);
+    job.frameFiles.clear();
+    foreach (int unique, job.outputFrames->uniqueIndexes())
+        job.frameFiles.append(job.uniqueFiles.at(unique));
+    return job;
+}
+
+
+// identifies the video stream of an export, everything but the audio
+static QByteArray videoFingerprint(const EncoderBackend *encoder, const EncoderParams &params, const ExportOptions &options, const QVector<int> &sequence, int framesNeeded)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << encoder->name() << encoder->executable()
+           << QFileInfo(options.outputFile).suffix().toLower()
+           << params.size << params.fps << int(params.preset) << int(params.codec) << params.extraOptions
+           << int(options.resizeFilter) << options.loopExport
+           << sequence << framesNeeded;
+    // the subtitles are burnt into the video
+    if (!params.subtitleFile.isEmpty())
+        stream << options.subtitleText << options.subtitleFont << options.duration;
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+
+static QString srtTime(const QTime &t)
+{
+    return QString("%1:%2:%3,000")
+            .arg(t.hour(), 2, 10, QChar('0'))
+            .arg(t.minute(), 2, 10, QChar('0'))
+            .arg(t.second(), 2, 10, QChar('0'));
+}
+
+
+QString ExportProgress::toString(void) const
+{
+    QString text = QCoreApplication::translate("VideoExporter", "Encoding pass %1/%2: %3 of %4 frames")
+            .arg(pass).arg(passes).arg(frames).arg(totalFrames);
+    if (fps > 0)
+        text += QCoreApplication::translate("VideoExporter", ", %1 fps").arg(fps, 0, 'f', 1);
+    if (bitrate > 0)
+        text += QCoreApplication::translate("VideoExporter", ", %1 kbit/s").arg(qRound(bitrate));
+    if (remaining >= 0) {
+        const QTime &t = QTime::fromMSecsSinceStartOfDay(int(qMin<qint64>(remaining, 24 * 3600 * 1000 - 1)));
+        text += QCoreApplication::translate("VideoExporter", ", %1 left").arg(t.toString(t.hour() > 0 ? "h:mm:ss" : "m:ss"));
+    }
+    return text;
+}
+
+
+// what start() works out for the encoders
+struct ExportPlan {
+    ExportPlan(void)
+        : framesToEncode(0)
+        , chunkCopies(1)
+        , cycles(0)
+        , period(0)
+        , nSegments(1)
+        , loopExport(false)
+        , remux(false)
+    { /* ... */ }
+    QVector<int> sequence;
+    EncoderParams params;
+    int framesToEncode;
+    int chunkCopies;
+    int cycles;
+    int period;
+    int nSegments;
+    bool loopExport;
+    bool remux;
+};
+
+
+class VideoExporterPrivate {
+public:
+    VideoExporterPrivate(void)
+        : encoder(nullptr)
+        , scheduler(nullptr)
+        , process(nullptr)
+        , frameStreamer(nullptr)
+        , muxPending(false)
+        , audioCache(nullptr)
+        , audioEncoder(nullptr)
+        , audioProcess(nullptr)
+        , waitingForAudio(false)
+        , running(false)
+        , framesNeeded(0)
+        , pass(1)
+        , passes(1)
+        , passFrames(0)
+        , segmented(false)
+        , prepareCanceled(false)
+        , instance(instanceCount.fetchAndAddRelaxed(1))
+    { /* ... */ }
+    EncoderBackend *encoder;
+    const FrameScheduler *scheduler;
+    ExportOptions options;
+    QSharedPointer<const FrameStore> frames;
+    QStringList frameFiles;
+    // keeps the filter weights as long as the sizes stay the same
+    ImageResizer resizer;
+    SegmentEncoder segmentEncoder;
+    QProcess *process;
+    FrameStreamer *frameStreamer;
+    // the last pass of segmented and loop export joins the video
+    // streams and adds the audio
+    bool muxPending;
+    QStringList muxInputs;
+    QString muxListFile;
+    EncoderParams muxParams;
+    AudioCache *audioCache;
+    EncoderBackend *audioEncoder;
+    // encodes the audio into the cache while the video is encoded
+    QProcess *audioProcess;
+    QString audioKey;
+    QString audioFormat;
+    QString audioStaging;
+    // the encoded audio from the cache, empty if there is none
+    QString cachedAudio;
+    // the video is done, but the audio is still being encoded
+    bool waitingForAudio;
+    // the video of the last export and what it has been made of
+    QString lastVideoFile;
+    QByteArray lastVideoFingerprint;
+    QWeakPointer<const FrameStore> lastVideoFrames;
+    // the output file the last video is a hard link of, if it is one
+    QString lastVideoLink;
+    // copies the last video where it can't be linked
+    QFutureWatcher<bool> keepWatcher;
+    QByteArray keepFingerprint;
+    // of the video being encoded, empty while remuxing
+    QByteArray fingerprint;
+    QStringList tempFiles;
+    QString errorString;
+    bool running;
+    // progress reports of the encoder process
+    EncoderOutputReader reader;
+    QElapsedTimer clock;
+    QElapsedTimer passClock;
+    QElapsedTimer logClock;
+    int framesNeeded;
+    int pass;
+    int passes;
+    int passFrames;
+    // true while the segments are being encoded
+    bool segmented;
+    ExportProgress lastReport;
+    // what start() has worked out for startEncoding()
+    ExportPlan plan;
+    // the frames are prepared in the background before the encoders start
+    QFutureWatcher<FramePreparation> prepareWatcher;
+    volatile bool prepareCanceled;
+    // tells apart the temporary files of the exporters in a process
+    const int instance;
+};
+
+
+VideoExporter::VideoExporter(QObject *parent)
+    : QObject(parent)
+    , d_ptr(new VideoExporterPrivate)
+{
+    Q_D(VideoExporter);
+    QObject::connect(&d->segmentEncoder, SIGNAL(output(QString)), SIGNAL(output(QString)));
+    QObject::connect(&d->segmentEncoder, SIGNAL(progress(int, int)), SLOT(segmentProgress(int, int)));
+    QObject::connect(&d->segmentEncoder, SIGNAL(finished(bool)), SLOT(segmentsFinished(bool)));
+    QObject::connect(&d->prepareWatcher, SIGNAL(finished()), SLOT(framesPrepared()));
+    QObject::connect(&d->keepWatcher, SIGNAL(finished()), SLOT(videoKept()));
+}
+
+
+VideoExporter::~VideoExporter()
+{
+    cancel();
+    d_ptr->keepWatcher.waitForFinished();
+    if (!d_ptr->lastVideoFile.isEmpty())
+        QFile::remove(d_ptr->lastVideoFile);
+}
+
+
+QString VideoExporter::defaultProgressLogFile(void)
+{
+    const QString &directory = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
+    QDir().mkpath(directory);
+    return directory + "/encoding-log.tsv";
+}
+
+
+void VideoExporter::setEncoder(EncoderBackend *encoder)
+{
+    d_ptr->encoder = encoder;
+}
+
+
+EncoderBackend *VideoExporter::encoder(void) const
+{
+    return d_ptr->encoder;
+}
+
+
+void VideoExporter::setAudioCache(AudioCache *cache)
+{
+    d_ptr->audioCache = cache;
+}
+
+
+void VideoExporter::setAudioEncoder(EncoderBackend *encoder)
+{
+    d_ptr->audioEncoder = encoder;
+}
+
+
+void VideoExporter::setFrames(QSharedPointer<const FrameStore> frames, const QStringList &frameFiles)
+{
+    Q_D(VideoExporter);
+    d->frames = frames;
+    d->frameFiles = frameFiles;
+}
+
+
+void VideoExporter::setScheduler(const FrameScheduler *scheduler)
+{
+    d_ptr->scheduler = scheduler;
+}
+
+
+void VideoExporter::setOptions(const ExportOptions &options)
+{
+    d_ptr->options = options;
+}
+
+
+const ExportOptions &VideoExporter::options(void) const
+{
+    return d_ptr->options;
+}
+
+
+int VideoExporter::frameCount(void) const
+{
+    Q_D(const VideoExporter);
+    if (d->scheduler == nullptr)
+        return 0;
+    const qreal duration = d->options.duration > 0 ? 1e-3 * d->options.duration : 1;
+    return qRound(d->scheduler->fps() * duration);
+}
+
+
+bool VideoExporter::isRunning(void) const
+{
+    return d_ptr->running;
+}
+
+
+QString VideoExporter::errorString(void) const
+{
+    return d_ptr->errorString;
+}
+
+
+QString VideoExporter::tempFileName(const QString &name) const
+{
+    return d_ptr->options.tempDirectory + "/" + AppName +
+            QString("-%1-%2-").arg(QCoreApplication::applicationPid()).arg(d_ptr->instance) + name;
+}
+
+
+bool VideoExporter::writeSubtitles(const QString &fileName)
+{
+    Q_D(VideoExporter);
+    QFile subtitleFile(fileName);
+    if (!subtitleFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    const QTime &subStartTime = QTime::fromMSecsSinceStartOfDay(d->options.duration - SubtitleLead);
+    const QTime &subEndTime = QTime::fromMSecsSinceStartOfDay(d->options.duration - SubtitleTrail);
+    subtitleFile.write("1\n");
+    subtitleFile.write(QString("%1 --> %2\n")
+                       .arg(srtTime(subStartTime))
+                       .arg(srtTime(subEndTime))
+                       .toLocal8Bit());
+    subtitleFile.write(d->options.subtitleText.toLocal8Bit());
+    subtitleFile.close();
+    d->tempFiles.append(fileName);
+    return true;
+}
+
+
+bool VideoExporter::start(void)
+{
+    Q_D(VideoExporter);
+    if (d->running) {
+        d->errorString = tr("A video is being encoded already.");
+        return false;
+    }
+    if (d->encoder == nullptr || !d->encoder->isAvailable()) {
+        d->errorString = d->encoder == nullptr
+                ? tr("No encoder chosen.")
+                : tr("%1 could not be run from \"%2\".")
+                  .arg(d->encoder->name())
+                  .arg(d->encoder->executable());
+        return false;
+    }
+    if (d->frames.isNull() || d->frames->frameCount() == 0 || d->scheduler == nullptr) {
+        d->errorString = tr("There are no frames to encode.");
+        return false;
+    }
+    const ExportOptions &o = d->options;
+    // the last video may still be copied from the file about to be
+    // overwritten
+    if (d->keepWatcher.isRunning()) {
+        d->keepWatcher.waitForFinished();
+        videoKept();
+    }
+    // the encoder would overwrite a hard link of the last video in place
+    if (!d->lastVideoLink.isEmpty() && QFileInfo(d->lastVideoLink) == QFileInfo(o.outputFile))
+        QFile::remove(o.outputFile);
+    d->lastVideoLink.clear();
+    d->errorString.clear();
+    d->tempFiles.clear();
+    d->muxPending = false;
+    d->waitingForAudio = false;
+    const qreal fps = d->scheduler->fps();
+    const int framesNeeded = frameCount();
+    const QString &subtitleFile = tempFileName("subtitles.srt");
+    const bool addSubtitles = !o.subtitleText.isEmpty() && o.duration > SubtitleLead && writeSubtitles(subtitleFile);
+    // the schedule repeats with every beat
+    const int period = d->scheduler->framesPerBeat();
+    // In loop mode only a whole number of beats gets encoded. The full
+    // length video is then concatenated from copies of that chunk
+    // without re-encoding. Burnt-in subtitles need a full encode.
+    const bool loopExport = o.loopExport && !addSubtitles && framesNeeded > period;
+    int framesToEncode = framesNeeded;
+    int chunkCopies = 1;
+    if (loopExport) {
+        const int cycles = (framesNeeded + period - 1) / period;
+        const int cyclesPerChunk = (cycles + MaxLoopChunkCopies - 1) / MaxLoopChunkCopies;
+        chunkCopies = (cycles + cyclesPerChunk - 1) / cyclesPerChunk;
+        framesToEncode = cyclesPerChunk * period;
+    }
+    const QVector<int> &sequence = d->scheduler->schedule(framesToEncode, o.frameOffset);
+    // Without loop export the video is split at beat boundaries into
+    // segments which are encoded at the same time and then joined
+    // without re-encoding.
+    const int cycles = (framesToEncode + period - 1) / period;
+    const int nSegments = (!loopExport && o.segmentedExport)
+            ? qBound(1, QThread::idealThreadCount(), cycles)
+            : 1;
+    const QSize &outputSize = ImageResizer::fit(d->frames->size(), o.outputSize);
+    EncoderParams params;
+    params.size = outputSize;
+    params.fps = fps;
+    params.threads = o.threads > 0 ? o.threads : QThread::idealThreadCount();
+    params.preset = o.preset;
+    params.codec = o.codec;
+    params.audioBitrate = o.audioBitrate;
+    params.extraOptions = o.extraOptions;
+    if (addSubtitles) {
+        params.subtitleFile = subtitleFile;
+        params.subtitleFont = o.subtitleFont;
+    }
+    // the video of the last export is remuxed with the new audio if
+    // everything else is the same
+    d->fingerprint.clear();
+    bool remux = false;
+    if (o.reuseVideo) {
+        d->fingerprint = videoFingerprint(d->encoder, params, o, sequence, framesNeeded);
+        remux = d->fingerprint == d->lastVideoFingerprint
+                && d->lastVideoFrames.toStrongRef() == d->frames
+                && QFileInfo(d->lastVideoFile).size() > 0;
+    }
+    ExportPlan &plan = d->plan;
+    plan.sequence = sequence;
+    plan.params = params;
+    plan.framesToEncode = framesToEncode;
+    plan.chunkCopies = chunkCopies;
+    plan.cycles = cycles;
+    plan.period = period;
+    plan.nSegments = nSegments;
+    plan.loopExport = loopExport;
+    plan.remux = remux;
+    d->framesNeeded = framesNeeded;
+    // the frames are scaled to the video size in memory and written
+    // if needed, which takes too long for the calling thread
+    FramePreparation job;
+    job.frames = d->frames;
+    job.frameFiles = d->frameFiles;
+    job.canceled = &d->prepareCanceled;
+    if (!remux && outputSize != d->frames->size()) {
+        d->resizer.setFilter(o.resizeFilter);
+        d->resizer.setSize(d->frames->size(), outputSize);
+        job.resizer = &d->resizer;
+    }
+    // frames which aren't on disk in the video size yet are written
+    if (!o.streamFrames && !remux && (job.resizer != nullptr || d->frameFiles.count() != d->frames->frameCount())) {
+        for (int i = 0; i < d->frames->uniqueFrameCount(); ++i)
+            job.uniqueFiles.append(tempFileName(QString("frame-%1.png").arg(i, 4, 10, QChar('0'))));
+        d->tempFiles.append(job.uniqueFiles);
+    }
+    else if (!o.streamFrames && !remux) {
+        job.keepFiles = true;
+        for (int i = 0; i < d->frames->uniqueFrameCount(); ++i)
+            job.uniqueFiles.append(QString());
+        for (int i = 0; i < d->frameFiles.count(); ++i)
+            job.uniqueFiles[d->frames->uniqueIndexes().at(i)] = d->frameFiles.at(i);
+    }
+    job.convert = o.streamFrames && !remux;
+    d->audioFormat.clear();
+    d->audioKey.clear();
+    if (!o.audioFile.isEmpty() && d->audioCache != nullptr && d->audioCache->isEnabled()) {
+        EncoderParams audioParams = params;
+        audioParams.audioFile = o.audioFile;
+        audioParams.outputFile = o.outputFile;
+        d->audioFormat = d->encoder->audioFormat(audioParams);
+        if (!d->audioFormat.isEmpty()) {
+            job.audioFile = o.audioFile;
+            job.audioFormat = d->audioFormat;
+            job.audioBitrate = o.audioBitrate;
+        }
+    }
+    d->running = true;
+    d->prepareCanceled = false;
+    d->lastReport = ExportProgress();
+    d->clock.start();
+    d->prepareWatcher.setFuture(QtConcurrent::run(prepareFrames, job));
+    return true;
+}
+
+
+void VideoExporter::framesPrepared(void)
+{
+    Q_D(VideoExporter);
+    if (!d->running || d->prepareCanceled)
+        return;
+    const FramePreparation &prepared = d->prepareWatcher.result();
+    if (prepared.writeErrors > 0) {
+        d->errorString = tr("%1 frames could not be written to %2").arg(prepared.writeErrors).arg(d->options.tempDirectory);
+        finish(false);
+        return;
+    }
+    d->audioKey = prepared.audioKey;
+    startEncoding(prepared.outputFrames, prepared.frameFiles);
+}
+
+
+void VideoExporter::startEncoding(QSharedPointer<const FrameStore> outputFrames, const QStringList &frameFiles)
+{
+    Q_D(VideoExporter);
+    const ExportOptions &o = d->options;
+    const ExportPlan &plan = d->plan;
+    const QVector<int> &sequence = plan.sequence;
+    const int framesNeeded = d->framesNeeded;
+    const int framesToEncode = plan.framesToEncode;
+    const int period = plan.period;
+    const int cycles = plan.cycles;
+    const int nSegments = plan.nSegments;
+    const qreal fps = plan.params.fps;
+    EncoderParams params = plan.params;
+    if (!o.streamFrames && !plan.remux && nSegments == 1) {
+        params.frameListFile = tempFileName("list.txt");
+        params.frames = sequence.size();
+        d->tempFiles.append(params.frameListFile);
+        if (!writeFrameList(d->encoder, params.frameListFile, frameFiles, sequence, 0, sequence.size(), fps)) {
+            d->errorString = tr("The list of frames could not be written to %1").arg(o.tempDirectory);
+            finish(false);
+            return;
+        }
+    }
+    // the last pass of segmented and loop export joins the video
+    // streams and adds the audio
+    EncoderParams &muxParams = d->muxParams;
+    muxParams = params;
+    muxParams.frames = framesNeeded;
+    muxParams.audioFile = o.audioFile;
+    muxParams.subtitleFile.clear();
+    muxParams.outputFile = o.outputFile;
+    d->muxListFile = tempFileName("concat.txt");
+    d->tempFiles.append(d->muxListFile);
+    startAudio(muxParams);
+    d->process = new QProcess;
+    QObject::connect(d->process, SIGNAL(readyReadStandardOutput()), SLOT(processOutput()));
+    QObject::connect(d->process, SIGNAL(readyReadStandardError()), SLOT(processOutput()));
+    QObject::connect(d->process, SIGNAL(finished(int, QProcess::ExitStatus)), SLOT(processFinished(int, QProcess::ExitStatus)));
+    d->reader = EncoderOutputReader(d->encoder);
+    d->pass = 1;
+    d->passes = (nSegments > 1 || plan.loopExport) ? 2 : 1;
+    d->passFrames = framesToEncode;
+    d->segmented = nSegments > 1;
+    d->passClock.start();
+    d->logClock.invalidate();
+    if (plan.remux) {
+        emit output(tr("Only the audio has changed, remuxing the last video ..."));
+        d->fingerprint.clear();
+        d->pass = 0;
+        d->passes = 1;
+        d->muxInputs = QStringList(d->lastVideoFile);
+        d->muxPending = true;
+        videoFinished(true);
+        return;
+    }
+    if (nSegments > 1) {
+        d->segmentEncoder.clear();
+        d->segmentEncoder.setEncoder(d->encoder);
+        d->segmentEncoder.setFrames(outputFrames, fps);
+        QStringList segmentFiles;
+        const QString &suffix = QFileInfo(o.outputFile).suffix();
+        for (int s = 0; s < nSegments; ++s) {
+            const int begin = (cycles * s / nSegments) * period;
+            const int end = qMin(framesToEncode, (cycles * (s + 1) / nSegments) * period);
+            EncoderParams segmentParams = params;
+            // the cores are shared among the segment encoders
+            segmentParams.threads = qMax(1, params.threads / nSegments);
+            if (!o.streamFrames) {
+                segmentParams.frameListFile = tempFileName(QString("list-%1.txt").arg(s));
+                segmentParams.frames = end - begin;
+                d->tempFiles.append(segmentParams.frameListFile);
+                if (!writeFrameList(d->encoder, segmentParams.frameListFile, frameFiles, sequence, begin, end, fps)) {
+                    d->errorString = tr("The list of frames could not be written to %1").arg(o.tempDirectory);
+                    d->segmentEncoder.clear();
+                    finish(false);
+                    return;
+                }
+            }
+            segmentFiles.append(tempFileName(QString("segment-%1.%2").arg(s).arg(suffix)));
+            segmentParams.outputFile = segmentFiles.last();
+            // the subtitles are timed relative to the whole video
+            segmentParams.subtitleDelay = -begin / fps;
+            d->segmentEncoder.addSegment(d->encoder->encodeCommand(segmentParams), sequence.mid(begin, end - begin), o.streamFrames);
+        }
+        d->tempFiles.append(segmentFiles);
+        d->muxInputs = segmentFiles;
+        d->muxPending = true;
+        emit output(tr("Encoding %1 segments in parallel ...").arg(nSegments));
+        d->segmentEncoder.start();
+        return;
+    }
+    if (plan.loopExport) {
+        // first pass: video only, second pass: concatenation and audio
+        params.outputFile = tempFileName("loop." + QFileInfo(o.outputFile).suffix());
+        d->tempFiles.append(params.outputFile);
+        d->muxInputs.clear();
+        for (int i = 0; i < plan.chunkCopies; ++i)
+            d->muxInputs.append(params.outputFile);
+        d->muxPending = true;
+    }
+    else {
+        params.audioFile = d->cachedAudio.isEmpty() ? o.audioFile : d->cachedAudio;
+        params.audioEncoded = !d->cachedAudio.isEmpty();
+        params.outputFile = o.outputFile;
+        // the video isn't joined with others
+        params.dropDuplicates = true;
+    }
+    if (o.streamFrames) {
+        d->frameStreamer = new FrameStreamer(d->process);
+        d->frameStreamer->setFrames(outputFrames);
+        d->frameStreamer->setSequence(sequence);
+        d->frameStreamer->setFrameRate(fps);
+        QObject::connect(d->frameStreamer, SIGNAL(progress(int, int)), SLOT(streamProgress(int, int)));
+    }
+    runCommand(d->encoder->encodeCommand(params));
+}
+
+
+void VideoExporter::runCommand(const EncoderCommand &command)
+{
+    emit output(command.toString());
+    d_ptr->process->start(command.program, command.arguments);
+    if (d_ptr->options.lowPriority)
+        lowerPriority(d_ptr->process);
+}
+
+
+void VideoExporter::startAudio(const EncoderParams &params)
+{
+    Q_D(VideoExporter);
+    d->cachedAudio.clear();
+    // the music has been hashed while the frames were prepared
+    if (d->audioKey.isEmpty())
+        return;
+    d->cachedAudio = d->audioCache->lookup(d->audioKey, d->audioFormat);
+    if (!d->cachedAudio.isEmpty()) {
+        emit output(tr("Using the encoded audio from the cache: %1").arg(d->cachedAudio));
+        return;
+    }
+    d->audioStaging = d->audioCache->begin(d->audioKey, d->audioFormat);
+    if (d->audioStaging.isEmpty())
+        return;
+    EncoderParams audioParams = params;
+    audioParams.outputFile = d->audioStaging;
+    EncoderCommand command = d->encoder->audioCommand(audioParams, d->audioFormat);
+    if (command.program.isEmpty() && d->audioEncoder != nullptr && d->audioEncoder->isAvailable())
+        command = d->audioEncoder->audioCommand(audioParams, d->audioFormat);
+    if (command.program.isEmpty()) {
+        d->audioCache->abort(d->audioStaging);
+        return;
+    }
+    emit output(command.toString());
+    d->audioProcess = new QProcess;
+    d->audioProcess->setProcessChannelMode(QProcess::MergedChannels);
+    QObject::connect(d->audioProcess, SIGNAL(finished(int, QProcess::ExitStatus)), SLOT(audioFinished(int, QProcess::ExitStatus)));
+    d->audioProcess->start(command.program, command.arguments);
+    // a process that doesn't start never finishes
+    if (!d->audioProcess->waitForStarted()) {
+        delete d->audioProcess;
+        d->audioProcess = nullptr;
+        d->audioCache->abort(d->audioStaging);
+        return;
+    }
+    if (d->options.lowPriority)
+        lowerPriority(d->audioProcess);
+}
+
+
+void VideoExporter::stopAudio(void)
+{
+    Q_D(VideoExporter);
+    d->waitingForAudio = false;
+    if (d->audioProcess == nullptr)
+        return;
+    QObject::disconnect(d->audioProcess, 0, this, 0);
+    d->audioProcess->kill();
+    d->audioProcess->waitForFinished();
+    d->audioProcess->deleteLater();
+    d->audioProcess = nullptr;
+    d->audioCache->abort(d->audioStaging);
+}
+
+
+void VideoExporter::audioFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    Q_D(VideoExporter);
+    if (exitStatus == QProcess::NormalExit && exitCode == 0) {
+        d->cachedAudio = d->audioCache->commit(d->audioKey, d->audioFormat, d->audioStaging);
+    }
+    else {
+        // the audio gets encoded while muxing then
+        emit output(QString::fromLocal8Bit(d->audioProcess->readAll()));
+        d->audioCache->abort(d->audioStaging);
+    }
+    // this is called from a slot of the process
+    d->audioProcess->deleteLater();
+    d->audioProcess = nullptr;
+    if (d->waitingForAudio) {
+        d->waitingForAudio = false;
+        videoFinished(true);
+    }
+}
+
+
+void VideoExporter::videoFinished(bool ok)
+{
+    Q_D(VideoExporter);
+    if (!ok) {
+        finish(false);
+        return;
+    }
+    if (d->audioProcess != nullptr) {
+        d->waitingForAudio = true;
+        emit output(tr("Waiting for the audio to be encoded ..."));
+        return;
+    }
+    if (d->muxPending)
+        runMuxCommand();
+    else
+        finish(true);
+}
+
+
+void VideoExporter::runMuxCommand(void)
+{
+    Q_D(VideoExporter);
+    const QString &rest = d->reader.flush();
+    if (!rest.isEmpty())
+        emit output(rest);
+    ++d->pass;
+    d->passFrames = d->framesNeeded;
+    d->segmented = false;
+    d->reader = EncoderOutputReader(d->encoder);
+    d->passClock.start();
+    reportProgress(0, d->passFrames);
+    d->muxPending = false;
+    EncoderParams params = d->muxParams;
+    if (!d->cachedAudio.isEmpty()) {
+        params.audioFile = d->cachedAudio;
+        params.audioEncoded = true;
+    }
+    runCommand(d->encoder->concatCommand(d->muxInputs, d->muxListFile, params));
+}
+
+
+void VideoExporter::keepVideo(void)
+{
+    Q_D(VideoExporter);
+    d->keepWatcher.waitForFinished();
+    if (!d->lastVideoFile.isEmpty())
+        QFile::remove(d->lastVideoFile);
+    d->lastVideoFingerprint.clear();
+    d->lastVideoLink.clear();
+    d->lastVideoFrames = d->frames;
+    d->lastVideoFile = tempFileName("last-video." + QFileInfo(d->options.outputFile).suffix());
+    if (linkFile(d->options.outputFile, d->lastVideoFile)) {
+        d->lastVideoLink = d->options.outputFile;
+        d->lastVideoFingerprint = d->fingerprint;
+        return;
+    }
+    // copying a long video would block the caller for seconds
+    d->keepFingerprint = d->fingerprint;
+    d->keepWatcher.setFuture(QtConcurrent::run(copyFile, d->options.outputFile, d->lastVideoFile));
+}
+
+
+void VideoExporter::videoKept(void)
+{
+    Q_D(VideoExporter);
+    // start() may have taken the result already
+    if (d->keepFingerprint.isEmpty() || d->keepWatcher.isRunning())
+        return;
+    if (d->keepWatcher.result())
+        d->lastVideoFingerprint = d->keepFingerprint;
+    d->keepFingerprint.clear();
+}
+
+
+void VideoExporter::reportProgress(int done, int total)
+{
+    Q_D(VideoExporter);
+    emit progress(done, total);
+    ExportProgress report;
+    report.pass = d->pass;
+    report.passes = d->passes;
+    report.frames = done;
+    report.totalFrames = total;
+    report.elapsed = d->clock.elapsed();
+    if (d->segmented) {
+        int withBitrate = 0;
+        for (int i = 0; i < d->segmentEncoder.segmentCount(); ++i) {
+            const EncoderProgress &segment = d->segmentEncoder.encoderProgress(i);
+            report.segments.append(segment);
+            if (segment.bitrate > 0) {
+                report.bitrate += segment.bitrate;
+                ++withBitrate;
+            }
+        }
+        if (withBitrate > 0)
+            report.bitrate /= withBitrate;
+        // segments finish at different times, so the rates of their
+        // encoders don't add up to the rate of the whole pass
+        if (d->passClock.elapsed() > 0)
+            report.fps = 1e3 * done / d->passClock.elapsed();
+    }
+    else if (d->reader.hasProgress()) {
+        report.fps = d->reader.progress().fps;
+        report.bitrate = d->reader.progress().bitrate;
+    }
+    if (report.fps > 0)
+        report.remaining = qint64(1e3 * qMax(0, total - done) / report.fps);
+    d->lastReport = report;
+    emit progressReport(report);
+    logProgress(report, "encoding");
+}
+
+
+void VideoExporter::logProgress(const ExportProgress &report, const QString &state)
+{
+    Q_D(VideoExporter);
+    const ExportOptions &o = d->options;
+    if (o.progressLogFile.isEmpty() || d->encoder == nullptr || d->scheduler == nullptr)
+        return;
+    if (state == "encoding" && d->logClock.isValid() && d->logClock.elapsed() < LogInterval)
+        return;
+    d->logClock.start();
+    QFile log(o.progressLogFile);
+    const bool newLog = !log.exists();
+    if (!log.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+        return;
+    // tab separated, to be read into a spreadsheet
+    QTextStream out(&log);
+    if (newLog)
+        out << "time\thost\tencoder\tpreset\tsize\tfps\toutput\tstate\tpass\tframes\ttotal"
+               "\tencode_fps\tkbps\telapsed_ms\tremaining_ms\n";
+    const QSize &size = ImageResizer::fit(d->frames->size(), o.outputSize);
+    out << QDateTime::currentDateTime().toString(Qt::ISODate) << "\t"
+        << QSysInfo::machineHostName() << "\t"
+        << d->encoder->name() << "\t"
+        << PresetNames[o.preset] << "\t"
+        << size.width() << "x" << size.height() << "\t"
+        << d->scheduler->fps() << "\t"
+        << o.outputFile << "\t"
+        << state << "\t"
+        << report.pass << "/" << report.passes << "\t"
+        << report.frames << "\t"
+        << report.totalFrames << "\t"
+        << QString::number(report.fps, 'f', 2) << "\t"
+        << QString::number(report.bitrate, 'f', 1) << "\t"
+        << report.elapsed << "\t"
+        << report.remaining << "\n";
+}
+
+
+void VideoExporter::cancel(void)
+{
+    Q_D(VideoExporter);
+    if (!d->running)
+        return;
+    // the preparation may be writing temporary files
+    d->prepareCanceled = true;
+    d->prepareWatcher.waitForFinished();
+    d->muxPending = false;
+    stopAudio();
+    d->segmentEncoder.cancel();
+    if (d->process != nullptr) {
+        QObject::disconnect(d->process, 0, this, 0);
+        d->process->kill();
+    }
+    deleteProcess();
+    d->running = false;
+    removeTemporaryFiles();
+}
+
+
+void VideoExporter::deleteProcess(void)
+{
+    Q_D(VideoExporter);
+    if (d->process == nullptr)
+        return;
+    d->process->waitForFinished();
+    // this may be called from a slot of the process
+    if (d->frameStreamer != nullptr)
+        d->frameStreamer->deleteLater();
+    d->frameStreamer = nullptr;
+    d->process->deleteLater();
+    d->process = nullptr;
+}
+
+
+void VideoExporter::finish(bool ok)
+{
+    Q_D(VideoExporter);
+    const QString &rest = d->reader.flush();
+    if (!rest.isEmpty())
+        emit output(rest);
+    d->lastReport.elapsed = d->clock.elapsed();
+    if (ok) {
+        d->lastReport.frames = d->lastReport.totalFrames;
+        d->lastReport.remaining = 0;
+    }
+    logProgress(d->lastReport, ok ? "done" : "failed");
+    d->muxPending = false;
+    stopAudio();
+    deleteProcess();
+    // only an encoded video can be reused, a remuxed one is kept already
+    if (ok && !d->fingerprint.isEmpty())
+        keepVideo();
+    d->running = false;
+    removeTemporaryFiles();
+    emit finished(ok);
+}
+
+
+void VideoExporter::removeTemporaryFiles(void)
+{
+    Q_D(VideoExporter);
+    foreach (QString tempFile, d->tempFiles)
+        QFile::remove(tempFile);
+    d->tempFiles.clear();
+}
+
+
+void VideoExporter::processOutput(void)
+{
+    Q_D(VideoExporter);
+    bool progressed = false;
+    const QString &out = d->reader.read(d->process->readAllStandardOutput(), &progressed);
+    const QByteArray &err = d->process->readAllStandardError();
+    if (!out.isEmpty())
+        emit output(out);
+    if (!err.isEmpty())
+        emit output(QString::fromLocal8Bit(err));
+    if (progressed)
+        reportProgress(qMin(d->reader.progress().scheduledFrames(d->muxParams.fps), d->passFrames), d->passFrames);
+}
+
+
+void VideoExporter::streamProgress(int done, int total)
+{
+    Q_D(VideoExporter);
+    Q_UNUSED(total);
+    // the encoder's own reports are closer to the truth
+    if (!d->reader.hasProgress())
+        reportProgress(done, d->passFrames);
+}
+
+
+void VideoExporter::segmentProgress(int done, int total)
+{
+    reportProgress(done, total);
+}
+
+
+void VideoExporter::processFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    Q_D(VideoExporter);
+    const bool ok = exitStatus == QProcess::NormalExit && exitCode == 0;
+    if (d->pass > 1) {
+        finish(ok);
+        return;
+    }
+    if (d->frameStreamer != nullptr)
+        d->frameStreamer->deleteLater();
+    d->frameStreamer = nullptr;
+    videoFinished(ok);
+}
+
+
+void VideoExporter::segmentsFinished(bool ok)
+{
+    // join the segments and add the audio
+    videoFinished(ok);
+}
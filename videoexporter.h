@@ -0,0 +1,191 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __VIDEOEXPORTER_H_
+#define __VIDEOEXPORTER_H_
+
+#include <QObject>
+#include <QProcess>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QScopedPointer>
+#include <QSharedPointer>
+
+#include "encoderbackend.h"
+#include "imageresizer.h"
+
+class VideoExporterPrivate;
+class AudioCache;
+class FrameStore;
+class FrameScheduler;
+
+
+struct ExportOptions {
+    ExportOptions(void)
+        : duration(0)
+        , audioBitrate(128)
+        , resizeFilter(ImageResizer::Lanczos3)
+        , preset(EncoderBackend::Balanced)
+        , codec(EncoderBackend::H264)
+        , threads(0)
+        , frameOffset(0)
+        , streamFrames(true)
+        , loopExport(true)
+        , segmentedExport(true)
+        , reuseVideo(false)
+        , lowPriority(false)
+    { /* ... */ }
+    QString outputFile;
+    QString tempDirectory;
+    QString audioFile;
+    // length of the audio in milliseconds
+    qint64 duration;
+    int audioBitrate;
+    // 0 leaves a dimension unconstrained, see ImageResizer::fit()
+    QSize outputSize;
+    ImageResizer::Filter resizeFilter;
+    EncoderBackend::Preset preset;
+    EncoderBackend::Codec codec;
+    QStringList extraOptions;
+    // threads of the encoder, 0 for one per core
+    int threads;
+    int frameOffset;
+    bool streamFrames;
+    bool loopExport;
+    bool segmentedExport;
+    // Keeps the encoded video, as a hard link if the file system allows
+    // it and copied in the background otherwise, so that the next export
+    // only remuxes it if nothing but the audio differs.
+    bool reuseVideo;
+    // runs the encoder processes at the lowest priority, so that they
+    // only use otherwise idle cores; segmented export is not affected
+    bool lowPriority;
+    // shown during the last seconds of the video if not empty
+    QString subtitleText;
+    QString subtitleFont;
+    // the progress reports are appended to this file if not empty
+    QString progressLogFile;
+};
+
+
+// Progress of an export as reported by the encoders.
+struct ExportProgress {
+    ExportProgress(void)
+        : pass(1)
+        , passes(1)
+        , frames(0)
+        , totalFrames(0)
+        , fps(0)
+        , bitrate(0)
+        , elapsed(0)
+        , remaining(-1)
+    { /* ... */ }
+    // the last pass joins the encoded video and adds the audio, if
+    // the video has been encoded in segments or as a loop before
+    int pass;
+    int passes;
+    // frames of the current pass
+    int frames;
+    int totalFrames;
+    // summed over the segments encoded at the same time
+    qreal fps;
+    // in kbit/s, 0 if unknown
+    qreal bitrate;
+    // milliseconds since the export has been started
+    qint64 elapsed;
+    // milliseconds until the current pass is done, -1 if unknown
+    qint64 remaining;
+    // reports of the segments' encoders if encoded in segments
+    QVector<EncoderProgress> segments;
+    // a line for the status bar or the console
+    QString toString(void) const;
+};
+
+
+// Encodes the frames of a GIF, repeated in the order of a schedule
+// for as long as the music lasts, and muxes the music. Depending on
+// the options the video is encoded from one beat long loop that gets
+// copied, or in segments on all cores, or in one go. Temporary files
+// are named after the process and the exporter, so several exports
+// may share a directory.
+class VideoExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit VideoExporter(QObject *parent = nullptr);
+    ~VideoExporter();
+
+    // file in the application's data directory to log the progress of
+    // all exports to
+    static QString defaultProgressLogFile(void);
+
+    void setEncoder(EncoderBackend *encoder);
+    EncoderBackend *encoder(void) const;
+    // The encoded audio is taken from the cache, or encoded into it
+    // while the video is encoded, and then muxed without re-encoding.
+    void setAudioCache(AudioCache *cache);
+    // encodes the audio for the cache if the encoder can't do that
+    void setAudioEncoder(EncoderBackend *encoder);
+    // One file name per frame. If there are none, the frames are
+    // written to the temporary directory as needed.
+    void setFrames(QSharedPointer<const FrameStore> frames, const QStringList &frameFiles = QStringList());
+    // provides the frame rate and the order of the frames
+    void setScheduler(const FrameScheduler *scheduler);
+    void setOptions(const ExportOptions &options);
+    const ExportOptions &options(void) const;
+    // number of frames needed to cover the audio
+    int frameCount(void) const;
+
+    // Scales and writes the frames as needed in the background and
+    // then starts the encoders. Failures after start() has returned
+    // true are reported by finished(false) and errorString().
+    bool start(void);
+    // stops all encoders without emitting finished()
+    void cancel(void);
+    bool isRunning(void) const;
+    QString errorString(void) const;
+
+signals:
+    void output(const QString&);
+    void progress(int done, int total);
+    void progressReport(const ExportProgress&);
+    void finished(bool ok);
+
+private slots:
+    void streamProgress(int done, int total);
+    void segmentProgress(int done, int total);
+    void processOutput(void);
+    void processFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void segmentsFinished(bool ok);
+    void audioFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void framesPrepared(void);
+    void videoKept(void);
+
+private: // methods
+    QString tempFileName(const QString &name) const;
+    bool writeSubtitles(const QString &fileName);
+    void startEncoding(QSharedPointer<const FrameStore> outputFrames, const QStringList &frameFiles);
+    void runCommand(const EncoderCommand &command);
+    void startAudio(const EncoderParams &params);
+    void stopAudio(void);
+    void videoFinished(bool ok);
+    void runMuxCommand(void);
+    void keepVideo(void);
+    void reportProgress(int done, int total);
+    // state is "encoding", "done" or "failed"; reports while encoding
+    // are thinned out
+    void logProgress(const ExportProgress &report, const QString &state);
+    void deleteProcess(void);
+    void finish(bool ok);
+    void removeTemporaryFiles(void);
+
+private:
+    QScopedPointer<VideoExporterPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(VideoExporter)
+    Q_DISABLE_COPY(VideoExporter)
+};
+
+#endif // __VIDEOEXPORTER_H_
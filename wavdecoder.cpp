@@ -0,0 +1,145 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QObject>
+#include <QtEndian>
+#include <QtCore/QDebug>
+#include <string.h>
+
+#include "wavdecoder.h"
+
+static const int WaveFormatPcm = 0x0001;
+static const int WaveFormatFloat = 0x0003;
+static const int WaveFormatExtensible = 0xfffe;
+
+
+WavDecoder::WavDecoder(void)
+    : mMap(nullptr)
+    , mData(nullptr)
+    , mDataSize(0)
+    , mFormatTag(0)
+    , mBitsPerSample(0)
+    , mBlockAlign(0)
+{
+    // ...
+}
+
+
+WavDecoder::~WavDecoder()
+{
+    if (mMap != nullptr)
+        mFile.unmap(const_cast<uchar*>(mMap));
+}
+
+
+bool WavDecoder::open(const QString &fileName)
+{
+    mFile.setFileName(fileName);
+    if (!mFile.open(QIODevice::ReadOnly)) {
+        mErrorString = mFile.errorString();
+        return false;
+    }
+    const qint64 fileSize = mFile.size();
+    mMap = mFile.map(0, fileSize);
+    if (mMap == nullptr) {
+        mErrorString = mFile.errorString();
+        return false;
+    }
+    if (fileSize < 12 || memcmp(mMap, "RIFF", 4) != 0 || memcmp(mMap + 8, "WAVE", 4) != 0) {
+        mErrorString = QObject::tr("Not a RIFF WAVE file");
+        return false;
+    }
+    bool haveFormat = false;
+    qint64 pos = 12;
+    while (pos + 8 <= fileSize) {
+        const uchar *chunk = mMap + pos;
+        const qint64 chunkSize = qFromLittleEndian<quint32>(chunk + 4);
+        const uchar *body = chunk + 8;
+        // a truncated file may end within the chunk
+        const qint64 bodySize = qMin(chunkSize, fileSize - (pos + 8));
+        if (memcmp(chunk, "fmt ", 4) == 0 && bodySize >= 16) {
+            mFormatTag = qFromLittleEndian<quint16>(body);
+            mChannels = qFromLittleEndian<quint16>(body + 2);
+            mSampleRate = qFromLittleEndian<quint32>(body + 4);
+            mBlockAlign = qFromLittleEndian<quint16>(body + 12);
+            mBitsPerSample = qFromLittleEndian<quint16>(body + 14);
+            // WAVE_FORMAT_EXTENSIBLE carries the actual format in the first two bytes of the sub format GUID
+            if (mFormatTag == WaveFormatExtensible && bodySize >= 26)
+                mFormatTag = qFromLittleEndian<quint16>(body + 24);
+            haveFormat = true;
+        }
+        else if (memcmp(chunk, "data", 4) == 0) {
+            mData = body;
+            mDataSize = bodySize;
+            break;
+        }
+        // chunks are padded to an even number of bytes
+        pos += 8 + chunkSize + (chunkSize & 1);
+    }
+    if (!haveFormat || mData == nullptr) {
+        mErrorString = QObject::tr("WAVE file lacks format or data chunk");
+        return false;
+    }
+    const bool supported =
+            (mFormatTag == WaveFormatPcm && (mBitsPerSample == 8 || mBitsPerSample == 16 || mBitsPerSample == 24 || mBitsPerSample == 32)) ||
+            (mFormatTag == WaveFormatFloat && mBitsPerSample == 32);
+    if (!supported || mChannels <= 0 || mBlockAlign < mChannels * mBitsPerSample / 8) {
+        mErrorString = QObject::tr("Unsupported WAVE format %1 with %2 bits per sample").arg(mFormatTag).arg(mBitsPerSample);
+        return false;
+    }
+    mFrameCount = mDataSize / mBlockAlign;
+    return true;
+}
+
+
+const SampleBufferType *WavDecoder::constData(void) const
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    if (mFormatTag == WaveFormatPcm && mBitsPerSample == 16 && mBlockAlign == 2 * mChannels)
+        return reinterpret_cast<const SampleBufferType*>(mData);
+#endif
+    return nullptr;
+}
+
+
+bool WavDecoder::decode(SampleBuffer &samples)
+{
+    const qint64 sampleCount = mFrameCount * mChannels;
+    samples.resize(int(sampleCount));
+    SampleBufferType *dst = samples.data();
+    const SampleBufferType *in = constData();
+    if (in != nullptr) {
+        memcpy(dst, in, sampleCount * sizeof(SampleBufferType));
+        return true;
+    }
+    const int bytesPerSample = mBitsPerSample / 8;
+    for (qint64 frame = 0; frame < mFrameCount && !mCanceled; ++frame) {
+        const uchar *src = mData + frame * mBlockAlign;
+        for (int c = 0; c < mChannels; ++c) {
+            switch (mBitsPerSample) {
+            case 8:
+                *dst++ = SampleBufferType((int(src[0]) - 128) << 8);
+                break;
+            case 16:
+                *dst++ = qFromLittleEndian<qint16>(src);
+                break;
+            case 24:
+                *dst++ = SampleBufferType(qFromLittleEndian<qint16>(src + 1));
+                break;
+            case 32:
+                if (mFormatTag == WaveFormatFloat) {
+                    const quint32 bits = qFromLittleEndian<quint32>(src);
+                    float f;
+                    memcpy(&f, &bits, sizeof(f));
+                    *dst++ = SampleBufferType(qBound(-32768, qRound(f * 32768.f), 32767));
+                }
+                else {
+                    *dst++ = SampleBufferType(qFromLittleEndian<qint32>(src) >> 16);
+                }
+                break;
+            }
+            src += bytesPerSample;
+        }
+    }
+    return !mCanceled;
+}
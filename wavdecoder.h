@@ -0,0 +1,32 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __WAVDECODER_H_
+#define __WAVDECODER_H_
+
+#include <QFile>
+#include "pcmdecoder.h"
+
+// Reads RIFF WAVE files from a memory mapping. 16 bit little endian
+// PCM is served in place, other sample formats are converted.
+class WavDecoder : public PcmDecoder
+{
+public:
+    WavDecoder(void);
+    ~WavDecoder();
+
+    bool open(const QString &fileName);
+    bool decode(SampleBuffer &samples);
+    const SampleBufferType *constData(void) const;
+
+private:
+    QFile mFile;
+    const uchar *mMap;
+    const uchar *mData;
+    qint64 mDataSize;
+    int mFormatTag;
+    int mBitsPerSample;
+    int mBlockAlign;
+};
+
+#endif // __WAVDECODER_H_
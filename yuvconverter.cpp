@@ -0,0 +1,155 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#include <QImage>
+#include <QByteArray>
+
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#define YUV_USE_SSE
+#include <emmintrin.h>
+#endif
+
+#include "yuvconverter.h"
+
+
+static inline int luma(quint32 p)
+{
+    const int r = (p >> 16) & 0xff, g = (p >> 8) & 0xff, b = p & 0xff;
+    return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+
+static inline quint32 average2x2(quint32 a0, quint32 a1, quint32 b0, quint32 b1)
+{
+    // same rounding as two rounds of _mm_avg_epu8: first vertical, then horizontal
+    quint32 result = 0;
+    for (int shift = 0; shift < 24; shift += 8) {
+        const int v0 = (((a0 >> shift) & 0xff) + ((b0 >> shift) & 0xff) + 1) >> 1;
+        const int v1 = (((a1 >> shift) & 0xff) + ((b1 >> shift) & 0xff) + 1) >> 1;
+        result |= quint32((v0 + v1 + 1) >> 1) << shift;
+    }
+    return result;
+}
+
+
+static inline int chromaU(quint32 p)
+{
+    const int r = (p >> 16) & 0xff, g = (p >> 8) & 0xff, b = p & 0xff;
+    return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+
+static inline int chromaV(quint32 p)
+{
+    const int r = (p >> 16) & 0xff, g = (p >> 8) & 0xff, b = p & 0xff;
+    return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+
+#ifdef YUV_USE_SSE
+// weighted sums of the B, G, R, A bytes of four pixels as 32 bit integers
+static inline __m128i dot4(__m128i px, __m128i coeff)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), coeff);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), coeff);
+    lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+    hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+    lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+    hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+    return _mm_unpacklo_epi64(lo, hi);
+}
+
+
+static inline __m128i scale(__m128i x, int offset)
+{
+    return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(x, _mm_set1_epi32(128)), 8), _mm_set1_epi32(offset));
+}
+
+
+// averages of horizontally adjacent pixels in the lower two lanes
+static inline __m128i pairAverage(__m128i px)
+{
+    return _mm_shuffle_epi32(_mm_avg_epu8(px, _mm_srli_epi64(px, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+}
+#endif
+
+
+int i420Size(int width, int height)
+{
+    return width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2);
+}
+
+
+void rgb32ToI420(const uchar *src, int stride, int width, int height, uchar *dst)
+{
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
+    uchar *dstY = dst;
+    uchar *dstU = dst + width * height;
+    uchar *dstV = dstU + chromaWidth * chromaHeight;
+#ifdef YUV_USE_SSE
+    const __m128i coeffY = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+    const __m128i coeffU = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+    const __m128i coeffV = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+#endif
+    for (int y = 0; y < height; y += 2) {
+        const quint32 *row0 = reinterpret_cast<const quint32*>(src + y * stride);
+        const quint32 *row1 = (y + 1 < height) ? reinterpret_cast<const quint32*>(src + (y + 1) * stride) : row0;
+        const int rows = (y + 1 < height) ? 2 : 1;
+        for (int r = 0; r < rows; ++r) {
+            const quint32 *row = (r == 0) ? row0 : row1;
+            uchar *out = dstY + (y + r) * width;
+            int x = 0;
+#ifdef YUV_USE_SSE
+            for (; x + 16 <= width; x += 16) {
+                const __m128i *p = reinterpret_cast<const __m128i*>(row + x);
+                const __m128i y0 = scale(dot4(_mm_loadu_si128(p), coeffY), 16);
+                const __m128i y1 = scale(dot4(_mm_loadu_si128(p + 1), coeffY), 16);
+                const __m128i y2 = scale(dot4(_mm_loadu_si128(p + 2), coeffY), 16);
+                const __m128i y3 = scale(dot4(_mm_loadu_si128(p + 3), coeffY), 16);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x),
+                                 _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3)));
+            }
+#endif
+            for (; x < width; ++x)
+                out[x] = uchar(luma(row[x]));
+        }
+        uchar *outU = dstU + (y / 2) * chromaWidth;
+        uchar *outV = dstV + (y / 2) * chromaWidth;
+        int x = 0;
+#ifdef YUV_USE_SSE
+        for (; x + 16 <= width; x += 16) {
+            const __m128i *p0 = reinterpret_cast<const __m128i*>(row0 + x);
+            const __m128i *p1 = reinterpret_cast<const __m128i*>(row1 + x);
+            const __m128i h0 = pairAverage(_mm_avg_epu8(_mm_loadu_si128(p0), _mm_loadu_si128(p1)));
+            const __m128i h1 = pairAverage(_mm_avg_epu8(_mm_loadu_si128(p0 + 1), _mm_loadu_si128(p1 + 1)));
+            const __m128i h2 = pairAverage(_mm_avg_epu8(_mm_loadu_si128(p0 + 2), _mm_loadu_si128(p1 + 2)));
+            const __m128i h3 = pairAverage(_mm_avg_epu8(_mm_loadu_si128(p0 + 3), _mm_loadu_si128(p1 + 3)));
+            const __m128i c01 = _mm_unpacklo_epi64(h0, h1);
+            const __m128i c23 = _mm_unpacklo_epi64(h2, h3);
+            const __m128i u = _mm_packs_epi32(scale(dot4(c01, coeffU), 128), scale(dot4(c23, coeffU), 128));
+            const __m128i v = _mm_packs_epi32(scale(dot4(c01, coeffV), 128), scale(dot4(c23, coeffV), 128));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(outU + x / 2), _mm_packus_epi16(u, u));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(outV + x / 2), _mm_packus_epi16(v, v));
+        }
+#endif
+        for (; x < width; x += 2) {
+            const int x1 = qMin(x + 1, width - 1);
+            const quint32 avg = average2x2(row0[x], row0[x1], row1[x], row1[x1]);
+            outU[x / 2] = uchar(chromaU(avg));
+            outV[x / 2] = uchar(chromaV(avg));
+        }
+    }
+}
+
+
+QByteArray toI420(const QImage &image)
+{
+    const QImage &rgb = (image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32 || image.format() == QImage::Format_ARGB32_Premultiplied)
+            ? image
+            : image.convertToFormat(QImage::Format_RGB32);
+    QByteArray result(i420Size(rgb.width(), rgb.height()), Qt::Uninitialized);
+    rgb32ToI420(rgb.constBits(), rgb.bytesPerLine(), rgb.width(), rgb.height(), reinterpret_cast<uchar*>(result.data()));
+    return result;
+}
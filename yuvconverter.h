@@ -0,0 +1,24 @@
+// Copyright (c) 2014 Oliver Lau <ola@ct.de>, Heise Zeitschriften Verlag.
+// All rights reserved.
+
+#ifndef __YUVCONVERTER_H_
+#define __YUVCONVERTER_H_
+
+#include <QtGlobal>
+
+class QImage;
+class QByteArray;
+
+// size in bytes of a planar YUV 4:2:0 image
+int i420Size(int width, int height);
+
+// Converts 32 bit RGB (memory layout of QImage::Format_RGB32, ARGB32
+// and ARGB32_Premultiplied) to planar YUV 4:2:0 with BT.601 studio
+// swing coefficients. The Y plane is followed by the U and V planes,
+// each subsampled 2:1 in both directions. Odd widths and heights are
+// padded by repeating the last column or row.
+void rgb32ToI420(const uchar *src, int stride, int width, int height, uchar *dst);
+
+QByteArray toI420(const QImage &image);
+
+#endif // __YUVCONVERTER_H_